@@ -0,0 +1,187 @@
+#include "common.h"
+#include "advent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Every day's solver linked into one binary.
+
+   advent <day> [<args>...]
+       Run one day, same as dayN/advent [<args>...]
+
+   advent --cache <day> [<args>...]
+       Run one day, or print the saved answer if it's been run on the
+       same input by the same build before.  See cache.c.
+
+   advent --batch [--json] [--workers <n>] <day> <dir> [<args>...]
+       Run one day on every file in <dir>, one result per line in
+       file name order.  See batch.c.
+
+   advent --tune [<day>...]
+       Time each solver's engines at each size on this host and save
+       which is fastest, for all the days with a choice or only these.
+       See tune.c.
+
+   advent --daemon <socket> [<workers>]
+       adventd mode, serve solvers on a Unix socket.  See adventd.c.
+
+   advent --client <socket> <day> [<args>...]
+       Send a request to adventd, print the answer and exit with the
+       solver's status.
+
+   Day 6 is a flex/bison parser with its own Makefile and is not included. */
+
+int day1_main(int argc, char **argv);
+int day2_main(int argc, char **argv);
+int day3_main(int argc, char **argv);
+int day4_main(int argc, char **argv);
+int day5_main(int argc, char **argv);
+int day7_main(int argc, char **argv);
+int day8_main(int argc, char **argv);
+int day9_main(int argc, char **argv);
+int day10_main(int argc, char **argv);
+int day11_main(int argc, char **argv);
+int day12_main(int argc, char **argv);
+int day13_main(int argc, char **argv);
+int day14_main(int argc, char **argv);
+int day15_main(int argc, char **argv);
+int day16_main(int argc, char **argv);
+int day17_main(int argc, char **argv);
+int day18_main(int argc, char **argv);
+
+static Solver Solvers[] = {
+    {  1, "day1",  day1_main,   day1_solve   },
+    {  2, "day2",  day2_main,   day2_solve   },
+    {  3, "day3",  day3_main,   day3_solve   },
+    {  4, "day4",  day4_main,   day4_solve   },
+    {  5, "day5",  day5_main,   day5_solve   },
+    {  7, "day7",  day7_main,   day7_solve   },
+    {  8, "day8",  day8_main,   day8_solve   },
+    {  9, "day9",  day9_main,   day9_solve   },
+    { 10, "day10", day10_main,  day10_solve  },
+    { 11, "day11", day11_main,  day11_solve  },
+    { 12, "day12", day12_main,  day12_solve  },
+    { 13, "day13", day13_main,  day13_solve  },
+    { 14, "day14", day14_main,  day14_solve  },
+    { 15, "day15", day15_main,  day15_solve  },
+    { 16, "day16", day16_main,  day16_solve  },
+    { 17, "day17", day17_main,  day17_solve  },
+    { 18, "day18", day18_main,  day18_solve  },
+    {  0, NULL,    NULL,        NULL         }
+};
+
+Solver *Solver_lookup(int day) {
+    for( Solver *solver = Solvers; solver->main != NULL; solver++ ) {
+        if( solver->day == day )
+            return solver;
+    }
+
+    return NULL;
+}
+
+/* Accepts "9" or "day9" */
+Solver *Solver_lookup_str(const char *day) {
+    if( strncmp(day, "day", 3) == 0 )
+        day += 3;
+
+    char *end;
+    long num = strtol(day, &end, 10);
+    if( end == day || *end != '\0' )
+        return NULL;
+
+    return Solver_lookup(num);
+}
+
+/* argv[0] is replaced with the solver's name, the rest are passed along */
+int Solver_run(Solver *self, int argc, char **argv) {
+    char *orig_name = argv[0];
+
+    argv[0] = self->name;
+    int ret = self->main(argc, argv);
+    argv[0] = orig_name;
+
+    return ret;
+}
+
+int num_cpus() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? cpus : 1;
+}
+
+static void advent_usage(char *name) {
+    char *run_desc[]    = {name, "<day>", "[<args>...]"};
+    char *cache_desc[]  = {name, "--cache", "<day>", "[<args>...]"};
+    char *batch_desc[]  = {name, "--batch", "[--json]", "[--workers <n>]", "<day>", "<dir>", "[<args>...]"};
+    char *tune_desc[]   = {name, "--tune", "[<day>...]"};
+    char *daemon_desc[] = {name, "--daemon", "<socket>", "[<workers>]"};
+    char *client_desc[] = {name, "--client", "<socket>", "<day>", "[<args>...]"};
+
+    usage(3, run_desc);
+    usage(4, cache_desc);
+    usage(7, batch_desc);
+    usage(3, tune_desc);
+    usage(4, daemon_desc);
+    usage(5, client_desc);
+}
+
+static int batch_main(int argc, char **argv) {
+    BatchFormat format = BATCH_TSV;
+    int workers = num_cpus();
+    int i;
+
+    for( i = 0; i < argc && argv[i][0] == '-'; i++ ) {
+        if( streq(argv[i], "--json") )
+            format = BATCH_JSON;
+        else if( streq(argv[i], "--tsv") )
+            format = BATCH_TSV;
+        else if( streq(argv[i], "--workers") && i + 1 < argc )
+            workers = atoi(argv[++i]);
+        else
+            die("Unknown batch option %s", argv[i]);
+    }
+
+    if( argc - i < 2 )
+        return -1;
+
+    Solver *solver = Solver_lookup_str(argv[i]);
+    if( !solver )
+        die("There is no solver for day %s", argv[i]);
+
+    return advent_batch(solver, argv[i+1], argc - i - 2, argv + i + 2, format, workers);
+}
+
+int main(int argc, char **argv) {
+    if( argc >= 2 && streq(argv[1], "--batch") ) {
+        int ret = batch_main(argc - 2, argv + 2);
+        if( ret >= 0 )
+            return ret;
+    }
+    else if( argc >= 3 && streq(argv[1], "--cache") ) {
+        Solver *solver = Solver_lookup_str(argv[2]);
+        if( !solver )
+            die("There is no solver for day %s", argv[2]);
+
+        return advent_cached_run(solver, argc - 2, argv + 2);
+    }
+    else if( argc >= 2 && streq(argv[1], "--tune") ) {
+        return advent_tune(argc - 2, argv + 2);
+    }
+    else if( argc >= 3 && streq(argv[1], "--daemon") ) {
+        int workers = argc >= 4 ? atoi(argv[3]) : num_cpus();
+        return adventd_serve(argv[2], workers);
+    }
+    else if( argc >= 4 && streq(argv[1], "--client") ) {
+        return adventd_request(argv[2], argc - 3, argv + 3);
+    }
+    else if( argc >= 2 && argv[1][0] != '-' ) {
+        Solver *solver = Solver_lookup_str(argv[1]);
+        if( !solver )
+            die("There is no solver for day %s", argv[1]);
+
+        return Solver_run(solver, argc - 1, argv + 1);
+    }
+
+    advent_usage(argv[0]);
+
+    return 1;
+}
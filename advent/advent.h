@@ -0,0 +1,39 @@
+#ifndef _advent_h
+#define _advent_h
+
+#include "common.h"
+#include "solve.h"
+
+/* Each day's main(), renamed to dayN_main when compiled into advent */
+typedef int (*DayMain)(int argc, char **argv);
+
+typedef struct {
+    int day;
+    char *name;
+    DayMain main;
+    /* The same solver as a library call, see solve.h */
+    SolveFunc solve;
+} Solver;
+
+Solver *Solver_lookup(int day);
+Solver *Solver_lookup_str(const char *day);
+int Solver_run(Solver *self, int argc, char **argv);
+
+typedef enum {
+    BATCH_TSV,
+    BATCH_JSON
+} BatchFormat;
+
+int advent_batch(Solver *solver, const char *path, int argc, char **argv,
+                 BatchFormat format, int num_workers);
+
+int advent_cached_run(Solver *solver, int argc, char **argv);
+
+int advent_tune(int argc, char **argv);
+
+int adventd_serve(const char *socket_path, int num_workers);
+int adventd_request(const char *socket_path, int argc, char **argv);
+
+int num_cpus();
+
+#endif
@@ -0,0 +1,379 @@
+#include "common.h"
+#include "advent.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+/* adventd: serve the solvers over a Unix socket.
+
+   A request is one line: the day followed by its arguments, quoted like
+   a shell command line.  "9 day9/input" runs day 9 on day9/input.  An
+   argument of "-" is replaced by a file holding everything the client
+   sends after the request line, so input can be sent inline.  The
+   client resolves relative paths before sending them, the daemon's
+   working directory is not the client's.
+
+   The response is whatever the solver prints, then a NUL and the
+   solver's exit status on a line of its own, then the connection
+   closes.  The client prints the output and exits with the status.
+
+   Solvers die() when they're unhappy, so requests are served by worker
+   processes.  A worker serves many requests in a row, keeping its
+   compiled regexes and warm heap, and is replaced if it exits.  A
+   worker exiting in the middle of a request still sends the status.
+   If it's killed there's no status, and the client calls that a
+   failure. */
+
+/* Bounds how much a worker can leak before it is recycled */
+#define MAX_REQUESTS_PER_WORKER 10000
+
+static volatile sig_atomic_t Stopping = 0;
+
+/* The client being served by this worker, -1 between requests */
+static int Serving = -1;
+
+static void stop_serving(int sig) {
+    Stopping = 1;
+}
+
+static void write_all(int fd, const char *buf, size_t len) {
+    while( len > 0 ) {
+        ssize_t wrote = write(fd, buf, len);
+        if( wrote < 0 ) {
+            if( errno == EINTR )
+                continue;
+            return;
+        }
+
+        buf += wrote;
+        len -= wrote;
+    }
+}
+
+static void copy_fd(int from, int to) {
+    char buf[64 * 1024];
+    ssize_t len;
+
+    while( (len = read(from, buf, sizeof(buf))) != 0 ) {
+        if( len < 0 ) {
+            if( errno == EINTR )
+                continue;
+            return;
+        }
+
+        write_all(to, buf, len);
+    }
+}
+
+static void copy_stream(FILE *from, FILE *to) {
+    char buf[64 * 1024];
+    size_t len;
+
+    while( (len = fread(buf, 1, sizeof(buf), from)) > 0 ) {
+        fwrite(buf, 1, len, to);
+    }
+}
+
+static struct sockaddr_un socket_address(const char *path) {
+    struct sockaddr_un addr;
+
+    if( strlen(path) >= sizeof(addr.sun_path) )
+        die("Socket path %s is too long", path);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    return addr;
+}
+
+static int listen_on(const char *path) {
+    struct sockaddr_un addr = socket_address(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if( fd < 0 )
+        die("Could not make a socket: %s", strerror(errno));
+
+    /* Clear out a socket left by a previous daemon */
+    unlink(path);
+
+    if( bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 )
+        die("Could not bind to %s: %s", path, strerror(errno));
+
+    if( listen(fd, SOMAXCONN) < 0 )
+        die("Could not listen on %s: %s", path, strerror(errno));
+
+    return fd;
+}
+
+static void send_status(int client, int status) {
+    char trailer[16];
+    int len = snprintf(trailer, sizeof(trailer), "%c%d\n", '\0', status);
+    write_all(client, trailer, len);
+}
+
+#ifdef __GLIBC__
+/* A solver which die()s exits the worker, the client still gets told */
+static void report_exit(int status, void *data) {
+    if( Serving < 0 )
+        return;
+
+    fflush(stdout);
+    fflush(stderr);
+    send_status(Serving, status);
+    Serving = -1;
+}
+#endif
+
+/* Run the solver with its stdout and stderr going to the client */
+static int run_for_client(Solver *solver, int argc, char **argv, int client) {
+    fflush(stdout);
+    fflush(stderr);
+
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stderr = dup(STDERR_FILENO);
+    dup2(client, STDOUT_FILENO);
+    dup2(client, STDERR_FILENO);
+
+    Serving = client;
+    int status = Solver_run(solver, argc, argv);
+    Serving = -1;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stdout);
+    close(saved_stderr);
+
+    return status;
+}
+
+static void serve_request(int client) {
+    FILE *conn = fdopen(dup(client), "r");
+    char *line = NULL;
+    size_t line_len = 0;
+    gint argc = 0;
+    gchar **argv = NULL;
+    GError *error = NULL;
+    FILE *inline_input = NULL;
+    int status = 1;
+
+    if( getline(&line, &line_len, conn) <= 0 )
+        goto done;
+
+    if( !g_shell_parse_argv(line, &argc, &argv, &error) ) {
+        dprintf(client, "Cannot understand request '%s': %s\n", g_strchomp(line), error->message);
+        g_error_free(error);
+        goto done;
+    }
+
+    Solver *solver = Solver_lookup_str(argv[0]);
+    if( !solver ) {
+        dprintf(client, "There is no solver for day %s\n", argv[0]);
+        goto done;
+    }
+
+    for( int i = 1; i < argc; i++ ) {
+        if( !streq(argv[i], "-") )
+            continue;
+
+        if( !inline_input ) {
+            inline_input = tmpfile();
+            copy_stream(conn, inline_input);
+            fflush(inline_input);
+            rewind(inline_input);
+        }
+
+        g_free(argv[i]);
+        argv[i] = g_strdup_printf("/dev/fd/%d", fileno(inline_input));
+    }
+
+    status = run_for_client(solver, argc, argv, client);
+
+  done:
+    send_status(client, status);
+    if( inline_input )
+        fclose(inline_input);
+    g_strfreev(argv);
+    free(line);
+    fclose(conn);
+}
+
+static void worker(int listener) {
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT,  SIG_DFL);
+
+    /* A client hanging up should not kill the worker */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Solvers which default to stdin get nothing */
+    int devnull = open("/dev/null", O_RDONLY);
+    dup2(devnull, STDIN_FILENO);
+    close(devnull);
+
+#ifdef __GLIBC__
+    on_exit(report_exit, NULL);
+#endif
+
+    for( int served = 0; served < MAX_REQUESTS_PER_WORKER; served++ ) {
+        int client = accept(listener, NULL, NULL);
+        if( client < 0 ) {
+            if( errno == EINTR || errno == ECONNABORTED )
+                continue;
+            die("accept failed: %s", strerror(errno));
+        }
+
+        serve_request(client);
+        close(client);
+    }
+
+    exit(0);
+}
+
+static pid_t spawn_worker(int listener) {
+    pid_t pid = fork();
+
+    if( pid < 0 )
+        die("Could not fork a worker: %s", strerror(errno));
+    else if( pid == 0 )
+        worker(listener);
+
+    return pid;
+}
+
+int adventd_serve(const char *socket_path, int num_workers) {
+    if( num_workers < 1 )
+        num_workers = 1;
+
+    int listener = listen_on(socket_path);
+    pid_t *workers = calloc(num_workers, sizeof(pid_t));
+
+    /* No SA_RESTART so waitpid() wakes up on a signal */
+    struct sigaction stop = { .sa_handler = stop_serving };
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGTERM, &stop, NULL);
+    sigaction(SIGINT,  &stop, NULL);
+
+    fflush(stdout);
+    fflush(stderr);
+    for( int i = 0; i < num_workers; i++ ) {
+        workers[i] = spawn_worker(listener);
+    }
+
+    fprintf(stderr, "adventd: serving on %s with %d workers\n", socket_path, num_workers);
+
+    while( !Stopping ) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+
+        if( pid < 0 ) {
+            if( errno == EINTR )
+                continue;
+            break;
+        }
+
+        for( int i = 0; i < num_workers; i++ ) {
+            if( workers[i] == pid && !Stopping )
+                workers[i] = spawn_worker(listener);
+        }
+    }
+
+    for( int i = 0; i < num_workers; i++ ) {
+        kill(workers[i], SIGTERM);
+    }
+    while( waitpid(-1, NULL, 0) > 0 || errno == EINTR )
+        ;
+
+    close(listener);
+    unlink(socket_path);
+    free(workers);
+
+    return 0;
+}
+
+/* Prints the response up to the NUL, returns the status after it */
+static int read_response(int fd) {
+    char buf[64 * 1024];
+    char status[16];
+    size_t status_len = 0;
+    bool in_status = false;
+    ssize_t len;
+
+    while( (len = read(fd, buf, sizeof(buf))) != 0 ) {
+        if( len < 0 ) {
+            if( errno == EINTR )
+                continue;
+            break;
+        }
+
+        char *output = buf;
+        if( !in_status ) {
+            char *nul = memchr(buf, '\0', len);
+            write_all(STDOUT_FILENO, buf, nul ? nul - buf : len);
+            if( !nul )
+                continue;
+
+            in_status = true;
+            output = nul + 1;
+        }
+
+        size_t rest = MIN((size_t)(buf + len - output), sizeof(status) - 1 - status_len);
+        memcpy(status + status_len, output, rest);
+        status_len += rest;
+    }
+    status[status_len] = '\0';
+
+    if( !in_status || status_len == 0 ) {
+        fprintf(stderr, "adventd: the request ended without a status\n");
+        return 1;
+    }
+
+    return atoi(status);
+}
+
+int adventd_request(const char *socket_path, int argc, char **argv) {
+    struct sockaddr_un addr = socket_address(socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if( fd < 0 )
+        die("Could not make a socket: %s", strerror(errno));
+
+    if( connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 )
+        die("Could not connect to %s: %s", socket_path, strerror(errno));
+
+    GString *request = g_string_new(NULL);
+    bool send_stdin = false;
+    for( int i = 0; i < argc; i++ ) {
+        /* Anything naming a file here is sent as a full path */
+        char *path = i > 0 && argv[i][0] != '/' && !streq(argv[i], "-") ? realpath(argv[i], NULL) : NULL;
+        gchar *quoted = g_shell_quote(path ? path : argv[i]);
+        free(path);
+        g_string_append_printf(request, "%s%s", i ? " " : "", quoted);
+        g_free(quoted);
+
+        if( streq(argv[i], "-") )
+            send_stdin = true;
+    }
+    g_string_append_c(request, '\n');
+
+    write_all(fd, request->str, request->len);
+    g_string_free(request, true);
+
+    if( send_stdin )
+        copy_fd(STDIN_FILENO, fd);
+    shutdown(fd, SHUT_WR);
+
+    int status = read_response(fd);
+    close(fd);
+
+    return status;
+}
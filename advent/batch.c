@@ -0,0 +1,241 @@
+#include "common.h"
+#include "advent.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/* advent --batch: run one day's solver over every file in a directory.
+
+   Inputs are handed out to a fixed pool of worker threads, each with
+   its own SolveContext (see solve.h).  Like adventd's workers each one
+   runs many inputs in a row, so compiled regexes and the warm heap
+   carry over from one input to the next.  A solver which die()s fails
+   only that input.  One which crashes takes the batch with it.
+
+   Results are printed in input order as soon as every earlier input
+   has finished. */
+
+typedef struct {
+    char *path;
+    char *output;
+    size_t output_len;
+    int status;
+    bool done;
+} BatchResult;
+
+typedef struct {
+    Solver *solver;
+
+    /* Arguments passed after the input file */
+    int argc;
+    char **argv;
+
+    BatchResult *results;
+    int num_inputs;
+
+    /* Guards next_task and each result's done */
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    int next_task;
+} Batch;
+
+static int path_cmp(const void *a, const void *b) {
+    return strcmp(*(char **)a, *(char **)b);
+}
+
+/* Every regular, non-hidden file in the directory, sorted by name.
+   A plain file is a batch of one. */
+static GPtrArray *batch_inputs(const char *path) {
+    GPtrArray *inputs = g_ptr_array_new_with_free_func(g_free);
+    struct stat st;
+
+    if( stat(path, &st) < 0 )
+        die("Could not read %s: %s", path, strerror(errno));
+
+    if( !S_ISDIR(st.st_mode) ) {
+        g_ptr_array_add(inputs, g_strdup(path));
+        return inputs;
+    }
+
+    DIR *dir = opendir(path);
+    if( !dir )
+        die("Could not open directory %s: %s", path, strerror(errno));
+
+    struct dirent *entry;
+    while( (entry = readdir(dir)) != NULL ) {
+        if( entry->d_name[0] == '.' )
+            continue;
+
+        char *file = g_build_filename(path, entry->d_name, NULL);
+        if( stat(file, &st) == 0 && S_ISREG(st.st_mode) )
+            g_ptr_array_add(inputs, file);
+        else
+            g_free(file);
+    }
+    closedir(dir);
+
+    qsort(inputs->pdata, inputs->len, sizeof(char *), path_cmp);
+
+    return inputs;
+}
+
+/* The solve's output, then why it failed if it did */
+static void BatchResult_finish(BatchResult *self, SolveContext *ctx, int status) {
+    GString *output = g_string_new_len(ctx->output->str, ctx->output->len);
+    if( ctx->error )
+        g_string_append_printf(output, "%s\n", ctx->error);
+
+    self->output_len = output->len;
+    self->output     = g_string_free(output, false);
+    self->status     = status;
+}
+
+static void *batch_worker(void *_batch) {
+    Batch *batch = _batch;
+    SolveContext *ctx = SolveContext_new();
+
+    for(;;) {
+        pthread_mutex_lock(&batch->lock);
+        int task = batch->next_task < batch->num_inputs ? batch->next_task++ : -1;
+        pthread_mutex_unlock(&batch->lock);
+
+        if( task < 0 )
+            break;
+
+        BatchResult *result = &batch->results[task];
+        int status = SolveContext_solve_file(ctx, batch->solver->solve, result->path,
+                                             batch->argc, batch->argv);
+        BatchResult_finish(result, ctx, status);
+
+        pthread_mutex_lock(&batch->lock);
+        result->done = true;
+        pthread_cond_signal(&batch->finished);
+        pthread_mutex_unlock(&batch->lock);
+    }
+
+    SolveContext_destroy(ctx);
+
+    return NULL;
+}
+
+/* TSV has no quoting, so tabs and newlines in the output are escaped */
+static void print_tsv_string(FILE *out, const char *str, size_t len) {
+    for( size_t i = 0; i < len; i++ ) {
+        switch( str[i] ) {
+            case '\t':  fputs("\\t", out);  break;
+            case '\n':  fputs("\\n", out);  break;
+            case '\r':  fputs("\\r", out);  break;
+            case '\\':  fputs("\\\\", out); break;
+            default:    fputc(str[i], out); break;
+        }
+    }
+}
+
+static void print_json_string(FILE *out, const char *str, size_t len) {
+    fputc('"', out);
+    for( size_t i = 0; i < len; i++ ) {
+        unsigned char c = str[i];
+        switch( c ) {
+            case '"':   fputs("\\\"", out); break;
+            case '\\':  fputs("\\\\", out); break;
+            case '\n':  fputs("\\n", out);  break;
+            case '\t':  fputs("\\t", out);  break;
+            case '\r':  fputs("\\r", out);  break;
+            default:
+                if( c < 0x20 )
+                    fprintf(out, "\\u%04x", c);
+                else
+                    fputc(c, out);
+                break;
+        }
+    }
+    fputc('"', out);
+}
+
+static void BatchResult_print(BatchResult *self, BatchFormat format, FILE *out) {
+    /* The trailing newline is the end of the record, not part of it */
+    size_t len = self->output_len;
+    if( len > 0 && self->output[len-1] == '\n' )
+        len--;
+
+    switch( format ) {
+        case BATCH_TSV:
+            print_tsv_string(out, self->path, strlen(self->path));
+            fprintf(out, "\t%d\t", self->status);
+            print_tsv_string(out, self->output, len);
+            break;
+        case BATCH_JSON:
+            fputs("{\"input\":", out);
+            print_json_string(out, self->path, strlen(self->path));
+            fprintf(out, ",\"status\":%d,\"output\":", self->status);
+            print_json_string(out, self->output, len);
+            fputc('}', out);
+            break;
+    }
+    fputc('\n', out);
+    fflush(out);
+
+    g_free(self->output);
+    self->output = NULL;
+}
+
+int advent_batch(Solver *solver, const char *path, int argc, char **argv,
+                 BatchFormat format, int num_workers)
+{
+    GPtrArray *inputs = batch_inputs(path);
+
+    Batch batch = {
+        .solver     = solver,
+        .argc       = argc,
+        .argv       = argv,
+        .num_inputs = inputs->len,
+        .results    = calloc(inputs->len + 1, sizeof(BatchResult)),
+        .next_task  = 0
+    };
+    for( int i = 0; i < batch.num_inputs; i++ ) {
+        batch.results[i].path = g_ptr_array_index(inputs, i);
+    }
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.finished, NULL);
+
+    if( num_workers > batch.num_inputs )
+        num_workers = batch.num_inputs;
+    if( num_workers < 1 )
+        num_workers = 1;
+
+    pthread_t *workers = calloc(num_workers, sizeof(pthread_t));
+    for( int i = 0; i < num_workers; i++ ) {
+        if( pthread_create(&workers[i], NULL, batch_worker, &batch) != 0 )
+            die("Could not start a worker: %s", strerror(errno));
+    }
+
+    int failed = 0;
+    for( int next_print = 0; next_print < batch.num_inputs; next_print++ ) {
+        BatchResult *result = &batch.results[next_print];
+
+        pthread_mutex_lock(&batch.lock);
+        while( !result->done )
+            pthread_cond_wait(&batch.finished, &batch.lock);
+        pthread_mutex_unlock(&batch.lock);
+
+        if( result->status != 0 )
+            failed++;
+        BatchResult_print(result, format, stdout);
+    }
+
+    for( int i = 0; i < num_workers; i++ ) {
+        pthread_join(workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&batch.finished);
+    pthread_mutex_destroy(&batch.lock);
+    free(workers);
+    free(batch.results);
+    g_ptr_array_free(inputs, true);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,336 @@
+/* dl_iterate_phdr() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "common.h"
+#include "advent.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <elf.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* advent --cache: remember the answers of solver runs on disk.
+
+   A run is keyed by a SHA-256 of the day, the build of this binary,
+   each argument and, for arguments which are files, their contents.
+   Change the input, the arguments or rebuild and it's a new key, so
+   entries never go stale, they're just never asked for again.
+
+   A solver given "-", or no file at all, might read stdin.  Then stdin
+   is read into a temp file, which goes into the key and is handed to
+   the solver as its stdin.  If stdin is a terminal there's no telling
+   what will be typed, so the run isn't cached.
+
+   An entry is a directory holding what the run printed to stdout and
+   stderr, so stats from --counters and friends come back with the
+   answer.  It is written as a temp directory which is then renamed into
+   place, so a reader sees a whole entry or none.  Only runs which
+   succeed are kept.
+
+   The cache lives in $ADVENT_CACHE, else $XDG_CACHE_HOME/advent, else
+   ~/.cache/advent.  Delete it whenever you like. */
+
+static char *cache_dir() {
+    const char *dir = getenv("ADVENT_CACHE");
+    if( dir && !is_empty(dir) )
+        return g_strdup(dir);
+
+    dir = getenv("XDG_CACHE_HOME");
+    if( dir && !is_empty(dir) )
+        return g_build_filename(dir, "advent", NULL);
+
+    dir = getenv("HOME");
+    if( !dir || is_empty(dir) )
+        die("Set ADVENT_CACHE to use --cache");
+
+    return g_build_filename(dir, ".cache", "advent", NULL);
+}
+
+static void make_dir(const char *dir) {
+    if( g_mkdir_with_parents(dir, 0777) < 0 )
+        die("Could not make %s: %s", dir, strerror(errno));
+}
+
+static bool checksum_fd(GChecksum *sum, int fd) {
+    unsigned char buf[64 * 1024];
+    ssize_t len;
+    while( (len = read(fd, buf, sizeof(buf))) != 0 ) {
+        if( len < 0 ) {
+            if( errno == EINTR )
+                continue;
+            return false;
+        }
+        g_checksum_update(sum, buf, len);
+    }
+
+    return true;
+}
+
+static bool checksum_file(GChecksum *sum, const char *file) {
+    int fd = open(file, O_RDONLY);
+    if( fd < 0 )
+        return false;
+
+    bool ok = checksum_fd(sum, fd);
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+
+    return ok;
+}
+
+/* The linker's build id note, if it left one */
+static int find_build_id(struct dl_phdr_info *info, size_t size, void *_sum) {
+    GChecksum *sum = _sum;
+
+    /* The first object is the executable */
+    for( int i = 0; i < info->dlpi_phnum; i++ ) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if( phdr->p_type != PT_NOTE )
+            continue;
+
+        const char *note = (const char *)(info->dlpi_addr + phdr->p_vaddr);
+        const char *end  = note + phdr->p_memsz;
+        while( note + sizeof(ElfW(Nhdr)) <= end ) {
+            const ElfW(Nhdr) *nhdr = (const ElfW(Nhdr) *)note;
+            const char *name = note + sizeof(ElfW(Nhdr));
+            const char *desc = name + ((nhdr->n_namesz + 3) & ~3);
+
+            if( nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 && memcmp(name, "GNU", 4) == 0 ) {
+                g_checksum_update(sum, (const guchar *)desc, nhdr->n_descsz);
+                return 1;
+            }
+
+            note = desc + ((nhdr->n_descsz + 3) & ~3);
+        }
+    }
+
+    return -1;
+}
+
+/* Without a build id, the binary itself will do */
+static void checksum_build(GChecksum *sum) {
+    g_checksum_update(sum, (const guchar *)"build", 6);
+
+    if( dl_iterate_phdr(find_build_id, sum) == 1 )
+        return;
+
+    if( !checksum_file(sum, "/proc/self/exe") )
+        die("Could not identify this build: %s", strerror(errno));
+}
+
+/* Each piece is prefixed with its length, so "ab" "c" and "a" "bc"
+   are different keys */
+static void checksum_string(GChecksum *sum, const char *type, const char *str) {
+    char header[64];
+    int len = snprintf(header, sizeof(header), "%s %zu:", type, strlen(str));
+
+    g_checksum_update(sum, (const guchar *)header, len);
+    g_checksum_update(sum, (const guchar *)str, strlen(str));
+}
+
+/* input is the saved stdin, or NULL if the solver won't read it */
+static char *cache_key(Solver *solver, int argc, char **argv, FILE *input) {
+    GChecksum *sum = g_checksum_new(G_CHECKSUM_SHA256);
+
+    checksum_string(sum, "day", solver->name);
+    checksum_build(sum);
+
+    /* argv[0] is the day, it's already in */
+    for( int i = 1; i < argc; i++ ) {
+        struct stat st;
+
+        checksum_string(sum, "arg", argv[i]);
+        if( stat(argv[i], &st) == 0 && S_ISREG(st.st_mode) ) {
+            g_checksum_update(sum, (const guchar *)"file", 5);
+            if( !checksum_file(sum, argv[i]) )
+                die("Could not read %s: %s", argv[i], strerror(errno));
+        }
+    }
+
+    if( input ) {
+        g_checksum_update(sum, (const guchar *)"stdin", 6);
+        if( !checksum_fd(sum, fileno(input)) )
+            die("Could not read stdin: %s", strerror(errno));
+        rewind(input);
+    }
+
+    char *key = g_strdup(g_checksum_get_string(sum));
+    g_checksum_free(sum);
+
+    return key;
+}
+
+static void copy_file(const char *file, FILE *to) {
+    FILE *from = fopen(file, "r");
+    if( !from )
+        return;
+
+    char buf[64 * 1024];
+    size_t len;
+    while( (len = fread(buf, 1, sizeof(buf), from)) > 0 ) {
+        fwrite(buf, 1, len, to);
+    }
+    fclose(from);
+
+    fflush(to);
+}
+
+static void CacheEntry_replay(const char *entry) {
+    char *out = g_build_filename(entry, "out", NULL);
+    char *err = g_build_filename(entry, "err", NULL);
+
+    copy_file(out, stdout);
+    copy_file(err, stderr);
+
+    g_free(out);
+    g_free(err);
+}
+
+static void CacheEntry_remove(const char *entry) {
+    char *out = g_build_filename(entry, "out", NULL);
+    char *err = g_build_filename(entry, "err", NULL);
+
+    unlink(out);
+    unlink(err);
+    rmdir(entry);
+
+    g_free(out);
+    g_free(err);
+}
+
+/* Run the solver in a child with its output going into the entry.
+   die() exits, so it can't be run here. */
+static int CacheEntry_fill(const char *entry, Solver *solver, int argc, char **argv) {
+    char *out = g_build_filename(entry, "out", NULL);
+    char *err = g_build_filename(entry, "err", NULL);
+
+    int out_fd = open(out, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    int err_fd = open(err, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if( out_fd < 0 || err_fd < 0 )
+        die("Could not write to %s: %s", entry, strerror(errno));
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if( pid < 0 ) {
+        die("Could not fork: %s", strerror(errno));
+    }
+    else if( pid == 0 ) {
+        dup2(out_fd, STDOUT_FILENO);
+        dup2(err_fd, STDERR_FILENO);
+
+        int ret = Solver_run(solver, argc, argv);
+
+        fflush(stdout);
+        fflush(stderr);
+        _exit(ret & 0xff);
+    }
+
+    close(out_fd);
+    close(err_fd);
+    g_free(out);
+    g_free(err);
+
+    int wstatus = 0;
+    while( waitpid(pid, &wstatus, 0) < 0 ) {
+        if( errno != EINTR )
+            die("Could not wait for the solver: %s", strerror(errno));
+    }
+
+    return WIFEXITED(wstatus)   ? WEXITSTATUS(wstatus)
+         : WIFSIGNALED(wstatus) ? 128 + WTERMSIG(wstatus)
+         :                        -1;
+}
+
+static bool might_read_stdin(int argc, char **argv) {
+    for( int i = 1; i < argc; i++ ) {
+        struct stat st;
+
+        if( streq(argv[i], "-") )
+            return true;
+        if( stat(argv[i], &st) == 0 && S_ISREG(st.st_mode) )
+            return false;
+    }
+
+    return true;
+}
+
+/* A copy of all of stdin, which then reads from the copy */
+static FILE *save_stdin() {
+    FILE *input = tmpfile();
+    if( !input )
+        die("Could not make a temp file for stdin: %s", strerror(errno));
+
+    char buf[64 * 1024];
+    size_t len;
+    while( (len = fread(buf, 1, sizeof(buf), stdin)) > 0 ) {
+        fwrite(buf, 1, len, input);
+    }
+    if( ferror(stdin) || fflush(input) != 0 )
+        die("Could not save stdin: %s", strerror(errno));
+    rewind(input);
+
+    if( dup2(fileno(input), STDIN_FILENO) < 0 )
+        die("Could not replace stdin: %s", strerror(errno));
+    clearerr(stdin);
+
+    return input;
+}
+
+int advent_cached_run(Solver *solver, int argc, char **argv) {
+    FILE *input = NULL;
+    if( might_read_stdin(argc, argv) ) {
+        if( isatty(STDIN_FILENO) )
+            return Solver_run(solver, argc, argv);
+
+        input = save_stdin();
+    }
+
+    char *dir = cache_dir();
+    char *key = cache_key(solver, argc, argv, input);
+
+    /* Fan out on the first two hex digits, like git's objects */
+    char prefix[3] = { key[0], key[1], '\0' };
+    char *bucket = g_build_filename(dir, prefix, NULL);
+    char *entry  = g_build_filename(bucket, key + 2, NULL);
+    int ret = 0;
+
+    struct stat st;
+    if( stat(entry, &st) == 0 && S_ISDIR(st.st_mode) ) {
+        CacheEntry_replay(entry);
+    }
+    else {
+        make_dir(bucket);
+
+        char *tmp = g_strdup_printf("%s.tmp.XXXXXX", entry);
+        if( !mkdtemp(tmp) )
+            die("Could not make %s: %s", tmp, strerror(errno));
+
+        ret = CacheEntry_fill(tmp, solver, argc, argv);
+        CacheEntry_replay(tmp);
+
+        /* If another run got there first, theirs is just as good */
+        if( ret != 0 || rename(tmp, entry) < 0 )
+            CacheEntry_remove(tmp);
+
+        g_free(tmp);
+    }
+
+    g_free(entry);
+    g_free(bucket);
+    g_free(key);
+    g_free(dir);
+    if( input )
+        fclose(input);
+
+    return ret;
+}
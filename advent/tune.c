@@ -0,0 +1,205 @@
+#include "common.h"
+#include "advent.h"
+#include "graph.h"
+#include "grid.h"
+#include "tune.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+/* advent --tune: find which engine each solver should use at each size
+   on this host, see tune.h.
+
+   Each tunable solver is run on inputs made by bench/gen, one size in
+   each size bucket, once with each of its engines forced through
+   ADVENT_ENGINE.  The fastest is saved as that bucket's winner.
+
+   An engine which loses by more than TUNE_GIVE_UP times isn't tried at
+   the bigger sizes, it's only getting further behind and might not
+   finish.  A brute force search is like that.
+
+   bench/gen is $GEN, else ./bench/gen. */
+
+#define MAX_TUNE_SIZES 8
+#define TUNE_GIVE_UP   10
+
+typedef struct {
+    const char *solver;
+    const char **engines;
+    int day;
+
+    /* Arguments after the input */
+    char *args[3];
+
+    /* How big the solver thinks a generated input of this size is */
+    long (*tune_size)(long gen_size);
+
+    long sizes[MAX_TUNE_SIZES];
+} Tunable;
+
+static long cities(long gen_size) { return gen_size; }
+static long cells(long gen_size)  { return gen_size * gen_size; }
+
+static Tunable Tunables[] = {
+    {
+        .solver = "graph",  .engines = Graph_Engines,      .day = 9,
+        .tune_size = cities,
+        .sizes = { 4, 6, 8, 12, 16 }
+    },
+    {
+        .solver = "day18",  .engines = Grid_Layout_Names,  .day = 18,
+        .args = { "10" },
+        .tune_size = cells,
+        .sizes = { 64, 256, 1024, 2048 }
+    },
+    { .solver = NULL }
+};
+
+static double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void generate(const char *gen, int day, long size, const char *file) {
+    char *cmd = g_strdup_printf("%s %d %ld > %s", gen, day, size, file);
+
+    if( system(cmd) != 0 )
+        die("'%s' failed", cmd);
+
+    g_free(cmd);
+}
+
+/* Run the solver with its answers thrown away, returns the seconds taken */
+static double run_quietly(Solver *solver, int argc, char **argv) {
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    double start = now_seconds();
+    int ret = Solver_run(solver, argc, argv);
+    fflush(stdout);
+    double took = now_seconds() - start;
+
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    if( ret != 0 )
+        die("%s failed on %s", solver->name, argv[1]);
+
+    return took;
+}
+
+/* Best of at least 3 runs and 50ms, only one if it's slow */
+static double time_engine(Tunable *tunable, Solver *solver, const char *engine, const char *input) {
+    char *argv[6] = { solver->name, (char *)input };
+    int argc = 2;
+    for( int i = 0; tunable->args[i] != NULL; i++ ) {
+        argv[argc++] = tunable->args[i];
+    }
+
+    char *force = g_strdup_printf("%s=%s", tunable->solver, engine);
+    setenv("ADVENT_ENGINE", force, 1);
+    g_free(force);
+
+    double best = INFINITY;
+    double total = 0;
+    for( int runs = 0; (runs < 3 && total < 1) || (total < 0.05 && runs < 1000); runs++ ) {
+        double took = run_quietly(solver, argc, argv);
+        best = MIN(best, took);
+        total += took;
+    }
+
+    unsetenv("ADVENT_ENGINE");
+
+    return best;
+}
+
+static void tune(Tunable *tunable, const char *gen, const char *dir) {
+    Solver *solver = Solver_lookup(tunable->day);
+    int num_engines = 0;
+    while( tunable->engines[num_engines] != NULL )
+        num_engines++;
+
+    bool given_up[num_engines];
+    memset(given_up, 0, sizeof(given_up));
+
+    for( int i = 0; i < MAX_TUNE_SIZES && tunable->sizes[i]; i++ ) {
+        long size = tunable->sizes[i];
+        int bucket = tune_bucket(tunable->tune_size(size));
+        char *input = g_strdup_printf("%s/day%d-%ld", dir, tunable->day, size);
+        generate(gen, tunable->day, size, input);
+
+        double seconds[num_engines];
+        int winner = -1;
+        printf("%s at %ld, bucket %d:", tunable->solver, size, bucket);
+        for( int engine = 0; engine < num_engines; engine++ ) {
+            if( given_up[engine] )
+                continue;
+
+            seconds[engine] = time_engine(tunable, solver, tunable->engines[engine], input);
+            printf(" %s %.6fs", tunable->engines[engine], seconds[engine]);
+            fflush(stdout);
+
+            if( winner < 0 || seconds[engine] < seconds[winner] )
+                winner = engine;
+        }
+        printf(", %s wins\n", tunable->engines[winner]);
+
+        for( int engine = 0; engine < num_engines; engine++ ) {
+            if( !given_up[engine] && seconds[engine] > TUNE_GIVE_UP * seconds[winner] )
+                given_up[engine] = true;
+        }
+
+        tune_save(tunable->solver, bucket, tunable->engines[winner]);
+
+        unlink(input);
+        g_free(input);
+    }
+}
+
+/* Tunes the solvers of the given days, or all of them */
+int advent_tune(int argc, char **argv) {
+    const char *gen = getenv("GEN");
+    if( !gen || is_empty(gen) )
+        gen = "./bench/gen";
+
+    /* Don't let a layout forced for something else skew the timings */
+    unsetenv("ADVENT_GRID");
+
+    for( int i = 0; i < argc; i++ ) {
+        Solver *solver = Solver_lookup_str(argv[i]);
+        if( !solver )
+            die("There is no solver for day %s", argv[i]);
+    }
+
+    char dir[] = "/tmp/advent-tune.XXXXXX";
+    if( !mkdtemp(dir) )
+        die("Could not make a temp directory: %s", strerror(errno));
+
+    for( Tunable *tunable = Tunables; tunable->solver != NULL; tunable++ ) {
+        bool wanted = argc == 0;
+        for( int i = 0; i < argc; i++ ) {
+            if( Solver_lookup_str(argv[i])->day == tunable->day )
+                wanted = true;
+        }
+
+        if( wanted )
+            tune(tunable, gen, dir);
+    }
+
+    rmdir(dir);
+
+    char *file = tune_file();
+    printf("Saved to %s\n", file);
+    g_free(file);
+
+    return 0;
+}
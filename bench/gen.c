@@ -0,0 +1,415 @@
+#include "common.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Generate synthetic puzzle inputs at any scale.
+
+   gen <day> <size> [<seed>]
+
+   The same day, size and seed always produce the same input, so
+   benchmarks can sweep sizes reproducibly.  What "size" counts is
+   different for each day, see Generators below. */
+
+typedef void (*GenFunc)(GRand *rand, long size, FILE *out);
+
+typedef struct {
+    int day;
+    char *size_desc;
+    GenFunc gen;
+} Generator;
+
+static inline int rand_range(GRand *rand, int min, int max) {
+    return g_rand_int_range(rand, min, max + 1);
+}
+
+static inline char rand_char(GRand *rand, const char *chars) {
+    return chars[ g_rand_int_range(rand, 0, strlen(chars)) ];
+}
+
+/* Turn a number into a unique alphabetic name: a, b ... z, aa, ab ...
+   Names must be letters only to satisfy the puzzle grammars. */
+static char *alpha_name(long num, bool capitalize) {
+    char buf[16];
+    int len = 0;
+
+    num++;
+    while( num > 0 ) {
+        num--;
+        buf[len++] = 'a' + (num % 26);
+        num /= 26;
+    }
+
+    char *name = calloc(len + 1, sizeof(char));
+    for( int i = 0; i < len; i++ ) {
+        name[i] = buf[len - i - 1];
+    }
+
+    if( capitalize )
+        name[0] -= 'a' - 'A';
+
+    return name;
+}
+
+static void gen_chars(GRand *rand, long size, FILE *out, const char *chars) {
+    for( long i = 0; i < size; i++ ) {
+        fputc(rand_char(rand, chars), out);
+    }
+}
+
+static void gen_day1(GRand *rand, long size, FILE *out) {
+    gen_chars(rand, size, out, "()");
+}
+
+static void gen_day2(GRand *rand, long size, FILE *out) {
+    for( long i = 0; i < size; i++ ) {
+        fprintf(out, "%dx%dx%d\n",
+                rand_range(rand, 1, 30), rand_range(rand, 1, 30), rand_range(rand, 1, 30)
+        );
+    }
+}
+
+static void gen_day3(GRand *rand, long size, FILE *out) {
+    gen_chars(rand, size, out, "^v<>");
+}
+
+/* Secret keys and passwords */
+static void gen_key(GRand *rand, long size, FILE *out) {
+    gen_chars(rand, size, out, "abcdefghjkmnpqrstuvwxyz");
+    fputc('\n', out);
+}
+
+static void gen_day5(GRand *rand, long size, FILE *out) {
+    for( long i = 0; i < size; i++ ) {
+        gen_chars(rand, 16, out, "abcdefghijklmnopqrstuvwxyz");
+        fputc('\n', out);
+    }
+}
+
+static void gen_day6(GRand *rand, long size, FILE *out) {
+    char *commands[] = { "turn on", "turn off", "toggle" };
+
+    for( long i = 0; i < size; i++ ) {
+        int x1 = rand_range(rand, 0, 999);
+        int y1 = rand_range(rand, 0, 999);
+        int x2 = rand_range(rand, x1, 999);
+        int y2 = rand_range(rand, y1, 999);
+
+        fprintf(out, "%s %d,%d through %d,%d\n",
+                commands[rand_range(rand, 0, 2)], x1, y1, x2, y2
+        );
+    }
+}
+
+/* A netlist of size gates.  Each gate only reads wires defined before
+   it so the circuit has no loops.  "b" is a constant so it can be
+   overridden, and "a" is the last gate so it depends on everything.
+   The lines are shuffled, real inputs are not in order either. */
+static void gen_day7(GRand *rand, long size, FILE *out) {
+    char *ops[] = { "AND", "OR", "LSHIFT", "RSHIFT", "NOT", "SET" };
+    char **lines = calloc(size, sizeof(char *));
+
+    if( size < 3 )
+        die("day7 needs at least 3 gates");
+
+    for( long i = 0; i < size; i++ ) {
+        /* Define wires in the order b, c, d ... and a last */
+        long wire = (i + 1) % size;
+        char *name = alpha_name(wire, false);
+
+        if( i < 2 ) {
+            lines[i] = g_strdup_printf("%d -> %s", rand_range(rand, 0, 65535), name);
+            free(name);
+            continue;
+        }
+
+        char *left  = alpha_name(rand_range(rand, 1, i), false);
+        char *right = alpha_name(rand_range(rand, 1, i), false);
+
+        char *op = ops[rand_range(rand, 0, 5)];
+        if( streq(op, "SET") )
+            lines[i] = g_strdup_printf("%s -> %s", left, name);
+        else if( streq(op, "NOT") )
+            lines[i] = g_strdup_printf("NOT %s -> %s", left, name);
+        else if( op[1] == 'S' )
+            lines[i] = g_strdup_printf("%s %s %d -> %s", left, op, rand_range(rand, 1, 15), name);
+        else
+            lines[i] = g_strdup_printf("%s %s %s -> %s", left, op, right, name);
+
+        free(left);
+        free(right);
+        free(name);
+    }
+
+    /* Fisher-Yates */
+    for( long i = size - 1; i > 0; i-- ) {
+        long j = rand_range(rand, 0, i);
+        char *tmp = lines[i];
+        lines[i] = lines[j];
+        lines[j] = tmp;
+    }
+
+    for( long i = 0; i < size; i++ ) {
+        fprintf(out, "%s\n", lines[i]);
+        g_free(lines[i]);
+    }
+
+    free(lines);
+}
+
+static void gen_day8(GRand *rand, long size, FILE *out) {
+    for( long i = 0; i < size; i++ ) {
+        int len = rand_range(rand, 1, 30);
+
+        fputc('"', out);
+        for( int j = 0; j < len; j++ ) {
+            switch( rand_range(rand, 0, 9) ) {
+                case 0:
+                    fputs("\\\\", out);
+                    break;
+                case 1:
+                    fputs("\\\"", out);
+                    break;
+                case 2:
+                    fprintf(out, "\\x%02x", rand_range(rand, 0, 255));
+                    break;
+                default:
+                    fputc(rand_range(rand, 'a', 'z'), out);
+                    break;
+            }
+        }
+        fputs("\"\n", out);
+    }
+}
+
+/* Distances between every pair of size cities */
+static void gen_day9(GRand *rand, long size, FILE *out) {
+    for( long from = 0; from < size; from++ ) {
+        char *from_name = alpha_name(from, true);
+
+        for( long to = from + 1; to < size; to++ ) {
+            char *to_name = alpha_name(to, true);
+            fprintf(out, "%s to %s = %d\n", from_name, to_name, rand_range(rand, 1, 150));
+            free(to_name);
+        }
+
+        free(from_name);
+    }
+}
+
+/* A look-and-say sequence.  Runs are kept to 3 or less like the real thing. */
+static void gen_day10(GRand *rand, long size, FILE *out) {
+    char prev = '\0';
+    int run = 0;
+
+    for( long i = 0; i < size; i++ ) {
+        char c = rand_char(rand, "123");
+        run = c == prev ? run + 1 : 1;
+        if( run > 3 ) {
+            c = c == '3' ? '1' : c + 1;
+            run = 1;
+        }
+
+        fputc(c, out);
+        prev = c;
+    }
+    fputc('\n', out);
+}
+
+static void gen_json_value(GRand *rand, long *budget, int depth, FILE *out);
+
+static void gen_json_container(GRand *rand, long *budget, int depth, FILE *out) {
+    bool is_object = g_rand_boolean(rand);
+    int len = rand_range(rand, 1, 8);
+
+    fputc(is_object ? '{' : '[', out);
+    for( int i = 0; i < len && *budget > 0; i++ ) {
+        if( i > 0 )
+            fputc(',', out);
+
+        if( is_object ) {
+            char *key = alpha_name(i, false);
+            fprintf(out, "\"%s\":", key);
+            free(key);
+        }
+
+        gen_json_value(rand, budget, depth + 1, out);
+    }
+    fputc(is_object ? '}' : ']', out);
+}
+
+static void gen_json_value(GRand *rand, long *budget, int depth, FILE *out) {
+    char *colors[] = { "red", "green", "blue", "orange", "violet", "yellow" };
+
+    (*budget)--;
+
+    /* Nest more at the top so large documents stay wide, not just deep */
+    if( depth < 40 && rand_range(rand, 0, 9) < (depth < 3 ? 9 : 3) ) {
+        gen_json_container(rand, budget, depth, out);
+    }
+    else if( g_rand_boolean(rand) ) {
+        fprintf(out, "%d", rand_range(rand, -200, 200));
+    }
+    else {
+        fprintf(out, "\"%s\"", colors[rand_range(rand, 0, 5)]);
+    }
+}
+
+/* A JSON document with roughly size values */
+static void gen_day12(GRand *rand, long size, FILE *out) {
+    long budget = size;
+
+    fputc('[', out);
+    for( long i = 0; budget > 0; i++ ) {
+        if( i > 0 )
+            fputc(',', out);
+        gen_json_value(rand, &budget, 1, out);
+    }
+    fputs("]\n", out);
+}
+
+/* Happiness between every pair of size people */
+static void gen_day13(GRand *rand, long size, FILE *out) {
+    for( long from = 0; from < size; from++ ) {
+        char *from_name = alpha_name(from, true);
+
+        for( long to = 0; to < size; to++ ) {
+            if( from == to )
+                continue;
+
+            char *to_name = alpha_name(to, true);
+            fprintf(out, "%s would %s %d happiness units by sitting next to %s.\n",
+                    from_name, g_rand_boolean(rand) ? "gain" : "lose",
+                    rand_range(rand, 1, 100), to_name
+            );
+            free(to_name);
+        }
+
+        free(from_name);
+    }
+}
+
+static void gen_day14(GRand *rand, long size, FILE *out) {
+    for( long i = 0; i < size; i++ ) {
+        char *name = alpha_name(i, true);
+        fprintf(out, "%s can fly %d km/s for %d seconds, but then must rest for %d seconds.\n",
+                name, rand_range(rand, 1, 30), rand_range(rand, 1, 20), rand_range(rand, 10, 200)
+        );
+        free(name);
+    }
+}
+
+static void gen_day15(GRand *rand, long size, FILE *out) {
+    for( long i = 0; i < size; i++ ) {
+        char *name = alpha_name(i, true);
+        fprintf(out, "%s: capacity %d, durability %d, flavor %d, texture %d, calories %d\n",
+                name,
+                rand_range(rand, -3, 5), rand_range(rand, -3, 5),
+                rand_range(rand, -3, 5), rand_range(rand, -3, 5),
+                rand_range(rand, 1, 8)
+        );
+        free(name);
+    }
+}
+
+static void gen_day16(GRand *rand, long size, FILE *out) {
+    char *props[] = {
+        "children", "cats", "samoyeds", "pomeranians", "akitas",
+        "vizslas", "goldfish", "trees", "cars", "perfumes"
+    };
+
+    for( long i = 1; i <= size; i++ ) {
+        /* Three different properties */
+        int first  = rand_range(rand, 0, 9);
+        int second = (first  + rand_range(rand, 1, 8)) % 10;
+        int third  = (second + 1) % 10 == first ? (second + 2) % 10 : (second + 1) % 10;
+
+        fprintf(out, "Sue %ld: %s: %d, %s: %d, %s: %d\n", i,
+                props[first],  rand_range(rand, 0, 10),
+                props[second], rand_range(rand, 0, 10),
+                props[third],  rand_range(rand, 0, 10)
+        );
+    }
+}
+
+static void gen_day17(GRand *rand, long size, FILE *out) {
+    for( long i = 0; i < size; i++ ) {
+        fprintf(out, "%d\n", rand_range(rand, 1, 50));
+    }
+}
+
+/* A size x size grid of lights */
+static void gen_day18(GRand *rand, long size, FILE *out) {
+    for( long row = 0; row < size; row++ ) {
+        gen_chars(rand, size, out, ".#");
+        fputc('\n', out);
+    }
+}
+
+static Generator Generators[] = {
+    {  1, "instructions",       gen_day1  },
+    {  2, "boxes",              gen_day2  },
+    {  3, "moves",              gen_day3  },
+    {  4, "key length",         gen_key   },
+    {  5, "strings",            gen_day5  },
+    {  6, "commands",           gen_day6  },
+    {  7, "gates",              gen_day7  },
+    {  8, "strings",            gen_day8  },
+    {  9, "cities",             gen_day9  },
+    { 10, "digits",             gen_day10 },
+    { 11, "password length",    gen_key   },
+    { 12, "values",             gen_day12 },
+    { 13, "people",             gen_day13 },
+    { 14, "reindeer",           gen_day14 },
+    { 15, "ingredients",        gen_day15 },
+    { 16, "aunts",              gen_day16 },
+    { 17, "containers",         gen_day17 },
+    { 18, "rows and columns",   gen_day18 },
+    {  0, NULL,                 NULL      }
+};
+
+static Generator *find_generator(int day) {
+    for( Generator *gen = Generators; gen->gen != NULL; gen++ ) {
+        if( gen->day == day )
+            return gen;
+    }
+
+    return NULL;
+}
+
+static void list_generators() {
+    fputs("Days and what <size> counts:\n", stderr);
+    for( Generator *gen = Generators; gen->gen != NULL; gen++ ) {
+        fprintf(stderr, "\t%2d\t%s\n", gen->day, gen->size_desc);
+    }
+}
+
+int main(int argc, char **argv) {
+    if( argc < 3 || argc > 4 ) {
+        char *desc[] = {argv[0], "<day>", "<size>", "[<seed>]"};
+        usage(4, desc);
+        list_generators();
+        return 1;
+    }
+
+    Generator *gen = find_generator(atoi(argv[1]));
+    if( !gen ) {
+        fprintf(stderr, "No generator for day %s.\n", argv[1]);
+        list_generators();
+        return 1;
+    }
+
+    long size = atol(argv[2]);
+    if( size <= 0 )
+        die("Size must be positive, got '%s'", argv[2]);
+
+    guint32 seed = argc == 4 ? strtoul(argv[3], NULL, 10) : 2015;
+    GRand *rand = g_rand_new_with_seed(seed);
+
+    gen->gen(rand, size, stdout);
+
+    g_rand_free(rand);
+
+    return 0;
+}
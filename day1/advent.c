@@ -1,13 +1,133 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "common.h"
+#include "phase.h"
+#include "cpu.h"
+#include "mapfile.h"
+#include "pool.h"
+#include "solve.h"
+#include <limits.h>
+#include <pthread.h>
 
 struct Floors {
-    int start_floor;
-    int end_floor;
-    int first_enter_basement;
+    long start_floor;
+    long end_floor;
+    /* Counted in instructions, -1 if he never does */
+    long first_enter_basement;
 };
 
+/* Instructions are counted this many at a time while looking for the
+   basement */
+#define FLOOR_BLOCK 64
+
+/* With more than one thread, inputs this big are split into chunks of
+   FLOOR_CHUNK, see Floors_scan_parallel() */
+#define FLOOR_PARALLEL_MIN (4 * 1024 * 1024)
+#define FLOOR_CHUNK        (1024 * 1024)
+
+/* Adds how many of each instruction are in buf to ups and downs */
+typedef void (*CountParensFunc)(const char *buf, size_t len, size_t *ups, size_t *downs);
+
+static CountParensFunc Count_Parens = NULL;
+static pthread_once_t Count_Parens_Once = PTHREAD_ONCE_INIT;
+
+static void count_parens_generic(const char *buf, size_t len, size_t *ups, size_t *downs) {
+    size_t up = 0;
+    size_t down = 0;
+
+    for( size_t i = 0; i < len; i++ ) {
+        up   += buf[i] == '(';
+        down += buf[i] == ')';
+    }
+
+    *ups   += up;
+    *downs += down;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/* Each match is -1, so subtracting counts them in bytes.  A byte can
+   count 255 blocks, then they're summed into 64 bit lanes. */
+__attribute__((target("avx2")))
+static void count_parens_avx2(const char *buf, size_t len, size_t *ups, size_t *downs) {
+    const __m256i open  = _mm256_set1_epi8('(');
+    const __m256i close = _mm256_set1_epi8(')');
+    const __m256i zero  = _mm256_setzero_si256();
+    __m256i up_total   = zero;
+    __m256i down_total = zero;
+    size_t blocks_end = len - len % 32;
+    size_t i = 0;
+
+    while( i < blocks_end ) {
+        size_t end = MIN(blocks_end, i + 255 * 32);
+        __m256i up   = zero;
+        __m256i down = zero;
+
+        for( ; i < end; i += 32 ) {
+            __m256i block = _mm256_loadu_si256((const __m256i *)(buf + i));
+            up   = _mm256_sub_epi8(up,   _mm256_cmpeq_epi8(block, open));
+            down = _mm256_sub_epi8(down, _mm256_cmpeq_epi8(block, close));
+        }
+
+        up_total   = _mm256_add_epi64(up_total,   _mm256_sad_epu8(up,   zero));
+        down_total = _mm256_add_epi64(down_total, _mm256_sad_epu8(down, zero));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, up_total);
+    *ups += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_storeu_si256((__m256i *)lanes, down_total);
+    *downs += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    count_parens_generic(buf + i, len - i, ups, downs);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static void count_parens_avx512(const char *buf, size_t len, size_t *ups, size_t *downs) {
+    const __m512i open  = _mm512_set1_epi8('(');
+    const __m512i close = _mm512_set1_epi8(')');
+    size_t up = 0;
+    size_t down = 0;
+    size_t i = 0;
+
+    for( ; i + 64 <= len; i += 64 ) {
+        __m512i block = _mm512_loadu_si512((const void *)(buf + i));
+        up   += __builtin_popcountll(_mm512_cmpeq_epi8_mask(block, open));
+        down += __builtin_popcountll(_mm512_cmpeq_epi8_mask(block, close));
+    }
+
+    *ups   += up;
+    *downs += down;
+
+    count_parens_avx2(buf + i, len - i, ups, downs);
+}
+#endif
+
+static const CpuImpl Count_Parens_Impls[] = {
+    CPU_IMPL(CPU_GENERIC, count_parens_generic),
+#if defined(__x86_64__) || defined(__i386__)
+    CPU_IMPL(CPU_AVX2,    count_parens_avx2),
+    CPU_IMPL(CPU_AVX512,  count_parens_avx512),
+#endif
+    CPU_IMPL_END
+};
+
+static void resolve_count_parens() {
+    Count_Parens = (CountParensFunc)cpu_dispatch("day1 count_parens", Count_Parens_Impls);
+}
+
+/* Once for all threads, it's the same CPU */
+static void init_count_parens() {
+    pthread_once(&Count_Parens_Once, resolve_count_parens);
+}
+
 static struct Floors *Floors_create() {
     struct Floors *floors = malloc(sizeof(struct Floors));
 
@@ -18,48 +138,604 @@ static struct Floors *Floors_create() {
     return floors;
 }
 
-static struct Floors *read_floor_instructions(FILE *fp) {
-    char c;
-    int position = 0;
-    struct Floors *floors = Floors_create();
-    
-    while( !feof(fp) ) {
-        c = (char)fgetc(fp);
-        switch(c) {
+/* One instruction at a time, for a block which might take him into
+   the basement */
+static void Floors_walk(struct Floors *floors, long *position, const char *buf, size_t len) {
+    for( size_t i = 0; i < len; i++ ) {
+        switch(buf[i]) {
             case '(':
-                position++;
+                (*position)++;
                 floors->end_floor++;
                 break;
             case ')':
-                position++;
+                (*position)++;
                 floors->end_floor--;
                 break;
         }
 
         if( floors->first_enter_basement < 0 && floors->end_floor < 0 ) {
-            floors->first_enter_basement = position;
+            floors->first_enter_basement = *position;
+        }
+    }
+}
+
+/* Until he's found the basement, a block with no more downs than the
+   floor he's on can't take him there and is counted whole.  Any other
+   is walked.  After that only the floor matters. */
+static void Floors_scan(struct Floors *floors, const char *buf, size_t len) {
+    long position = 0;
+    size_t i = 0;
+
+    for( ; i < len && floors->first_enter_basement < 0; i += FLOOR_BLOCK ) {
+        size_t block = MIN(FLOOR_BLOCK, len - i);
+        size_t ups = 0;
+        size_t downs = 0;
+
+        Count_Parens(buf + i, block, &ups, &downs);
+        if( (long)downs <= floors->end_floor ) {
+            floors->end_floor += (long)ups - (long)downs;
+            position += ups + downs;
+        }
+        else {
+            Floors_walk(floors, &position, buf + i, block);
         }
     }
 
+    if( i < len ) {
+        size_t ups = 0;
+        size_t downs = 0;
+
+        Count_Parens(buf + i, len - i, &ups, &downs);
+        floors->end_floor += (long)ups - (long)downs;
+    }
+}
+
+/* What a run of instructions does, relative to where it starts */
+typedef struct {
+    long delta;
+    long instructions;
+    /* The lowest floor after any of them, LONG_MAX if there are none */
+    long min;
+    /* Just past where min is first reached */
+    size_t min_end;
+} FloorSpan;
+
+/* The same trick as Floors_scan(), a block with no more downs than it
+   would take to go below the lowest so far is counted whole */
+static FloorSpan FloorSpan_of(const char *buf, size_t len) {
+    FloorSpan span = { .delta = 0, .instructions = 0, .min = LONG_MAX, .min_end = 0 };
+
+    for( size_t i = 0; i < len; i += FLOOR_BLOCK ) {
+        size_t block = MIN(FLOOR_BLOCK, len - i);
+        size_t ups = 0;
+        size_t downs = 0;
+
+        Count_Parens(buf + i, block, &ups, &downs);
+        if( span.min != LONG_MAX && span.delta - (long)downs >= span.min ) {
+            span.delta        += (long)ups - (long)downs;
+            span.instructions += ups + downs;
+            continue;
+        }
+
+        for( size_t j = i; j < i + block; j++ ) {
+            if( buf[j] != '(' && buf[j] != ')' )
+                continue;
+
+            span.delta += buf[j] == '(' ? 1 : -1;
+            span.instructions++;
+            if( span.delta < span.min ) {
+                span.min     = span.delta;
+                span.min_end = j + 1;
+            }
+        }
+    }
+
+    return span;
+}
+
+typedef struct {
+    const char *buf;
+    size_t len;
+    FloorSpan *spans;
+} FloorChunks;
+
+static void Floors_scan_chunks(long from, long to, void *_chunks) {
+    FloorChunks *chunks = _chunks;
+
+    for( long chunk = from; chunk < to; chunk++ ) {
+        size_t start = chunk * FLOOR_CHUNK;
+        chunks->spans[chunk] = FloorSpan_of(chunks->buf + start, MIN(FLOOR_CHUNK, chunks->len - start));
+    }
+}
+
+/* The basement is the first prefix below 0, which is a scan.  Each
+   chunk's span is found in parallel, then the spans are added up in
+   order.  The first chunk whose lowest point is below 0 from the floor
+   it starts on is the only one walked again, and only as far as that
+   lowest point. */
+static void Floors_scan_parallel(struct Floors *floors, const char *buf, size_t len) {
+    long num_chunks = (len + FLOOR_CHUNK - 1) / FLOOR_CHUNK;
+    FloorChunks chunks = {
+        .buf   = buf,
+        .len   = len,
+        .spans = malloc(num_chunks * sizeof(FloorSpan))
+    };
+
+    pool_for(0, num_chunks, 1, Floors_scan_chunks, &chunks);
+
+    long floor = 0;
+    long position = 0;
+    for( long chunk = 0; chunk < num_chunks; chunk++ ) {
+        FloorSpan *span = &chunks.spans[chunk];
+
+        if( floors->first_enter_basement < 0 && span->min != LONG_MAX && floor + span->min < 0 ) {
+            long walked = position;
+            floors->end_floor = floor;
+            Floors_walk(floors, &walked, buf + chunk * FLOOR_CHUNK, span->min_end);
+        }
+
+        floor    += span->delta;
+        position += span->instructions;
+    }
+
+    floors->end_floor = floor;
+    free(chunks.spans);
+}
+
+static struct Floors *read_floor_instructions(const char *input, size_t len) {
+    struct Floors *floors = Floors_create();
+
+    init_count_parens();
+
+    if( pool_num_threads() > 1 && len >= FLOOR_PARALLEL_MIN )
+        Floors_scan_parallel(floors, input, len);
+    else
+        Floors_scan(floors, input, len);
+    phase_items(len);
+
     return floors;
 }
 
-int main(int argc, char **argv) {
-    if( argc != 2 ) {
-        char *desc[2] = { argv[0], "<inputfile>" };
-        usage(2, desc);
+/* Query mode: many questions about one long instruction file.
+
+       floor <k>    the floor he's on after k instructions
+       reach <f>    how many instructions until he's first on floor f,
+                    or never
+
+   An index is built once and saved next to the input as
+   <inputfile>.index, or kept in memory for the run if it can't be.
+   It's rebuilt if the input's size or modification time changes.  It holds the floor and byte offset every FLOOR_SAMPLE
+   instructions, and a segment tree of the lowest and highest floor in
+   each block between samples.
+
+   A floor query starts from its block's sample.  A reach query walks
+   down the tree to the first block which has the floor in its range.
+   The floor moves one at a time, so a range of blocks which has the
+   floor in its range has it in one of its blocks.  Either way at most
+   FLOOR_SAMPLE instructions are walked after an O(log n) lookup. */
+
+#define FLOOR_SAMPLE      4096
+#define FLOOR_INDEX_MAGIC "AOC1IDX1"
+
+typedef struct {
+    char magic[8];
+    uint64_t input_size;
+    int64_t input_mtime_sec;
+    int64_t input_mtime_nsec;
+    uint64_t sample;
+    uint64_t num_blocks;
+    /* Leaves of the tree, a power of 2 */
+    uint64_t num_leaves;
+    int64_t instructions;
+    int64_t end_floor;
+} FloorIndexHeader;
+
+/* Where a block starts */
+typedef struct {
+    uint64_t offset;
+    int64_t floor;
+} FloorSample;
+
+/* The floors a block or range of blocks visits, min > max for none */
+typedef struct {
+    int64_t min;
+    int64_t max;
+} FloorRange;
+
+typedef struct {
+    /* The index as it's saved: header, samples then tree */
+    char *data;
+    size_t size;
+    /* Set if it was read from disk, else data is ours */
+    MappedFile *file;
+
+    const FloorIndexHeader *header;
+    const FloorSample *samples;
+    /* Node 1 is the root, node n's children are 2n and 2n+1 */
+    const FloorRange *tree;
+
+    const char *buf;
+} FloorIndex;
+
+static size_t FloorIndex_size(uint64_t num_blocks, uint64_t num_leaves) {
+    return sizeof(FloorIndexHeader) + num_blocks * sizeof(FloorSample) +
+           2 * num_leaves * sizeof(FloorRange);
+}
+
+static void FloorIndex_point(FloorIndex *self) {
+    self->header  = (const FloorIndexHeader *)self->data;
+    self->samples = (const FloorSample *)(self->data + sizeof(FloorIndexHeader));
+    self->tree    = (const FloorRange *)(self->samples + self->header->num_blocks);
+}
+
+static inline void FloorRange_add(FloorRange *range, int64_t floor) {
+    range->min = MIN(range->min, floor);
+    range->max = MAX(range->max, floor);
+}
+
+static inline bool FloorRange_has(const FloorRange *range, int64_t floor) {
+    return range->min <= floor && floor <= range->max;
+}
+
+/* One pass over the input.  A block which can't move the sampled range
+   and doesn't reach a sample is counted whole, like Floors_scan(). */
+static FloorIndex *FloorIndex_build(const char *buf, size_t len, const struct stat *st) {
+    /* Every instruction is at least a byte */
+    uint64_t max_blocks = len / FLOOR_SAMPLE + 1;
+    uint64_t num_leaves = 1;
+    while( num_leaves < max_blocks )
+        num_leaves *= 2;
+
+    char *data = calloc(1, FloorIndex_size(max_blocks, num_leaves));
+    FloorIndexHeader *header = (FloorIndexHeader *)data;
+    FloorSample *samples = (FloorSample *)(data + sizeof(FloorIndexHeader));
+    FloorRange *leaves = malloc(num_leaves * sizeof(FloorRange));
+    for( uint64_t i = 0; i < num_leaves; i++ ) {
+        leaves[i] = (FloorRange){ .min = INT64_MAX, .max = INT64_MIN };
+    }
+
+    int64_t floor = 0;
+    int64_t instructions = 0;
+    uint64_t block = 0;
+    samples[0] = (FloorSample){ .offset = 0, .floor = 0 };
+
+    for( size_t i = 0; i < len; i += FLOOR_BLOCK ) {
+        size_t chunk = MIN(FLOOR_BLOCK, len - i);
+        size_t ups = 0;
+        size_t downs = 0;
+        Count_Parens(buf + i, chunk, &ups, &downs);
+
+        FloorRange *range = &leaves[block];
+        int64_t next_sample = (int64_t)(block + 1) * FLOOR_SAMPLE;
+        if( instructions + (int64_t)(ups + downs) < next_sample &&
+            range->min <= floor - (int64_t)downs && floor + (int64_t)ups <= range->max ) {
+            floor        += (int64_t)ups - (int64_t)downs;
+            instructions += ups + downs;
+            continue;
+        }
+
+        for( size_t j = i; j < i + chunk; j++ ) {
+            if( buf[j] != '(' && buf[j] != ')' )
+                continue;
+
+            floor += buf[j] == '(' ? 1 : -1;
+            instructions++;
+            FloorRange_add(&leaves[block], floor);
+
+            if( instructions % FLOOR_SAMPLE == 0 ) {
+                block++;
+                samples[block] = (FloorSample){ .offset = j + 1, .floor = floor };
+            }
+        }
+    }
+
+    /* A last sample with nothing after it isn't a block */
+    uint64_t num_blocks = instructions % FLOOR_SAMPLE == 0 ? block : block + 1;
+    if( num_blocks == 0 )
+        num_blocks = 1;
+
+    memcpy(header->magic, FLOOR_INDEX_MAGIC, sizeof(header->magic));
+    header->input_size       = st->st_size;
+    header->input_mtime_sec  = st->st_mtim.tv_sec;
+    header->input_mtime_nsec = st->st_mtim.tv_nsec;
+    header->sample           = FLOOR_SAMPLE;
+    header->num_blocks       = num_blocks;
+    header->num_leaves       = num_leaves;
+    header->instructions     = instructions;
+    header->end_floor        = floor;
+
+    /* The samples shrank to num_blocks, the tree goes right after */
+    FloorRange *tree = (FloorRange *)(samples + num_blocks);
+    memcpy(tree + num_leaves, leaves, num_leaves * sizeof(FloorRange));
+    for( uint64_t node = num_leaves - 1; node >= 1; node-- ) {
+        tree[node].min = MIN(tree[2 * node].min, tree[2 * node + 1].min);
+        tree[node].max = MAX(tree[2 * node].max, tree[2 * node + 1].max);
+    }
+    free(leaves);
+
+    FloorIndex *self = calloc(1, sizeof(FloorIndex));
+    self->data = data;
+    self->size = FloorIndex_size(num_blocks, num_leaves);
+    self->buf  = buf;
+    FloorIndex_point(self);
+
+    return self;
+}
+
+/* Written to a temp file and renamed, a reader never sees half.  The
+   temp file is 0666 less the umask like any other, mkstemp()'s 0600
+   would stick.  If it can't be saved, say so, the index still works
+   from memory. */
+static void FloorIndex_save(FloorIndex *self, const char *filename) {
+    char *tmp = g_strdup_printf("%s.XXXXXX", filename);
+    int fd = g_mkstemp_full(tmp, O_WRONLY, 0666);
+    bool saved = false;
+
+    if( fd >= 0 ) {
+        FILE *out = fdopen(fd, "w");
+        if( out ) {
+            saved = fwrite(self->data, 1, self->size, out) == self->size;
+            saved = fclose(out) == 0 && saved;
+        }
+        else {
+            close(fd);
+        }
+        saved = saved && rename(tmp, filename) == 0;
+    }
+
+    if( !saved ) {
+        fprintf(stderr, "Could not save %s: %s, using the index from memory.\n", filename, strerror(errno));
+        if( fd >= 0 )
+            unlink(tmp);
+    }
+
+    g_free(tmp);
+}
+
+/* Every size in it fits in len, checked before they're multiplied so
+   a bad one can't overflow */
+static bool FloorIndexHeader_fits(const FloorIndexHeader *header, size_t len) {
+    if( len < sizeof(FloorIndexHeader) )
+        return false;
+
+    uint64_t room = len - sizeof(FloorIndexHeader);
+    uint64_t blocks = header->num_blocks;
+    uint64_t leaves = header->num_leaves;
+
+    if( blocks == 0 || leaves < blocks || (leaves & (leaves - 1)) != 0 ||
+        blocks > room / sizeof(FloorSample) || leaves > room / (2 * sizeof(FloorRange)) )
+        return false;
+
+    if( len != FloorIndex_size(blocks, leaves) )
+        return false;
+
+    /* Each block is FLOOR_SAMPLE instructions, each at least a byte */
+    return header->instructions >= 0 &&
+           (uint64_t)header->instructions <= blocks * FLOOR_SAMPLE &&
+           (uint64_t)header->instructions <= header->input_size;
+}
+
+/* NULL if there isn't one, or it's not for this input as it is now */
+static FloorIndex *FloorIndex_load(const char *filename, const struct stat *st, const char *buf) {
+    struct stat index_st;
+    if( stat(filename, &index_st) != 0 || !S_ISREG(index_st.st_mode) )
+        return NULL;
+
+    FILE *fp = fopen(filename, "r");
+    if( !fp )
+        return NULL;
+
+    MappedFile *file = MappedFile_new(fp);
+    fclose(fp);
+
+    const FloorIndexHeader *header = (const FloorIndexHeader *)file->data;
+    if( !FloorIndexHeader_fits(header, file->len) ||
+        memcmp(header->magic, FLOOR_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->input_size       != (uint64_t)st->st_size ||
+        header->input_mtime_sec  != st->st_mtim.tv_sec ||
+        header->input_mtime_nsec != st->st_mtim.tv_nsec ||
+        header->sample           != FLOOR_SAMPLE )
+    {
+        MappedFile_destroy(file);
+        return NULL;
+    }
+
+    FloorIndex *self = calloc(1, sizeof(FloorIndex));
+    self->data = (char *)file->data;
+    self->size = file->len;
+    self->file = file;
+    self->buf  = buf;
+    FloorIndex_point(self);
+
+    return self;
+}
+
+static void FloorIndex_destroy(FloorIndex *self) {
+    if( self->file )
+        MappedFile_destroy(self->file);
+    else
+        free(self->data);
+
+    free(self);
+}
+
+/* Walk up to max instructions from the start of block, or until he's
+   on stop_floor if stop_at_floor, returns how many were walked */
+static int64_t FloorIndex_walk(FloorIndex *self, uint64_t block, int64_t max, int64_t *floor,
+                               int64_t stop_floor, bool stop_at_floor)
+{
+    const FloorSample *sample = &self->samples[block];
+    const char *end = self->buf + self->header->input_size;
+    int64_t walked = 0;
+
+    *floor = sample->floor;
+    for( const char *pos = self->buf + sample->offset; pos < end && walked < max; pos++ ) {
+        if( *pos != '(' && *pos != ')' )
+            continue;
+
+        *floor += *pos == '(' ? 1 : -1;
+        walked++;
+
+        if( stop_at_floor && *floor == stop_floor )
+            break;
+    }
+
+    return walked;
+}
+
+static int64_t FloorIndex_floor_at(FloorIndex *self, int64_t step) {
+    if( step >= self->header->instructions )
+        return self->header->end_floor;
+
+    int64_t floor;
+    uint64_t block = step / FLOOR_SAMPLE;
+    FloorIndex_walk(self, block, step - (int64_t)block * FLOOR_SAMPLE, &floor, 0, false);
+
+    return floor;
+}
+
+/* -1 for never */
+static int64_t FloorIndex_first_reach(FloorIndex *self, int64_t want) {
+    if( want == 0 )
+        return 0;
+
+    if( !FloorRange_has(&self->tree[1], want) )
         return -1;
+
+    uint64_t node = 1;
+    while( node < self->header->num_leaves ) {
+        node = FloorRange_has(&self->tree[2 * node], want) ? 2 * node : 2 * node + 1;
+    }
+
+    uint64_t block = node - self->header->num_leaves;
+    int64_t floor;
+    int64_t walked = FloorIndex_walk(self, block, FLOOR_SAMPLE, &floor, want, true);
+
+    return (int64_t)block * FLOOR_SAMPLE + walked;
+}
+
+/* Next to the input file if there is one, else in memory for this
+   solve only */
+static FloorIndex *FloorIndex_open(SolveContext *ctx, const char *input, size_t len) {
+    struct stat st = { .st_size = 0 };
+    FloorIndex *index = NULL;
+    char *index_file = NULL;
+
+    if( ctx->input_name ) {
+        if( stat(ctx->input_name, &st) != 0 )
+            die("Could not stat %s: %s", ctx->input_name, strerror(errno));
+
+        index_file = SolveContext_own(ctx, g_strdup_printf("%s.index", ctx->input_name), g_free);
     }
 
-    FILE *floor_fp = open_file(argv[1], "r");
-    
-    struct Floors *floors = read_floor_instructions(floor_fp);
-    printf("The instructions take Santa to floor %d.\n", floors->end_floor);
+    /* The index is of the input as read, so for a compressed file it's
+       the decompressed length which is checked */
+    st.st_size = len;
+
+    /* Owned as soon as there is one, anything after can die() */
+    if( index_file )
+        index = FloorIndex_load(index_file, &st, input);
+    if( index )
+        return SolveContext_own(ctx, index, (GDestroyNotify)FloorIndex_destroy);
+
+    phase_begin("index");
+    index = SolveContext_own(ctx, FloorIndex_build(input, len, &st), (GDestroyNotify)FloorIndex_destroy);
+    phase_items(len);
+    phase_end("index");
+
+    if( index_file )
+        FloorIndex_save(index, index_file);
+
+    return index;
+}
+
+typedef struct {
+    SolveContext *ctx;
+    FloorIndex *index;
+    long queries;
+} FloorQueries;
+
+static void answer_query(char *line, void *_queries) {
+    FloorQueries *queries = _queries;
+    char what[16];
+    int num_start;
+    char *num_end;
+
+    if( is_blank(line) )
+        return;
+
+    /* The number is all there is after the word, "floor 12abc" isn't 12 */
+    if( sscanf(line, "%15s%n", what, &num_start) != 1 )
+        die("Unknown query '%s', try 'floor <step>' or 'reach <floor>'", line);
+
+    errno = 0;
+    long num = strtol(line + num_start, &num_end, 10);
+    if( num_end == line + num_start || errno != 0 || !is_blank(num_end) )
+        die("Unknown query '%s', try 'floor <step>' or 'reach <floor>'", line);
+
+    if( streq(what, "floor") ) {
+        if( num < 0 )
+            die("There's no step %ld", num);
+        SolveContext_printf(queries->ctx, "floor %ld = %" PRId64 "\n", num,
+                            FloorIndex_floor_at(queries->index, num));
+    }
+    else if( streq(what, "reach") ) {
+        int64_t step = FloorIndex_first_reach(queries->index, num);
+        if( step < 0 )
+            SolveContext_printf(queries->ctx, "reach %ld = never\n", num);
+        else
+            SolveContext_printf(queries->ctx, "reach %ld = %" PRId64 "\n", num, step);
+    }
+    else {
+        die("Unknown query '%s', try 'floor <step>' or 'reach <floor>'", line);
+    }
+
+    queries->queries++;
+}
+
+static void query_floors(SolveContext *ctx, const char *input, size_t len, FILE *query_fp) {
+    init_count_parens();
+
+    FloorQueries queries = { .ctx = ctx, .index = FloorIndex_open(ctx, input, len), .queries = 0 };
+
+    phase_begin("query");
+    foreach_line(query_fp, answer_query, &queries);
+    phase_items(queries.queries);
+    phase_end("query");
+}
+
+/* With a query file, or - for stdin, it answers the queries instead */
+int day1_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    size_t len;
+    const char *buf = SolveContext_map(ctx, input, &len);
+
+    if( argc >= 1 ) {
+        FILE *query_fp = SolveContext_open(ctx, streq(argv[0], "-") ? NULL : argv[0]);
+        query_floors(ctx, buf, len, query_fp);
+
+        return 0;
+    }
+
+    phase_begin("solve");
+    struct Floors *floors = SolveContext_own(ctx, read_floor_instructions(buf, len), free);
+    phase_end("solve");
+
+    SolveContext_printf(ctx, "The instructions take Santa to floor %ld.\n", floors->end_floor);
     if( floors->first_enter_basement > 0 ) {
-        printf("Santa enters the basement at position %d.\n", floors->first_enter_basement);
+        SolveContext_printf(ctx, "Santa enters the basement at position %ld.\n", floors->first_enter_basement);
     }
 
-    free(floors);
-    
     return 0;
 }
+
+int main(int argc, char **argv) {
+    common_options(&argc, argv);
+
+    if( argc != 2 && argc != 3 ) {
+        char *desc[3] = { argv[0], "<inputfile>", "[<queryfile or ->]" };
+        usage(3, desc);
+        return -1;
+    }
+
+    return solve_main(day1_solve, argv[1], argc - 2, argv + 2);
+}
@@ -1,4 +1,6 @@
 #include "common.h"
+#include "phase.h"
+#include "solve.h"
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
@@ -198,7 +200,27 @@ static void run_tests() {
 }
 
 
+/* The input is the starting sequence, argv the number of times */
+int day10_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    if( argc < 1 )
+        die("How many times to look and say?");
+
+    size_t len;
+    const char *word = SolveContext_map(ctx, input, &len);
+    char *start = SolveContext_strndup(ctx, word, len);
+
+    SolveContext_printf(ctx, "Trying %s %s times.\n", start, argv[0]);
+    phase_begin("solve");
+    Sequence *result = SolveContext_own(ctx, look_and_say(start, atoi(argv[0])), (GDestroyNotify)Sequence_destroy);
+    phase_end("solve");
+    SolveContext_printf(ctx, "Length is %zu\n", result->size);
+
+    return 0;
+}
+
 int main(int argc, char **argv) {
+    common_options(&argc, argv);
+
     if( argc > 3 ) {
         char *desc[3] = { argv[0], "<initial sequence>", "<num times>" };
         usage(3, desc);
@@ -206,10 +228,7 @@ int main(int argc, char **argv) {
     }
     
     if( argc == 3 ) {
-        printf( "Trying %s %s times.\n", argv[1], argv[2] );
-        Sequence *result = look_and_say(argv[1], atoi(argv[2]));
-        printf("Length is %zu\n", result->size);
-        Sequence_destroy(result);
+        return solve_main_string(day10_solve, argv[1], argc - 2, argv + 2);
     }
     else {
         puts("Running tests.");
@@ -1,4 +1,6 @@
 #include "common.h"
+#include "phase.h"
+#include "solve.h"
 #include <stdio.h>
 #include <assert.h>
 #include <stdbool.h>
@@ -196,18 +198,34 @@ static void tests() {
 }
 
 
+/* The input is the old password */
+int day11_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    size_t len;
+    const char *word = SolveContext_map(ctx, input, &len);
+    char *old = SolveContext_strndup(ctx, word, len);
+
+    phase_begin("solve");
+    char *new = SolveContext_own(ctx, next_password(old), free);
+    phase_end("solve");
+
+    SolveContext_printf(ctx, "%s\n", new);
+
+    return 0;
+}
+
 int main(int argc, char **argv) {
+    common_options(&argc, argv);
+
     if( argc == 1 ) {
         tests();
     }
     else if( argc == 2 ) {
-        char *new = next_password( argv[1] );
-
-        puts(new);
-        free(new);
+        return solve_main_string(day11_solve, argv[1], argc - 2, argv + 2);
     }
     else {
         char *desc[] = {argv[0], "<old password>"};
         usage(2, desc);
     }
+
+    return 0;
 }
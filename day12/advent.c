@@ -1,9 +1,10 @@
 #include "common.h"
+#include "phase.h"
 #include <stdio.h>
 #include <assert.h>
 #include <math.h>
+#include "solve.h"
 #include <json-glib/json-glib.h>
-#include <gio/gunixinputstream.h>
 
 static int sum_json_node(JsonNode *node);
 
@@ -189,35 +190,49 @@ static void tests() {
     test_sum_json_string();
 }
 
-static int sum_json(FILE *input) {
+static int sum_json(SolveContext *ctx, const char *input, size_t len) {
     GError *error = NULL;
-    JsonParser *parser = json_parser_new();
-    GInputStream *stream = g_unix_input_stream_new( fileno(input), false );
+    JsonParser *parser = SolveContext_own(ctx, json_parser_new(), g_object_unref);
     
-    if( !json_parser_load_from_stream(parser, stream, NULL, &error) )
+    phase_begin("parse");
+    if( !json_parser_load_from_data(parser, input, len, &error) )
         die("Could not load JSON: %s", error->message);
 
+    /* Bytes of JSON */
+    phase_items(len);
+    phase_end("parse");
+
     JsonNode *root = json_parser_get_root(parser);
 
+    phase_begin("solve");
     int sum = sum_json_node(root);
-    
-    g_object_unref(parser);
-    g_object_unref(stream);
+    phase_end("solve");
 
     return sum;
 }
 
+int day12_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    size_t len;
+    const char *buf = SolveContext_map(ctx, input, &len);
+
+    SolveContext_printf(ctx, "%d\n", sum_json(ctx, buf, len));
+
+    return 0;
+}
+
 int main(int argc, char **argv) {
+    common_options(&argc, argv);
+
     if( argc == 1 ) {
         tests();
     }
     else if( argc == 2 ) {
-        FILE *input = open_file(argv[1], "r");
-        int sum = sum_json(input);
-        printf("%d\n", sum);
+        return solve_main(day12_solve, argv[1], argc - 2, argv + 2);
     }
     else {
         char *desc[] = {argv[0], "<input file>"};
         usage(2, desc);
     }
+
+    return 0;
 }
@@ -1,32 +1,33 @@
 #include "common.h"
+#include "phase.h"
 #include "graph.h"
+#include "solve.h"
 #include <glib.h>
 #include <stdio.h>
 #include <assert.h>
 #include <math.h>
 
-GRegex *Line_Re;
-
-static void init_regexes() {
-    if( !Line_Re )
-        Line_Re = compile_regex(
-            "^\\s*"
-            "(?<FROM>[[:alpha:]]+) would (?<SIGN>gain|lose) (?<HAPPINESS>\\d+) happiness units by sitting next to (?<TO>[[:alpha:]]+)\\."
-            "\\s*$",
-            G_REGEX_OPTIMIZE,
-            0
-        );
+/* Kept by the context, see solve.h */
+static GRegex *line_regex(SolveContext *ctx) {
+    return SolveContext_regex(ctx,
+        "^\\s*"
+        "(?<FROM>[[:alpha:]]+) would (?<SIGN>gain|lose) (?<HAPPINESS>\\d+) happiness units by sitting next to (?<TO>[[:alpha:]]+)\\."
+        "\\s*$",
+        G_REGEX_OPTIMIZE
+    );
 }
 
-static void free_regexes() {
-    g_regex_unref(Line_Re);
-}
+typedef struct {
+    GRegex *line_re;
+    Graph *graph;
+} GraphReader;
 
-void read_node( char *line, void *_graph ) {
-    Graph *graph = (Graph *)_graph;
+static void read_node( char *line, void *_reader ) {
+    GraphReader *reader = _reader;
+    Graph *graph = reader->graph;
     GMatchInfo *match;
 
-    if( g_regex_match(Line_Re, line, 0, &match) ) {
+    if( g_regex_match(reader->line_re, line, 0, &match) ) {
         char *from      = g_match_info_fetch_named(match, "FROM");
         char *to        = g_match_info_fetch_named(match, "TO");
         char *happiness = g_match_info_fetch_named(match, "HAPPINESS");
@@ -57,13 +58,13 @@ void read_node( char *line, void *_graph ) {
     return;
 }
 
-void test_read_node() {
+static void test_read_node() {
+    SolveContext *ctx = SolveContext_new();
     Graph *graph = Graph_new(20);
+    GraphReader reader = { .line_re = line_regex(ctx), .graph = graph };
 
-    init_regexes();
-    read_node( "Alice would gain 54 happiness units by sitting next to Bob.\n", graph );
-    read_node( "Bob would lose 14 happiness units by sitting next to Alice.\n", graph );
-    free_regexes();
+    read_node( "Alice would gain 54 happiness units by sitting next to Bob.\n", &reader );
+    read_node( "Bob would lose 14 happiness units by sitting next to Alice.\n", &reader );
 
     GraphNodeNum alice_num = Graph_lookup_or_add(graph, "Alice");
     GraphNodeNum bob_num   = Graph_lookup_or_add(graph, "Bob");
@@ -77,19 +78,23 @@ void test_read_node() {
     want = -40;
     printf("Graph_edge_cost( %p, %d, %d ) == %.0f/%.0f\n", graph, bob_num, alice_num, have, want);
     assert( have == want );
+
+    Graph_destroy(graph);
+    SolveContext_destroy(ctx);
 }
 
-Graph *read_graph(FILE *input) {
-    Graph *graph = Graph_new(30);
+static Graph *read_graph(SolveContext *ctx, FILE *input) {
+    GraphReader reader = {
+        .line_re = line_regex(ctx),
+        .graph   = SolveContext_own(ctx, Graph_new(30), (GDestroyNotify)Graph_destroy)
+    };
 
-    init_regexes();
-    foreach_line(input, read_node, graph);
-    free_regexes();
+    foreach_line(input, read_node, &reader);
     
-    return graph;
+    return reader.graph;
 }
 
-void runtests() {
+static void runtests() {
     test_read_node();
 }
 
@@ -106,27 +111,38 @@ static void add_me(Graph *graph) {
     }
 }
 
+int day13_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    phase_begin("parse");
+    Graph *graph = read_graph(ctx, input);
+    add_me(graph);
+    phase_items(graph->num_nodes);
+    phase_end("parse");
+    
+    if( DEBUG )
+        Graph_print(graph);
+    
+    phase_begin("solve");
+    int happiness = -Graph_shortest_route_cost_from(graph, 0, true);
+    phase_end("solve");
+
+    SolveContext_printf(ctx, "%d\n", happiness);
+
+    return 0;
+}
+
 int main(int argc, char **argv) {
+    common_options(&argc, argv);
+
     if( argc == 1 ) {
         runtests();
     }
     else if( argc == 2 ) {
-        FILE *input = open_file(argv[1], "r");
-        Graph *graph = read_graph(input);
-
-        add_me(graph);
-        
-        if( DEBUG )
-            Graph_print(graph);
-        
-        int happiness = -Graph_shortest_route_cost_from(graph, 0, true);
-
-        printf("%d\n", happiness);
-
-        Graph_destroy(graph);
+        return solve_main(day13_solve, argv[1], argc - 2, argv + 2);
     }
     else {
         char *desc[] = {argv[0], "<input file>"};
         usage(2, desc);
     }
+
+    return 0;
 }
@@ -1,4 +1,6 @@
 #include "common.h"
+#include "phase.h"
+#include "solve.h"
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -48,25 +50,18 @@ static void Reindeer_print(Reindeer *self) {
     );
 }
 
-GRegex *Line_Re;
-
-static void init_regexes() {
-    if( !Line_Re )
-        Line_Re = compile_regex(
-            "^(?<NAME>[[:alpha:]]+) can fly (?<FLIGHT_SPEED>\\d+) km/s for (?<FLIGHT_TIME>\\d+) seconds, but then must rest for (?<REST_TIME>\\d+) seconds\\.$",
-            G_REGEX_OPTIMIZE,
-            0
-        );
-}
-
-static void free_regexes() {
-    g_regex_unref(Line_Re);
+/* Kept by the context, see solve.h */
+static GRegex *line_regex(SolveContext *ctx) {
+    return SolveContext_regex(ctx,
+        "^(?<NAME>[[:alpha:]]+) can fly (?<FLIGHT_SPEED>\\d+) km/s for (?<FLIGHT_TIME>\\d+) seconds, but then must rest for (?<REST_TIME>\\d+) seconds\\.$",
+        G_REGEX_OPTIMIZE
+    );
 }
 
-static void read_reindeer_line( char *line, Reindeer **reindeer_p ) {
+static void read_reindeer_line( GRegex *line_re, char *line, Reindeer **reindeer_p ) {
     GMatchInfo *match;
     
-    if( g_regex_match(Line_Re, line, 0, &match) ) {
+    if( g_regex_match(line_re, line, 0, &match) ) {
         char *name              = g_match_info_fetch_named(match, "NAME");
         char *flight_speed      = g_match_info_fetch_named(match, "FLIGHT_SPEED");
         char *flight_time       = g_match_info_fetch_named(match, "FLIGHT_TIME");
@@ -127,7 +122,8 @@ static int race_reindeer(Reindeer **reindeers, int num_reindeer, int race_length
     return max_of(points, num_reindeer);
 }
 
-static int read_and_race_reindeer(FILE *input, int race_length) {
+static int read_and_race_reindeer(SolveContext *ctx, FILE *input, int race_length) {
+    GRegex *line_re = line_regex(ctx);
     int max_reindeer = 10;
     Reindeer **reindeers = calloc(max_reindeer, sizeof(Reindeer*));
 
@@ -142,7 +138,7 @@ static int read_and_race_reindeer(FILE *input, int race_length) {
         }
         
         Reindeer *reindeer = NULL;
-        read_reindeer_line(line, &reindeer);
+        read_reindeer_line(line_re, line, &reindeer);
         if( reindeer ) {
             reindeers[num_reindeer] = reindeer;
             num_reindeer++;
@@ -163,7 +159,7 @@ static int read_and_race_reindeer(FILE *input, int race_length) {
 
 
 #define NUM_TEST_REINDEER 2
-char *Test_Lines[NUM_TEST_REINDEER] = {
+static char *Test_Lines[NUM_TEST_REINDEER] = {
     "Comet can fly 14 km/s for 10 seconds, but then must rest for 127 seconds.\n",
     "Dancer can fly 16 km/s for 11 seconds, but then must rest for 162 seconds.\n"
 };
@@ -171,10 +167,11 @@ char *Test_Lines[NUM_TEST_REINDEER] = {
 static void test_reindeer() {
     printf("test_reindeer\n");
     
+    SolveContext *ctx = SolveContext_new();
     Reindeer *reindeers[NUM_TEST_REINDEER];
     for( int i = 0; i < NUM_TEST_REINDEER; i++ ) {
         Reindeer *reindeer = NULL;
-        read_reindeer_line( Test_Lines[i], &reindeer );
+        read_reindeer_line( line_regex(ctx), Test_Lines[i], &reindeer );
 
         reindeers[i] = reindeer;
     }
@@ -198,15 +195,17 @@ static void test_reindeer() {
     for( int i = 0; i < NUM_TEST_REINDEER; i++ ) {
         Reindeer_destroy(reindeers[i]);
     }
+    SolveContext_destroy(ctx);
 }
 
 static void test_race_reindeer() {
     printf("test_race_reindeer\n");
     
+    SolveContext *ctx = SolveContext_new();
     Reindeer *reindeers[NUM_TEST_REINDEER];
     for( int i = 0; i < NUM_TEST_REINDEER; i++ ) {
         Reindeer *reindeer = NULL;
-        read_reindeer_line( Test_Lines[i], &reindeer );
+        read_reindeer_line( line_regex(ctx), Test_Lines[i], &reindeer );
         reindeers[i] = reindeer;
     }
 
@@ -215,6 +214,7 @@ static void test_race_reindeer() {
     for( int i = 0; i < NUM_TEST_REINDEER; i++ ) {
         Reindeer_destroy(reindeers[i]);
     }
+    SolveContext_destroy(ctx);
 }
 
 static void run_tests() {
@@ -226,12 +226,21 @@ static void run_tests() {
     printf("OK\n");
 }
 
+int day14_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    phase_begin("solve");
+    int distance = read_and_race_reindeer(ctx, input, 2503);
+    phase_end("solve");
+
+    SolveContext_printf(ctx, "%d\n", distance);
+
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
-    init_regexes();
-    
+    common_options(&argc, argv);
+
     if( argc == 2 ) {
-        FILE *input = open_file(argv[1], "r");
-        printf("%d\n", read_and_race_reindeer(input, 2503));
+        return solve_main(day14_solve, argv[1], argc - 2, argv + 2);
     }
     else if( argc == 1 ) {
         run_tests();
@@ -241,5 +250,5 @@ int main(int argc, char *argv[]) {
         usage(2, desc);
     }
 
-    free_regexes();
+    return 0;
 }
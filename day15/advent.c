@@ -1,26 +1,19 @@
 #include "common.h"
+#include "phase.h"
+#include "solve.h"
 #include <assert.h>
 #include <glib.h>
 #include <stdio.h>
 #include <stdbool.h>
 
-GRegex *Line_Re;
-
-static void free_regexes() {
-    g_regex_unref(Line_Re);
-}
-
-static void init_regexes() {
-    if( !Line_Re ) {
-        Line_Re = compile_regex(
-            "^"
-            "(?<NAME>[[:alpha:]]+): capacity (?<CAP>-?\\d+), durability (?<DUR>-?\\d+), flavor (?<FLA>-?\\d+), texture (?<TEX>-?\\d+), calories (?<CAL>-?\\d+)"
-            "$",
-            G_REGEX_OPTIMIZE,
-            0
-        );
-        atexit(free_regexes);
-    }
+/* Kept by the context, see solve.h */
+static GRegex *line_regex(SolveContext *ctx) {
+    return SolveContext_regex(ctx,
+        "^"
+        "(?<NAME>[[:alpha:]]+): capacity (?<CAP>-?\\d+), durability (?<DUR>-?\\d+), flavor (?<FLA>-?\\d+), texture (?<TEX>-?\\d+), calories (?<CAL>-?\\d+)"
+        "$",
+        G_REGEX_OPTIMIZE
+    );
 }
 
 typedef enum {
@@ -44,12 +37,18 @@ static void Ingredient_destroy(ingredient_t *self) {
     free(self);
 }
 
-static void read_ingredient( char *line, void *_ingredients ) {
-    GArray *ingredients = (GArray *)_ingredients;
+typedef struct {
+    GRegex *line_re;
+    GArray *ingredients;
+} IngredientReader;
+
+static void read_ingredient( char *line, void *_reader ) {
+    IngredientReader *reader = _reader;
+    GArray *ingredients = reader->ingredients;
 
     GMatchInfo *match;
     
-    if( g_regex_match(Line_Re, line, 0, &match) ) {
+    if( g_regex_match(reader->line_re, line, 0, &match) ) {
         char *name  = g_match_info_fetch_named(match, "NAME");
         char *cap   = g_match_info_fetch_named(match, "CAP");
         char *dur   = g_match_info_fetch_named(match, "DUR");
@@ -75,7 +74,7 @@ static void read_ingredient( char *line, void *_ingredients ) {
         free(cal);
     }
     else if( !is_blank(line) ) {
-        die("Unknown line: '%s'");
+        die("Unknown line: '%s'", line);
     }
 }
 
@@ -165,10 +164,17 @@ static long best_ingredients_combo( GArray *ingredients, int total ) {
     return score;
 }
 
-static GArray *read_ingredients(FILE *input) {
-    GArray *ingredients = Ingredients_new();
-    foreach_line(input, read_ingredient, ingredients);
-    return ingredients;
+static void destroy_ingredients(void *ingredients) {
+    Ingredients_destroy(ingredients, true);
+}
+
+static GArray *read_ingredients(SolveContext *ctx, FILE *input) {
+    IngredientReader reader = {
+        .line_re     = line_regex(ctx),
+        .ingredients = SolveContext_own(ctx, Ingredients_new(), destroy_ingredients)
+    };
+    foreach_line(input, read_ingredient, &reader);
+    return reader.ingredients;
 }
 
 static void test_ingredients() {
@@ -180,9 +186,11 @@ static void test_ingredients() {
         "Cinnamon: capacity 2, durability 3, flavor -2, texture -1, calories 3\n"
     };
 
+    SolveContext *ctx = SolveContext_new();
     GArray *ingredients = Ingredients_new();
+    IngredientReader reader = { .line_re = line_regex(ctx), .ingredients = ingredients };
     for( int i = 0; i < num_lines; i++ ) {
-        read_ingredient(lines[i], ingredients);
+        read_ingredient(lines[i], &reader);
     }
 
     ingredient_t *butterscotch = g_array_index(ingredients, ingredient_t*, 0);
@@ -214,6 +222,7 @@ static void test_ingredients() {
     assert( best_ingredients_combo(ingredients, 100) == 62842880 );
     
     Ingredients_destroy(ingredients, true);
+    SolveContext_destroy(ctx);
     
     puts("OK");
 }
@@ -273,20 +282,38 @@ static void runtests() {
     test_increment_measures();
 }
 
+/* argv is the total units of ingredients */
+int day15_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    if( argc < 1 )
+        die("How many units of ingredients?");
+
+    phase_begin("parse");
+    GArray *ingredients = read_ingredients(ctx, input);
+    phase_items(ingredients->len);
+    phase_end("parse");
+
+    phase_begin("solve");
+    long score = best_ingredients_combo(ingredients, atoi(argv[0]));
+    phase_end("solve");
+
+    SolveContext_printf(ctx, "%ld\n", score);
+
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
-    init_regexes();
+    common_options(&argc, argv);
 
     if( argc == 1 ) {
         runtests();
     }
     else if( argc == 3 ) {
-        FILE *input = open_file(argv[1], "r");
-        GArray *ingredients = read_ingredients(input);
-        printf("%ld\n", best_ingredients_combo(ingredients, atoi(argv[2])));
-        Ingredients_destroy(ingredients, true);
+        return solve_main(day15_solve, argv[1], argc - 2, argv + 2);
     }
     else {
         char *desc[] = {argv[0], "<input file>", "<total units>"};
         usage(3, desc);
     }
+
+    return 0;
 }
@@ -1,29 +1,23 @@
 #include "common.h"
+#include "phase.h"
+#include "map.h"
+#include "solve.h"
 #include <assert.h>
 #include <stdio.h>
 #include <glib.h>
 #include <stdlib.h>
 
-GRegex *Line_Re;
-
-static void free_regexes() {
-    g_regex_unref(Line_Re);
+/* Kept by the context, see solve.h */
+static GRegex *line_regex(SolveContext *ctx) {
+    return SolveContext_regex(ctx,
+        "^"
+        "Sue (?<NUM>\\d+): (?<PROPS>.+)"
+        "$",
+        G_REGEX_OPTIMIZE
+    );
 }
 
-static void init_regexes() {
-    if( !Line_Re ) {
-        Line_Re = compile_regex(
-            "^"
-            "Sue (?<NUM>\\d+): (?<PROPS>.+)"
-            "$",
-            G_REGEX_OPTIMIZE,
-            0
-        );
-        atexit(free_regexes);
-    }
-}
-
-static bool filter_aunt(char *prop_line, GHashTable *filter) {
+static bool filter_aunt(char *prop_line, StrMap *filter) {
     gchar **props = g_regex_split_simple(", ", prop_line, 0, 0);
 
     bool check = true;
@@ -36,8 +30,10 @@ static bool filter_aunt(char *prop_line, GHashTable *filter) {
         if( DEBUG )
             printf("Trying %s -> %d\n", key, have);
         
-        void *_want = g_hash_table_lookup( filter, key );
-        int want = *(int *)_want;
+        void *_want;
+        if( !StrMap_lookup( filter, key, &_want ) )
+            die("Unknown property '%s'", key);
+        int want = (intptr_t)_want;
 
         if( streq(key, "cats") || streq(key, "trees") ) {
             if( have <= want )
@@ -63,15 +59,16 @@ static bool filter_aunt(char *prop_line, GHashTable *filter) {
     return check;
 }
 
-static int find_aunt(FILE *input, GHashTable *filter) {
+static int find_aunt(SolveContext *ctx, FILE *input, StrMap *filter) {
+    GRegex *line_re = line_regex(ctx);
     char *line = NULL;
     size_t linecap = 0;
 
-    GMatchInfo *match;
+    GMatchInfo *match = NULL;
     int matched_aunt = 0;
     
     while( getline(&line, &linecap, input) > 0 ) {
-        if( g_regex_match(Line_Re, line, 0, &match ) ) {
+        if( g_regex_match(line_re, line, 0, &match ) ) {
             char *props = g_match_info_fetch_named(match, "PROPS");
             
             if( filter_aunt(props, filter) ) {
@@ -90,6 +87,7 @@ static int find_aunt(FILE *input, GHashTable *filter) {
         }
 
         g_match_info_free(match);
+        match = NULL;
     }
 
     free(line);
@@ -98,15 +96,13 @@ static int find_aunt(FILE *input, GHashTable *filter) {
     return matched_aunt;
 }
 
-static inline void add_to_filter(GHashTable *filter, char *key, int val) {
-    int *val_p = malloc(sizeof(val));
-    *val_p = val;
-
-    g_hash_table_insert(filter, key, val_p);
+/* The values are small, they're stored in the pointer */
+static inline void add_to_filter(StrMap *filter, char *key, int val) {
+    StrMap_put(filter, key, (void *)(intptr_t)val);
 }
 
-static GHashTable *make_filter() {
-    GHashTable *filter = g_hash_table_new_full( g_str_hash, g_str_equal, NULL, free );
+static StrMap *make_filter() {
+    StrMap *filter = StrMap_new(10);
 
     add_to_filter(filter, "children", 3);
     add_to_filter(filter, "cats", 7);
@@ -122,19 +118,32 @@ static GHashTable *make_filter() {
     return filter;
 }
 
+static void destroy_filter(void *filter) {
+    StrMap_destroy(filter, NULL);
+}
+
+int day16_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    StrMap *filter = SolveContext_own(ctx, make_filter(), destroy_filter);
+
+    phase_begin("solve");
+    int aunt = find_aunt(ctx, input, filter);
+    phase_end("solve");
+
+    SolveContext_printf(ctx, "%d\n", aunt);
+
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
-    init_regexes();
-    
-    if( argc == 2 ) {
-        GHashTable *filter = make_filter();
-        
-        FILE *input = open_file(argv[1], "r");
-        printf("%d\n", find_aunt(input, filter));
+    common_options(&argc, argv);
 
-        g_hash_table_unref(filter);
+    if( argc == 2 ) {
+        return solve_main(day16_solve, argv[1], argc - 2, argv + 2);
     }
     else {
         char *desc[] = {argv[0], "<inputfile>"};
         usage(2, desc);
     }
+
+    return 0;
 }
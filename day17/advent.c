@@ -1,4 +1,9 @@
 #include "common.h"
+#include "phase.h"
+#include "pool.h"
+#include "vec.h"
+#include "sort.h"
+#include "solve.h"
 #include <glib.h>
 #include <stdio.h>
 #include <assert.h>
@@ -13,13 +18,13 @@ static inline bool is_in_combo( combo_size_t combo, int i ) {
     return combo & (1<<i);
 }
 
-static bool try_combo(GArray *containers, combo_size_t combo, target_size_t target) {
+static bool try_combo(Vec *containers, combo_size_t combo, target_size_t target) {
     size_t num_containers = containers->len;
 
     target_size_t sum = 0;
     for( int i = 0; i < num_containers; i++ ) {
         if( is_in_combo(combo, i) )
-            sum += g_array_index(containers, container_size_t, i);
+            sum += Vec_index(containers, container_size_t, i);
 
         if( sum > target )
             return false;
@@ -32,9 +37,11 @@ static void test_try_combo() {
     printf("test_try_combo...");
     
     container_size_t test_data[] = {20, 15, 10, 5, 5};
-    GArray *containers = g_array_new(false, true, sizeof(container_size_t));
+    Vec *containers = Vec_new(sizeof(container_size_t), 0);
 
-    g_array_append_vals(containers, test_data, 5);
+    for( int i = 0; i < 5; i++ ) {
+        Vec_push_val(containers, test_data[i]);
+    }
 
     g_assert_false( try_combo(containers, 0L, 25) );
     g_assert_false( try_combo(containers, 1L, 25) );
@@ -52,7 +59,7 @@ static void test_try_combo() {
     // 15, 5, and 5
     g_assert_true( try_combo(containers,  ((1<<1) + (1<<3) + (1<<4)), 25) );
     
-    g_array_unref(containers);
+    Vec_destroy(containers);
 
     puts("OK");
 }
@@ -61,14 +68,14 @@ static void read_container(char *line, void *_containers) {
     if( is_blank(line) )
         return;
     
-    GArray *containers = (GArray*)_containers;
+    Vec *containers = (Vec*)_containers;
 
     errno = 0;
     container_size_t size = strtol(line, NULL, 10);
     if( size == 0 && errno == EINVAL)
         die("Unknown line '%s'", line);
 
-    g_array_append_val(containers, size);
+    Vec_push_val(containers, size);
 
     return;
 }
@@ -76,7 +83,7 @@ static void read_container(char *line, void *_containers) {
 static void test_read_container() {
     printf("test_read_container...");
     
-    GArray *containers = g_array_new(false, true, sizeof(container_size_t));
+    Vec *containers = Vec_new(sizeof(container_size_t), 0);
 
     read_container("", containers);
     g_assert_cmpuint( containers->len, ==, 0 );
@@ -86,31 +93,31 @@ static void test_read_container() {
 
     read_container("23\n", containers);
     g_assert_cmpuint( containers->len, ==, 1 );
-    g_assert_cmpint( g_array_index(containers, container_size_t, 0), ==, 23 );
+    g_assert_cmpint( Vec_index(containers, container_size_t, 0), ==, 23 );
 
     read_container("0\n", containers);
     g_assert_cmpuint( containers->len, ==, 2 );
-    g_assert_cmpint( g_array_index(containers, container_size_t, 1), ==, 0 );
+    g_assert_cmpint( Vec_index(containers, container_size_t, 1), ==, 0 );
     
-    g_array_unref(containers);
+    Vec_destroy(containers);
 
     puts("OK");
 }
 
-static GArray *read_containers(FILE *input) {
-    GArray *containers = g_array_new(false, true, sizeof(container_size_t));
+static Vec *read_containers(SolveContext *ctx, FILE *input) {
+    Vec *containers = SolveContext_own(ctx, Vec_new(sizeof(container_size_t), 0), (GDestroyNotify)Vec_destroy);
 
     foreach_line(input, read_container, containers);
     
     return containers;
 }
 
-static void print_combo(GArray *containers, combo_size_t combo, container_size_t num) {
+static void print_combo(SolveContext *ctx, Vec *containers, combo_size_t combo, container_size_t num) {
     for( int i = 0; i < num; i++ ) {
         if( is_in_combo(combo, i) )
-            printf("%d ", g_array_index(containers, container_size_t, i));
+            SolveContext_printf(ctx, "%d ", Vec_index(containers, container_size_t, i));
     }
-    puts("");
+    SolveContext_printf(ctx, "\n");
 }
 
 static inline size_t get_combo_size( combo_size_t combo, size_t num_containers ) {
@@ -133,57 +140,113 @@ static void test_get_combo_size() {
     puts("OK");
 }
 
-static inline GArray *clear_array(GArray *array) {
-    if( array->len == 0 )
-        return array;
-    return g_array_remove_range(array, 0, array->len);    
+static inline Vec *clear_array(Vec *array) {
+    Vec_clear(array);
+    return array;
 }
 
 static void test_clear_array() {
     printf("test_clear_array...");
     
-    GArray *array = g_array_new(false, true, sizeof(int));
+    Vec *array = Vec_new(sizeof(int), 0);
 
     clear_array(array);
     g_assert_cmpuint( array->len, ==, 0 );
     
     int haves[] = {23, 42};
-    g_array_append_vals(array, haves, 2);
+    Vec_push_val(array, haves[0]);
+    Vec_push_val(array, haves[1]);
 
     g_assert_cmpuint( array->len, ==, 2 );
 
     clear_array(array);
     g_assert_cmpuint( array->len, ==, 0 );
 
-    g_array_unref(array);
+    Vec_destroy(array);
     
     puts("OK");
 }
 
-static GArray *find_combos(GArray *containers, target_size_t target, bool find_min_combos) {
-    GArray *combos = g_array_new(false, true, sizeof(combo_size_t));
-    size_t num_containers = containers->len;
-    size_t min_combo_size = SIZE_MAX;
-    
-    for( combo_size_t combo = 0; combo <= (1<<num_containers); combo++ ) {
+typedef struct {
+    Vec *containers;
+    target_size_t target;
+    bool find_min_combos;
+} ComboSearch;
+
+/* Each thread's combos.  combos starts NULL, the partials are copies. */
+typedef struct {
+    Vec *combos;
+    size_t min_combo_size;
+} ComboResult;
+
+static void ComboResult_add(ComboResult *self, combo_size_t combo, size_t combo_size, bool find_min_combos) {
+    if( !self->combos )
+        self->combos = Vec_new(sizeof(combo_size_t), 0);
+
+    // If we found a smaller combo, throw out all previous combos
+    if( find_min_combos && combo_size < self->min_combo_size ) {
+        clear_array(self->combos);
+        self->min_combo_size = combo_size;
+    }
+
+    Vec_push_val(self->combos, combo);
+}
+
+static void find_combos_range(long from, long to, void *_search, void *_result) {
+    ComboSearch *search = _search;
+    ComboResult *result = _result;
+    size_t num_containers = search->containers->len;
+
+    for( combo_size_t combo = from; combo < to; combo++ ) {
         size_t combo_size = get_combo_size(combo, num_containers);
 
         // Skip combos that are bigger than the minimum.
-        if( find_min_combos && combo_size > min_combo_size )
+        if( search->find_min_combos && combo_size > result->min_combo_size )
             continue;
             
-        if( try_combo(containers, combo, target) ) {
-            // If we found a smaller combo, throw out all previous combos
-            if( find_min_combos && combo_size < min_combo_size ) {
-                clear_array(combos);
-                min_combo_size = combo_size;
-            }
-            
-            g_array_append_val(combos, combo);
+        if( try_combo(search->containers, combo, search->target) )
+            ComboResult_add(result, combo, combo_size, search->find_min_combos);
+    }
+}
+
+static void find_combos_combine(void *_result, const void *_partial, void *_search) {
+    ComboSearch *search = _search;
+    ComboResult *result = _result;
+    const ComboResult *partial = _partial;
+
+    if( !partial->combos )
+        return;
+
+    if( !search->find_min_combos || partial->min_combo_size <= result->min_combo_size ) {
+        for( int i = 0; i < partial->combos->len; i++ ) {
+            ComboResult_add(result, Vec_index(partial->combos, combo_size_t, i),
+                            partial->min_combo_size, search->find_min_combos);
         }
     }
-        
-    return combos;
+
+    Vec_destroy(partial->combos);
+}
+
+/* Every combo is tried independently across the thread pool.  They're
+   sorted at the end so the order doesn't depend on the threads. */
+static Vec *find_combos(Vec *containers, target_size_t target, bool find_min_combos) {
+    ComboSearch search = {
+        .containers      = containers,
+        .target          = target,
+        .find_min_combos = find_min_combos
+    };
+    ComboResult result = { .combos = NULL, .min_combo_size = SIZE_MAX };
+
+    pool_reduce(0, (1L<<containers->len) + 1, 1024,
+                find_combos_range, find_combos_combine,
+                &result, sizeof(result), &search);
+
+    if( !result.combos )
+        return Vec_new(sizeof(combo_size_t), 0);
+
+    Vec_sort(result.combos, cmp_long);
+
+    return result.combos;
 }
 
 static void runtests() {
@@ -193,21 +256,36 @@ static void runtests() {
     test_get_combo_size();
 }
 
+/* argv is the storage target */
+int day17_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    if( argc < 1 )
+        die("How much is there to store?");
+
+    phase_begin("parse");
+    Vec *containers = read_containers(ctx, input);
+    phase_items(containers->len);
+    phase_end("parse");
+
+    phase_begin("solve");
+    Vec *combos = SolveContext_own(ctx, find_combos(containers, atol(argv[0]), true), (GDestroyNotify)Vec_destroy);
+    phase_items((1L<<containers->len) + 1);
+    phase_end("solve");
+
+    for( int i = 0; i < combos->len; i++ ) {
+        print_combo(ctx, containers, Vec_index(combos, combo_size_t, i), containers->len);
+    }
+
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
+    common_options(&argc, argv);
+
     if( argc == 1 ) {
         runtests();
     }
     else if( argc == 3 ) {
-        FILE *input = open_file(argv[1], "r");
-        GArray *containers = read_containers(input);
-        GArray *combos = find_combos(containers, atol(argv[2]), true);
-
-        for( int i = 0; i < combos->len; i++ ) {
-            print_combo(containers, g_array_index(combos, combo_size_t, i), containers->len);
-        }
-        
-        g_array_unref(containers);
-        g_array_unref(combos);
+        return solve_main(day17_solve, argv[1], argc - 2, argv + 2);
     }
     else {
         char *desc[] = {argv[0], "<input file>", "<storage target>"};
@@ -1,4 +1,11 @@
 #include "common.h"
+#include "trace.h"
+#include "phase.h"
+#include "pool.h"
+#include "vec.h"
+#include "grid.h"
+#include "tune.h"
+#include "solve.h"
 #include <assert.h>
 #include <stdio.h>
 #include <glib.h>
@@ -15,11 +22,23 @@ typedef struct {
     size_t max_rows;
     size_t max_cols;
     size_t rows;
-    Light *grid;
+    Grid *grid;
+    /* Where the next step goes, then they swap */
+    Grid *next_grid;
 } Lights;
 
-static inline Light Lights_get(Lights *self, size_t row, size_t col) {
-    return TWOD(self->grid, row, col, self->max_rows);
+/* Rows per piece of a step, see Lights_step() */
+#define LIGHTS_ROW_GRAIN 16
+
+/* The step sweeps along rows and only needs the rows either side, so
+   plain rows stay in cache and index the cheapest.  On a 6000x6000
+   grid tiles took 1.6x as long and Z-order longer still.  It's the
+   layout unless advent --tune finds otherwise for the grid's size, or
+   ADVENT_GRID says. */
+#define LIGHTS_LAYOUT GRID_ROWS
+
+static inline Light Lights_get(Lights *self, long row, long col) {
+    return Grid_at(self->grid, Light, row, col);
 }
 
 static inline void Lights_set(Lights *self, size_t row, size_t col, Light new) {
@@ -30,10 +49,10 @@ static inline void Lights_set(Lights *self, size_t row, size_t col, Light new) {
     if( old == STUCK_OFF || old == STUCK_ON )
         return;
     
-    TWOD(self->grid, row, col, self->max_rows) = new;
+    Grid_at(self->grid, Light, row, col) = new;
 }
 
-static inline bool Lights_same_setting(Lights *self, size_t row, size_t col, Light want) {
+static inline bool Lights_same_setting(Lights *self, long row, long col, Light want) {
     Light state = Lights_get(self, row, col);
     if( state == want )
         return true;
@@ -49,8 +68,10 @@ static inline size_t Lights_get_next_row(Lights *self) {
     return self->rows;
 }
 
-static inline Light *Lights_new_grid(Lights *self) {
-    return calloc(self->max_rows * self->max_cols, sizeof(Light));
+/* A halo of OFF lights, so neighbors can be counted without checking
+   for the edge */
+static inline Grid *Lights_new_grid(Lights *self, GridLayout layout) {
+    return Grid_new(self->max_rows, self->max_cols, sizeof(Light), layout, 1);
 }
 
 static Lights *Lights_new(size_t rows, size_t cols) {
@@ -58,31 +79,27 @@ static Lights *Lights_new(size_t rows, size_t cols) {
 
     self->max_rows = rows;
     self->max_cols = cols;
-    self->grid = Lights_new_grid(self);
+    GridLayout layout = tune_engine("day18", Grid_Layout_Names, rows * cols, LIGHTS_LAYOUT);
+    self->grid = Lights_new_grid(self, grid_layout(layout));
     
     self->rows = 0;
 
     return self;
 }
 
-static Lights *Lights_new_from_array(size_t rows, size_t cols, Light *grid) {
-    Lights *self = calloc(1, sizeof(Lights));
+static Lights *Lights_new_from_array_copy(size_t rows, size_t cols, Light *orig_grid) {
+    Lights *self = Lights_new(rows, cols);
 
-    self->max_rows = rows;
-    self->max_cols = cols;
+    for( size_t row = 0; row < rows; row++ ) {
+        for( size_t col = 0; col < cols; col++ ) {
+            Grid_at(self->grid, Light, row, col) = TWOD(orig_grid, row, col, cols);
+        }
+    }
     self->rows = rows;
 
-    self->grid = grid;
-
     return self;
 }
 
-static Lights *Lights_new_from_array_copy(size_t rows, size_t cols, Light *orig_grid) {
-    Light *copy_grid = calloc(rows*cols, sizeof(Light));
-    memcpy(copy_grid, orig_grid, rows * cols * sizeof(Light));
-    return Lights_new_from_array(rows, cols, copy_grid);
-}
-
 static void Lights_read_line(char *line, void *_lights) {
     Lights *lights = (Lights *)_lights;
     size_t row = Lights_get_next_row(lights);
@@ -115,23 +132,44 @@ static void Lights_read_line(char *line, void *_lights) {
 static Lights *Lights_new_from_strings(size_t rows, size_t cols, char *lines[]) {
     Lights *self = Lights_new(rows, cols);
 
-    for( int i = 0; lines[i] != NULL && i < self->max_rows; i++ ) {
+    for( int i = 0; i < self->max_rows && lines[i] != NULL; i++ ) {
         Lights_read_line(lines[i], self);
     }
 
     return self;
 }
 
-static Lights *Lights_new_from_fp(size_t rows, size_t cols, FILE *input) {
-    Lights *self = Lights_new(rows, cols);
+static void Lights_keep_line(char *line, void *lines) {
+    char *copy = strdup(line);
+    Vec_push_val(lines, copy);
+}
+
+/* The grid is one row per line and as wide as the first line.  The
+   lines are kept to measure it first, the input might be a pipe which
+   can't be read twice. */
+static Lights *Lights_new_from_fp(FILE *input) {
+    Vec *lines = Vec_new(sizeof(char *), 128);
+    foreach_line(input, Lights_keep_line, lines);
 
-    foreach_line(input, Lights_read_line, self);
+    size_t rows = lines->len;
+    size_t cols = rows ? strcspn(Vec_index(lines, char *, 0), "\n") : 0;
+
+    char *end = NULL;
+    Vec_push_val(lines, end);
+    Lights *self = Lights_new_from_strings(rows, cols, (char **)lines->data);
+
+    for( size_t i = 0; i < rows; i++ ) {
+        free(Vec_index(lines, char *, i));
+    }
+    Vec_destroy(lines);
 
     return self;
 }
 
 static void Lights_destroy(Lights *self) {
-    free(self->grid);
+    Grid_destroy(self->grid);
+    if( self->next_grid )
+        Grid_destroy(self->next_grid);
     free(self);
 }
 
@@ -190,7 +228,7 @@ static void assert_lights_eq(Lights *have, Lights *want) {
     }
 }
 
-static int Lights_num_neighbors(Lights *self, size_t origin_row, size_t origin_col, Light setting) {
+static int Lights_num_neighbors(Lights *self, long origin_row, long origin_col, Light setting) {
     int num_neighbors = 0;
     
     for( int i = -1; i <= 1; i++ ) {
@@ -199,16 +237,13 @@ static int Lights_num_neighbors(Lights *self, size_t origin_row, size_t origin_c
             if( i == 0 && j == 0 )
                 continue;
             
-            int row = origin_row + i;
-            int col = origin_col + j;
-
-            // We've gone past the edge
-            if( row < 0 || col < 0 ||
-                row >= self->max_rows    ||
-                col >= self->max_cols
-            ) {
+            long row = origin_row + i;
+            long col = origin_col + j;
+
+            // We've gone past the edge.  The halo is all OFF, so only
+            // counting OFF lights needs to check.
+            if( setting != ON && !Grid_in_bounds(self->grid, row, col) )
                 continue;
-            }
 
             if( Lights_same_setting(self, row, col, setting) )
                 num_neighbors++;
@@ -218,46 +253,83 @@ static int Lights_num_neighbors(Lights *self, size_t origin_row, size_t origin_c
     return num_neighbors;
 }
 
-static void Lights_step(Lights *self) {
-    Light *new_grid = Lights_new_grid(self);
-    
-    for( int row = 0; row < self->max_rows; row++ ) {
-        for( int col = 0; col < self->max_cols; col++ ) {
-            Light light = Lights_get(self, row, col);
+typedef struct {
+    Lights *lights;
+    Grid *new_grid;
+} LightsStep;
+
+static inline bool light_is_on(Light light) {
+    return light == ON || light == STUCK_ON;
+}
+
+/* The step for one layout, it's inlined into Lights_step_rows() once
+   per layout with it as a constant */
+static inline void Lights_step_rows_in(LightsStep *step, GridLayout layout, long from, long to) {
+    Lights *self = step->lights;
+    Grid *grid = self->grid;
+    Grid *new_grid = step->new_grid;
+
+    for( long row = from; row < to; row++ ) {
+        for( long col = 0; col < self->max_cols; col++ ) {
+            Light light = Grid_at_in(grid, Light, layout, row, col);
 
             if( light == STUCK_ON || light == STUCK_OFF ) {
-                TWOD(new_grid, row, col, self->max_rows) = light;
+                Grid_at_in(new_grid, Light, layout, row, col) = light;
                 continue;
             }
-            
-            int num_on = Lights_num_neighbors(self, row, col, ON);
 
-            // A light which is on stays on when 2 or 3 neighbors are on, and turns off otherwise.
-            if( light ) {
-                switch( num_on ) {
-                    case 2:
-                    case 3:
-                        TWOD(new_grid, row, col, self->max_rows) = ON;
-                        break;
-                    default:
-                        TWOD(new_grid, row, col, self->max_rows) = OFF;
-                        break;
+            /* The halo is OFF, so the edges need no checks */
+            int num_on = 0;
+            for( int i = -1; i <= 1; i++ ) {
+                for( int j = -1; j <= 1; j++ ) {
+                    if( i == 0 && j == 0 )
+                        continue;
+                    num_on += light_is_on(Grid_at_in(grid, Light, layout, row + i, col + j));
                 }
             }
+
+            // A light which is on stays on when 2 or 3 neighbors are on, and turns off otherwise.
             // A light which is off turns on if exactly 3 neighbors are on, and stays off otherwise.
-            else {
-                if( num_on == 3 ) {
-                    TWOD(new_grid, row, col, self->max_rows) = ON;
-                }
-                else {
-                    TWOD(new_grid, row, col, self->max_rows) = OFF;
-                }
-            }
+            if( light )
+                Grid_at_in(new_grid, Light, layout, row, col) = (num_on == 2 || num_on == 3) ? ON : OFF;
+            else
+                Grid_at_in(new_grid, Light, layout, row, col) = num_on == 3 ? ON : OFF;
         }
     }
+}
+
+static void Lights_step_rows(long from, long to, void *_step) {
+    LightsStep *step = _step;
+
+    switch( step->new_grid->layout ) {
+        case GRID_ROWS:
+            Lights_step_rows_in(step, GRID_ROWS, from, to);
+            break;
+        case GRID_TILED:
+            Lights_step_rows_in(step, GRID_TILED, from, to);
+            break;
+        case GRID_MORTON:
+            Lights_step_rows_in(step, GRID_MORTON, from, to);
+            break;
+    }
+}
+
+/* Each row of the new grid only reads the old one, so the rows are
+   spread across the thread pool.  The two grids are swapped rather
+   than a new one made each step. */
+static void Lights_step(Lights *self) {
+    if( !self->next_grid ) {
+        self->next_grid = Lights_new_grid(self, self->grid->layout);
+        /* Its pages go near the threads which will write them */
+        Grid_touch(self->next_grid, LIGHTS_ROW_GRAIN);
+    }
+
+    LightsStep step = { .lights = self, .new_grid = self->next_grid };
+
+    pool_for(0, self->max_rows, LIGHTS_ROW_GRAIN, Lights_step_rows, &step);
 
-    free(self->grid);
-    self->grid = new_grid;
+    self->next_grid = self->grid;
+    self->grid = step.new_grid;
 }
 
 static void test_lights_step_stuck() {
@@ -467,21 +539,40 @@ static void runtests() {
     test_lights_step_stuck();
 }
 
+/* argv is the number of steps */
+int day18_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    if( argc < 1 )
+        die("How many steps?");
+
+    int steps = atoi(argv[0]);
+    phase_begin("parse");
+    Lights *lights = SolveContext_own(ctx, Lights_new_from_fp(input),
+                                      (GDestroyNotify)Lights_destroy);
+    phase_items(lights->max_rows * lights->max_cols);
+    phase_end("parse");
+
+    phase_begin("solve");
+    for( int i = 1; i <= steps; i++ ) {
+        Lights_step(lights);
+        TRACE_COUNTER("step", i);
+    }
+    int num_on = Lights_count(lights, ON);
+    phase_items((long)steps * lights->max_rows * lights->max_cols);
+    phase_end("solve");
+
+    SolveContext_printf(ctx, "%d\n", num_on);
+
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
+    common_options(&argc, argv);
+
     if( argc == 1 ) {
         runtests();
     }
     else if( argc == 3 ) {
-        int steps = atoi(argv[2]);
-        FILE *input = open_file(argv[1], "r");
-        Lights *lights = Lights_new_from_fp(100, 100, input);
-        for( int i = 1; i <= steps; i++ ) {
-            Lights_step(lights);
-        }
-
-        printf("%d\n", Lights_count(lights, ON));
-
-        Lights_destroy(lights);
+        return solve_main(day18_solve, argv[1], argc - 2, argv + 2);
     }
     else {
         char *desc[] = {argv[0], "<input file>", "<num steps>"};
@@ -1,151 +1,309 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <assert.h>
+#include <stdint.h>
 #include <string.h>
 #include "common.h"
+#include "phase.h"
+#include "cpu.h"
+#include "pool.h"
+#include "solve.h"
+#include <pthread.h>
 
 typedef struct {
-    int paper;
-    int ribbon;
+    int64_t paper;
+    int64_t ribbon;
+    long boxes;
+    /* A box with a side over BOX_MAX_SIDE was left out, an error once
+       the chunks are added up */
+    bool oversized;
 } Order;
 
-static Order *Order_create() {
-    Order *order = malloc(sizeof(Order));
+/* Boxes are parsed into columns this many at a time, then added up
+   across the columns */
+#define BOX_BATCH 1024
 
-    order->paper  = 0;
-    order->ribbon = 0;
+/* Each box is worked out in 32 bits, its volume must fit */
+#define BOX_MAX_SIDE 1290
 
-    return order;
-}
+/* The input is split between threads in chunks of this many bytes,
+   moved to the next line */
+#define BOX_CHUNK (1024 * 1024)
 
 typedef struct {
-    int sides[3];
-} Box;
+    int32_t height[BOX_BATCH];
+    int32_t width[BOX_BATCH];
+    int32_t length[BOX_BATCH];
+} BoxBatch;
 
-#define HEIGHT 0
-#define WIDTH  1
-#define LENGTH 2
+/* Adds the paper and ribbon for num boxes to the order */
+typedef void (*AddBoxesFunc)(const int32_t *height, const int32_t *width, const int32_t *length,
+                             int num, Order *order);
 
-static inline int min(const int x, const int y) {
-    return x < y ? x : y;
-}
+static AddBoxesFunc Add_Boxes = NULL;
+static pthread_once_t Add_Boxes_Once = PTHREAD_ONCE_INIT;
+
+/* The sides in order without branching, then
+
+       paper  = 2lw + 2wh + 2hl + the smallest side's area
+       ribbon = the smallest perimeter + the volume */
+static void add_boxes_generic(const int32_t *height, const int32_t *width, const int32_t *length,
+                              int num, Order *order)
+{
+    int64_t paper = 0;
+    int64_t ribbon = 0;
+
+    for( int i = 0; i < num; i++ ) {
+        int32_t h = height[i];
+        int32_t w = width[i];
+        int32_t l = length[i];
 
-static Box *Box_create(const int *dimensions) {
-    Box *box = malloc(sizeof(Box));
+        int32_t low   = MIN(h, w);
+        int32_t high  = MAX(h, w);
+        int32_t other = MIN(high, l);
+        int32_t small = MIN(low, other);
+        int32_t mid   = MAX(low, other);
 
-    for(int i = 0; i < 3; i++) {
-        box->sides[i] = dimensions[i];
+        int32_t lw = l * w;
+        paper  += 2 * (lw + w * h + h * l) + small * mid;
+        ribbon += 2 * (small + mid) + lw * h;
     }
 
-    return box;
+    order->paper  += paper;
+    order->ribbon += ribbon;
 }
 
-static int Box_volume(const Box *box) {
-    return box->sides[0] * box->sides[1] * box->sides[2];
-}
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
 
-static int cmpsides(const void *arg1, const void *arg2) {
-    const int a = *(const int*)arg1;
-    const int b = *(const int*)arg2;
+/* 8 boxes at a time, the totals widened to 64 bit lanes */
+__attribute__((target("avx2")))
+static void add_boxes_avx2(const int32_t *height, const int32_t *width, const int32_t *length,
+                           int num, Order *order)
+{
+    __m256i paper  = _mm256_setzero_si256();
+    __m256i ribbon = _mm256_setzero_si256();
+    int i = 0;
 
-    if( a < b ) {
-        return -1;
-    }
-    else if( a > b ) {
-        return 1;
-    }
-    else {
-        return 0;
+    for( ; i + 8 <= num; i += 8 ) {
+        __m256i h = _mm256_loadu_si256((const __m256i *)(height + i));
+        __m256i w = _mm256_loadu_si256((const __m256i *)(width  + i));
+        __m256i l = _mm256_loadu_si256((const __m256i *)(length + i));
+
+        __m256i low   = _mm256_min_epi32(h, w);
+        __m256i high  = _mm256_max_epi32(h, w);
+        __m256i other = _mm256_min_epi32(high, l);
+        __m256i small = _mm256_min_epi32(low, other);
+        __m256i mid   = _mm256_max_epi32(low, other);
+
+        __m256i lw = _mm256_mullo_epi32(l, w);
+        __m256i areas = _mm256_add_epi32(_mm256_add_epi32(lw, _mm256_mullo_epi32(w, h)),
+                                         _mm256_mullo_epi32(h, l));
+        __m256i box_paper  = _mm256_add_epi32(_mm256_slli_epi32(areas, 1),
+                                              _mm256_mullo_epi32(small, mid));
+        __m256i box_ribbon = _mm256_add_epi32(_mm256_slli_epi32(_mm256_add_epi32(small, mid), 1),
+                                              _mm256_mullo_epi32(lw, h));
+
+        paper  = _mm256_add_epi64(paper,  _mm256_cvtepi32_epi64(_mm256_castsi256_si128(box_paper)));
+        paper  = _mm256_add_epi64(paper,  _mm256_cvtepi32_epi64(_mm256_extracti128_si256(box_paper, 1)));
+        ribbon = _mm256_add_epi64(ribbon, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(box_ribbon)));
+        ribbon = _mm256_add_epi64(ribbon, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(box_ribbon, 1)));
     }
 
-    assert(0);
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, paper);
+    order->paper += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_storeu_si256((__m256i *)lanes, ribbon);
+    order->ribbon += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    add_boxes_generic(height + i, width + i, length + i, num - i, order);
 }
 
-static int Box_smallest_perimeter(const Box *box) {
-    int sides[3];
+/* 16 boxes at a time */
+__attribute__((target("avx512f")))
+static void add_boxes_avx512(const int32_t *height, const int32_t *width, const int32_t *length,
+                             int num, Order *order)
+{
+    __m512i paper  = _mm512_setzero_si512();
+    __m512i ribbon = _mm512_setzero_si512();
+    int i = 0;
+
+    for( ; i + 16 <= num; i += 16 ) {
+        __m512i h = _mm512_loadu_si512((const void *)(height + i));
+        __m512i w = _mm512_loadu_si512((const void *)(width  + i));
+        __m512i l = _mm512_loadu_si512((const void *)(length + i));
 
-    for(int i = 0; i < 3; i++) {
-        sides[i] = box->sides[i];
+        __m512i low   = _mm512_min_epi32(h, w);
+        __m512i high  = _mm512_max_epi32(h, w);
+        __m512i other = _mm512_min_epi32(high, l);
+        __m512i small = _mm512_min_epi32(low, other);
+        __m512i mid   = _mm512_max_epi32(low, other);
+
+        __m512i lw = _mm512_mullo_epi32(l, w);
+        __m512i areas = _mm512_add_epi32(_mm512_add_epi32(lw, _mm512_mullo_epi32(w, h)),
+                                         _mm512_mullo_epi32(h, l));
+        __m512i box_paper  = _mm512_add_epi32(_mm512_slli_epi32(areas, 1),
+                                              _mm512_mullo_epi32(small, mid));
+        __m512i box_ribbon = _mm512_add_epi32(_mm512_slli_epi32(_mm512_add_epi32(small, mid), 1),
+                                              _mm512_mullo_epi32(lw, h));
+
+        paper  = _mm512_add_epi64(paper,  _mm512_cvtepi32_epi64(_mm512_castsi512_si256(box_paper)));
+        paper  = _mm512_add_epi64(paper,  _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(box_paper, 1)));
+        ribbon = _mm512_add_epi64(ribbon, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(box_ribbon)));
+        ribbon = _mm512_add_epi64(ribbon, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(box_ribbon, 1)));
     }
 
-    qsort(sides, 3, sizeof(*sides), cmpsides);
+    order->paper  += _mm512_reduce_add_epi64(paper);
+    order->ribbon += _mm512_reduce_add_epi64(ribbon);
 
-    return sides[0] + sides[0] + sides[1] + sides[1];
+    add_boxes_avx2(height + i, width + i, length + i, num - i, order);
 }
+#endif
+
+static const CpuImpl Add_Boxes_Impls[] = {
+    CPU_IMPL(CPU_GENERIC, add_boxes_generic),
+#if defined(__x86_64__) || defined(__i386__)
+    CPU_IMPL(CPU_AVX2,    add_boxes_avx2),
+    CPU_IMPL(CPU_AVX512,  add_boxes_avx512),
+#endif
+    CPU_IMPL_END
+};
 
-static int Box_ribbon(const Box *box) {
-    return Box_smallest_perimeter(box) + Box_volume(box);
+static void resolve_add_boxes() {
+    Add_Boxes = (AddBoxesFunc)cpu_dispatch("day2 add_boxes", Add_Boxes_Impls);
 }
 
-static int Box_surface_area(const Box *box) {
-    return (2 * box->sides[LENGTH] * box->sides[WIDTH])  +
-           (2 * box->sides[WIDTH]  * box->sides[HEIGHT]) +
-           (2 * box->sides[HEIGHT] * box->sides[LENGTH]);
+/* Once for all threads, it's the same CPU */
+static void init_add_boxes() {
+    pthread_once(&Add_Boxes_Once, resolve_add_boxes);
 }
 
-static int Box_wrapping_paper_slack(const Box *box) {
-    return min(box->sides[LENGTH] * box->sides[WIDTH],
-               min(box->sides[WIDTH] * box->sides[HEIGHT],
-                   box->sides[HEIGHT] * box->sides[LENGTH]
-               )
-           );
+/* LxWxH lines straight into the columns, no copies and no atoi().
+   Blank lines are skipped and missing sides are 0.  Returns where it
+   stopped, which is the end or the start of the line which didn't fit.
+   It runs in pool threads, so a box which is too big is flagged in
+   order, not died on. */
+static const char *parse_boxes(const char *pos, const char *end, BoxBatch *boxes, int *num, Order *order) {
+    int n = 0;
+
+    while( pos < end && n < BOX_BATCH ) {
+        int32_t sides[3] = {0, 0, 0};
+        int side = 0;
+        bool any = false;
+
+        for( ; pos < end && *pos != '\n'; pos++ ) {
+            char c = *pos;
+
+            if( c >= '0' && c <= '9' ) {
+                if( side < 3 && sides[side] <= BOX_MAX_SIDE )
+                    sides[side] = sides[side] * 10 + (c - '0');
+                any = true;
+            }
+            else if( c == 'x' ) {
+                side++;
+            }
+        }
+        pos++;
+
+        if( !any )
+            continue;
+
+        if( sides[0] > BOX_MAX_SIDE || sides[1] > BOX_MAX_SIDE || sides[2] > BOX_MAX_SIDE ) {
+            order->oversized = true;
+            continue;
+        }
+
+        boxes->height[n] = sides[0];
+        boxes->width[n]  = sides[1];
+        boxes->length[n] = sides[2];
+        n++;
+    }
+
+    *num = n;
+
+    return MIN(pos, end);
 }
 
-static int Box_wrapping_paper(const Box *box) {
-    return Box_surface_area(box) + Box_wrapping_paper_slack(box);
+typedef struct {
+    const char *data;
+    size_t len;
+} BoxInput;
+
+/* A chunk is the lines which start in its bytes */
+static const char *line_start(const BoxInput *input, size_t offset) {
+    if( offset == 0 )
+        return input->data;
+    if( offset >= input->len )
+        return input->data + input->len;
+
+    const char *newline = memchr(input->data + offset - 1, '\n', input->len - offset + 1);
+    return newline ? newline + 1 : input->data + input->len;
 }
 
-static Box *parse_box_line(const char *orig_line) {
-    /* Copy the line, because strsep() is destructive
-     * strsep() will move line around, so hold onto a pointer to the
-     * original memory so we can free it */
-    char *tofree, *line;
-    tofree = line = strdup(orig_line);
-    assert(line != NULL);
-
-    int dimensions[3];
-    int idx = 0;
-    char *token;
-    while((token = strsep(&line, "x")) != NULL) {
-        dimensions[idx] = atoi(token);
-        idx++;
+static void add_chunks(long from, long to, void *_input, void *_order) {
+    const BoxInput *input = _input;
+    Order *order = _order;
+    BoxBatch boxes;
+
+    const char *pos = line_start(input, from * BOX_CHUNK);
+    const char *end = line_start(input, to * BOX_CHUNK);
+    while( pos < end ) {
+        int num;
+        pos = parse_boxes(pos, end, &boxes, &num, order);
+
+        Add_Boxes(boxes.height, boxes.width, boxes.length, num, order);
+        order->boxes += num;
     }
+}
 
-    free(tofree);
-    
-    return Box_create(dimensions);
+static void add_orders(void *_order, const void *_partial, void *data) {
+    Order *order = _order;
+    const Order *partial = _partial;
+
+    order->paper  += partial->paper;
+    order->ribbon += partial->ribbon;
+    order->boxes  += partial->boxes;
+    order->oversized |= partial->oversized;
 }
 
-static Order *read_box_sizes(FILE *fp) {
-    char *line = NULL;
-    size_t linecap = 0;
-    Box *box;
-    Order *order = Order_create();
-    
-    while(getline(&line, &linecap, fp) > 0) {
-        box = parse_box_line(line);
-        order->paper  += Box_wrapping_paper(box);
-        order->ribbon += Box_ribbon(box);
-        free(box);
-    }
-    free(line);
+/* Each thread parses and adds up its own chunks, the totals are sums
+   so it doesn't matter which */
+static Order read_box_sizes(const char *data, size_t len) {
+    Order order = { .paper = 0, .ribbon = 0, .boxes = 0, .oversized = false };
+    BoxInput input = { .data = data, .len = len };
+    long num_chunks = (len + BOX_CHUNK - 1) / BOX_CHUNK;
+
+    init_add_boxes();
+
+    pool_reduce(0, num_chunks, 1, add_chunks, add_orders, &order, sizeof(order), &input);
+    if( order.oversized )
+        die("A box side is over %d", BOX_MAX_SIDE);
+    phase_items(order.boxes);
 
     return order;
 }
 
-int main(const int argc, char **argv) {
+int day2_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    size_t len;
+    const char *buf = SolveContext_map(ctx, input, &len);
+
+    phase_begin("solve");
+    Order order = read_box_sizes(buf, len);
+    phase_end("solve");
+
+    SolveContext_printf(ctx, "The elves need %ld sqft of paper and %ld ft of ribbon.\n",
+                        (long)order.paper, (long)order.ribbon);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    common_options(&argc, argv);
+
     if( argc != 2 ) {
         char *desc[2] = {argv[0], "<inputfile>"};
         usage(2, desc);
         return -1;
     }
 
-    FILE *fp = open_file(argv[1], "r");
-
-    Order *order = read_box_sizes(fp);
-    printf("The elves need %d sqft of paper and %d ft of ribbon.\n", order->paper, order->ribbon);
-
-    free(order);
-    
-    return 0;
+    return solve_main(day2_solve, argv[1], argc - 2, argv + 2);
 }
@@ -1,39 +1,30 @@
 #include "common.h"
-#include <glib.h>
+#include "phase.h"
+#include "map.h"
+#include "solve.h"
 #include <stdio.h>
 #include <stdlib.h>
 
-static void free_key(gpointer data) {
-    free(data);
+static inline int64_t house_key(const int *pos) {
+    return pos[0] + (int64_t)pos[1] * 0xffffffffL;
 }
 
-static gint64 *house_key(const int *pos) {
-    gint64 *key = malloc(sizeof(gint64));
-
-    *key = pos[0];
-    *key += (gint64)pos[1] * 0xffffffffL;
-
-    return key;
-}
-
-static void deliver( GHashTable *houses, const int *pos ) {
-    gint64 *key = house_key(pos);
-
-    g_hash_table_add(houses, key);
+static void deliver( IntMap *houses, const int *pos ) {
+    IntMap_put(houses, house_key(pos), 0);
 }
 
-static GHashTable *deliver_to_houses( FILE *fp ) {
-    GHashTable *houses = g_hash_table_new_full(g_int64_hash, g_int64_equal, free_key, NULL);
+/* Santa and Robo-Santa take turns, every character is a turn */
+static IntMap *deliver_to_houses( const char *input, size_t len ) {
+    IntMap *houses = IntMap_new(0);
     int pos[2][2] = {{0,0}, {0,0}};
     int steps = 0;
     
     deliver(houses, pos[0]);
     
-    while( !feof(fp) ) {
+    for( size_t i = 0; i < len; i++ ) {
         short who = steps % 2;
         
-        char c = (char)fgetc(fp);
-        switch(c) {
+        switch(input[i]) {
             case '>':
                 pos[who][0]++;
                 deliver(houses, pos[who]);
@@ -53,24 +44,32 @@ static GHashTable *deliver_to_houses( FILE *fp ) {
         }
 
         steps++;
-    };
+    }
 
     return houses;
 }
 
-int main(const int argc, char **argv) {
+int day3_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    size_t len;
+    const char *buf = SolveContext_map(ctx, input, &len);
+
+    phase_begin("solve");
+    IntMap *houses = SolveContext_own(ctx, deliver_to_houses(buf, len), (GDestroyNotify)IntMap_destroy);
+    phase_end("solve");
+
+    SolveContext_printf(ctx, "%zu\n", IntMap_size(houses));
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    common_options(&argc, argv);
+
     if( argc != 2 ) {
         char *desc[2] = { argv[0], "<inputfile>" };
         usage(2, desc);
         return -1;
     }
 
-    FILE *fp = open_file(argv[1], "r");
-
-    GHashTable *houses = deliver_to_houses(fp);
-    printf("%u\n", g_hash_table_size(houses));
-
-    g_hash_table_destroy(houses);
-    
-    return 0;
+    return solve_main(day3_solve, argv[1], argc - 2, argv + 2);
 }
@@ -1,36 +1,85 @@
 #include "common.h"
+#include "phase.h"
+#include "pool.h"
+#include "solve.h"
 #include <glib.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
-int mine_adventcoins(char *start) {
+/* Numbers are tried in rounds of this many, spread across the pool */
+#define MINE_ROUND 1000000
+#define MINE_GRAIN 4096
+
+static void mine_adventcoins_range(long from, long to, void *_start, void *_found) {
+    char *start = _start;
+    long *found = _found;
     char key[20] = "";
 
-    for(int i = 0; i < INT_MAX; i++ ) {
-        char num[10];
-        sprintf(num, "%d", i);
-        
+    /* Only the lowest counts, anything past what's been found is moot */
+    for( long i = from; i < to && i < *found; i++ ) {
+        char num[12];
+        sprintf(num, "%ld", i);
+
         strlcpy(key, start, 20);
         strlcat(key, num, 20);
 
         char *md5sum = g_compute_checksum_for_string(G_CHECKSUM_MD5, key, -1);
-        if( strncmp(md5sum, "000000", 6) == 0 )
-            return i;
+        bool is_coin = strncmp(md5sum, "000000", 6) == 0;
+        g_free(md5sum);
+
+        if( is_coin ) {
+            *found = i;
+            return;
+        }
+    }
+}
+
+static void mine_adventcoins_min(void *_found, const void *_partial, void *data) {
+    long *found = _found;
+    const long *partial = _partial;
+
+    *found = MIN(*found, *partial);
+}
+
+static int mine_adventcoins(char *start) {
+    for( long round = 0; round < INT_MAX; round += MINE_ROUND ) {
+        long found = LONG_MAX;
+        pool_reduce(round, MIN(round + MINE_ROUND, (long)INT_MAX), MINE_GRAIN,
+                    mine_adventcoins_range, mine_adventcoins_min,
+                    &found, sizeof(found), start);
+
+        if( found != LONG_MAX )
+            return found;
     }
 
     return -1;
 }
 
-int main(const int argc, char **argv) {
+/* The input is the secret key */
+int day4_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    size_t len;
+    const char *word = SolveContext_map(ctx, input, &len);
+    char *key = SolveContext_strndup(ctx, word, len);
+
+    phase_begin("solve");
+    int coin = mine_adventcoins(key);
+    phase_end("solve");
+
+    SolveContext_printf(ctx, "%d\n", coin);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    common_options(&argc, argv);
+
     if( argc != 2 ) {
         char *argv_desc[2] = { argv[0], "<secret key>" };
         usage(2, argv_desc);
         return -1;
     }
 
-    int coin = mine_adventcoins(argv[1]);
-    printf("%d\n", coin);
-    
-    return 0;
+    return solve_main_string(day4_solve, argv[1], argc - 2, argv + 2);
 }
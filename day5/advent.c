@@ -1,61 +1,82 @@
 #include "common.h"
+#include "phase.h"
+#include "pipeline.h"
+#include "solve.h"
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
 #include <glib.h>
 
-GError *ReError;
-GRegex *ReRepeat;
-GRegex *RePair;
+typedef struct {
+    GRegex *repeat;
+    GRegex *pair;
+    int num_nice;
+} NiceCount;
 
-static void init_regexes() {
-    RePair = g_regex_new("(.).\\1", G_REGEX_OPTIMIZE, 0, &ReError);
-    ReRepeat = g_regex_new("((.)[^\\2]).*\\1", G_REGEX_OPTIMIZE, 0, &ReError);
-}
-
-static bool is_nice(char *string) {
+static bool is_nice(NiceCount *count, char *string) {
     /* It contains at least one letter which repeats with exactly one letter
        between them, like xyx, abcdefeghi (efe), or even aaa. */
-    if( !g_regex_match(ReRepeat, string, 0, NULL ) )
+    if( !g_regex_match(count->repeat, string, 0, NULL ) )
         return false;
 
     /* It contains a pair of any two letters that appears at least twice in
        the string without overlapping, like xyxy (xy) or aabcdefgaa (aa), but
        not like aaa (aa, but it overlaps). */
-    if( !g_regex_match(RePair, string, 0, NULL ) )
+    if( !g_regex_match(count->pair, string, 0, NULL ) )
         return false;
     
     return true;
 }
 
-static int count_nice( FILE *fp ) {
-    char *line = NULL;
-    size_t line_len = 0;
-    int num_nice = 0;
-    
-    while( getline(&line, &line_len, fp) > 0 ) {
-        if( is_nice(line) )
-            num_nice++;
-    }
-    free(line);
+/* The regexes are the slow part, they run in the parse stage.  It
+   only reads them, the fold only changes num_nice. */
+static bool check_line(char *line, void *nice, void *count) {
+    *(bool *)nice = is_nice(count, line);
+    return true;
+}
+
+static void count_line(void *nice, void *count) {
+    if( *(bool *)nice )
+        ((NiceCount *)count)->num_nice++;
+}
+
+static int count_nice( SolveContext *ctx, FILE *fp ) {
+    NiceCount count = {
+        .pair     = SolveContext_regex(ctx, "(.).\\1", G_REGEX_OPTIMIZE),
+        .repeat   = SolveContext_regex(ctx, "((.)[^\\2]).*\\1", G_REGEX_OPTIMIZE),
+        .num_nice = 0
+    };
+    Pipeline pipeline = {
+        .record_size = sizeof(bool),
+        .parse       = check_line,
+        .fold        = count_line,
+        .data        = &count
+    };
+
+    phase_items(pipeline_run(&pipeline, fp));
 
-    return num_nice;
+    return count.num_nice;
 }
 
-int main(const int argc, char **argv) {
+int day5_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    phase_begin("solve");
+    int num_nice = count_nice(ctx, input);
+    phase_end("solve");
+
+    SolveContext_printf(ctx, "%d\n", num_nice);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    common_options(&argc, argv);
+
     if( argc != 2 ) {
         char *argv_desc[2] = {argv[1], "<input file>"};
         usage(2, argv_desc);
         return -1;
     }
 
-    FILE *fp = open_file(argv[1], "r");
-
-    init_regexes();
-    
-    int num_nice = count_nice(fp);
-    printf("%d\n", num_nice);
-
-    return 0;
+    return solve_main(day5_solve, argv[1], argc - 2, argv + 2);
 }
@@ -4,12 +4,14 @@
     #include "advent.y.h"
     #include "advent.l.h"
     #include "common.h"
+    #include "phase.h"
+    #include "grid.h"
 
     #define MAX_LIGHTS 1000
 
-    int *Lights;
+    Grid *Lights;
 
-    void change_lights(int *lights, const char *command, int where[2][2]);
+    void change_lights(Grid *lights, const char *command, int where[2][2]);
     void yyerror (YYLTYPE *loc, char const *msg);
 %}
 
@@ -60,11 +62,10 @@ void yyerror (YYLTYPE *loc, char const *msg) {
     );
 }
 
-static inline int light_key(int row, int col) {
-    return row + col * MAX_LIGHTS;
-}
+/* The lights are changed a row at a time, so they're stored that way */
+#define LIGHTS_LAYOUT GRID_ROWS
 
-static void dim_lights(int *lights, int where[2][2], int dim) {
+static void dim_lights(Grid *lights, int where[2][2], int dim) {
     int *from = where[0];
     int *to   = where[1]; 
     
@@ -73,15 +74,15 @@ static void dim_lights(int *lights, int where[2][2], int dim) {
 
     for( row = from[0]; row <= to[0]; row++ ) {
         for( col = from[1]; col <= to[1]; col++ ) {
-            int key = light_key(row, col);
-            lights[key] += dim;
-            if( lights[key] < 0 )
-                lights[key] = 0;
+            int *light = &Grid_at_in(lights, int, LIGHTS_LAYOUT, row, col);
+            *light += dim;
+            if( *light < 0 )
+                *light = 0;
         }
     }
 }
 
-void change_lights(int *lights, const char *command, int where[2][2]) {
+void change_lights(Grid *lights, const char *command, int where[2][2]) {
     if( strcmp(command, "turn on") == 0 ) {
         dim_lights(lights, where, +1);
     }
@@ -96,28 +97,30 @@ void change_lights(int *lights, const char *command, int where[2][2]) {
     }
 }
 
-static int light_brightness(int *lights) {
+static int light_brightness(Grid *lights) {
     int brightness = 0;
     
     for(int row = 0; row < MAX_LIGHTS; row++) {
         for(int col = 0; col < MAX_LIGHTS; col++) {
-            int key = light_key(row, col);
-            brightness += lights[key];
+            brightness += Grid_at_in(lights, int, LIGHTS_LAYOUT, row, col);
         }
     }
 
     return brightness;
 }
 
-static void init_lights(int **lights) {
-    *lights = calloc(1, sizeof(int) * MAX_LIGHTS * MAX_LIGHTS);
+/* 4MB walked over and over, it goes on huge pages, see grid.h */
+static void init_lights(Grid **lights) {
+    *lights = Grid_new(MAX_LIGHTS, MAX_LIGHTS, sizeof(int), LIGHTS_LAYOUT, 0);
 }
 
-static void free_lights(int *lights) {
-    free(lights);
+static void free_lights(Grid *lights) {
+    Grid_destroy(lights);
 }
 
 int main(int argc, char **argv) {
+    common_options(&argc, argv);
+
     FILE *input = stdin;
 
     if( argc > 2 ) {
@@ -132,12 +135,15 @@ int main(int argc, char **argv) {
 
     init_lights(&Lights);
     
+    phase_begin("solve");
     yyin = input;
     do {
         yyparse();
     } while(!feof(yyin));
+    int brightness = light_brightness(Lights);
+    phase_end("solve");
 
-    printf("%d\n", light_brightness(Lights));
+    printf("%d\n", brightness);
 
     free_lights(Lights);
 }
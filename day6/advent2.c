@@ -3,6 +3,7 @@
 #include <string.h>
 #include <stdint.h>
 #include "common.h"
+#include "bigbuf.h"
 #include <glib.h>
 
 #define MAX_LIGHTS 1000
@@ -92,8 +93,9 @@ static void read_lights(FILE *fp, int16_t lights[MAX_LIGHTS][MAX_LIGHTS]) {
 
 int main(int argc, char **argv) {
     FILE *input = stdin;
-    int16_t lights[MAX_LIGHTS][MAX_LIGHTS] = {{0}};
-    
+    /* 2MB is a lot of stack, and it's walked over and over */
+    int16_t (*lights)[MAX_LIGHTS] = bigbuf_new(sizeof(int16_t) * MAX_LIGHTS * MAX_LIGHTS);
+
     if( argv[1] ) {
         input = open_file(argv[1], "r");
     }
@@ -101,5 +103,7 @@ int main(int argc, char **argv) {
     read_lights(input, lights);
     printf("%d\n", light_brightness(lights));
 
+    bigbuf_free(lights, sizeof(int16_t) * MAX_LIGHTS * MAX_LIGHTS);
+
     return 0;
 }
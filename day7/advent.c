@@ -7,30 +7,26 @@
 #include <ctype.h>
 #include <stdint.h>
 #include "gate.h"
-
-GRegex *Gate_Line_Re;
-
-static void init_regexes() {
-    if( !Gate_Line_Re ) {
-        Gate_Line_Re = compile_regex(
-            " ^ \\s* "
-            " (?: "
-            "   (?:(?:(?<LEFT>[[:alnum:]]+) \\s+ )? (?<OP>[[:alpha:]]+) \\s+ )? (?<RIGHT>[[:alnum:]]+) "
-            " ) "
-            " \\s* -> \\s* "
-            " (?<NAME>[[:alpha:]]+) "
-            " \\s* $ ",
-            G_REGEX_OPTIMIZE | G_REGEX_EXTENDED,
-            0
-        );
-    }
-}
-
-static void free_regexes() {
-    g_regex_unref(Gate_Line_Re);
+#include "trace.h"
+#include "phase.h"
+#include "map.h"
+#include "solve.h"
+
+/* Kept by the context, see solve.h */
+static GRegex *gate_line_regex(SolveContext *ctx) {
+    return SolveContext_regex(ctx,
+        " ^ \\s* "
+        " (?: "
+        "   (?:(?:(?<LEFT>[[:alnum:]]+) \\s+ )? (?<OP>[[:alpha:]]+) \\s+ )? (?<RIGHT>[[:alnum:]]+) "
+        " ) "
+        " \\s* -> \\s* "
+        " (?<NAME>[[:alpha:]]+) "
+        " \\s* $ ",
+        G_REGEX_OPTIMIZE | G_REGEX_EXTENDED
+    );
 }
 
-static void destroy_gate(gpointer _gate) {
+static void destroy_gate(void *_gate) {
     Gate *gate = (Gate *)_gate;
     __(gate, destroy);
 }
@@ -38,14 +34,7 @@ static void destroy_gate(gpointer _gate) {
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-function"
 
-static gint cmp_keys(gconstpointer _a, gconstpointer _b) {
-    char *a = (char *)_a;
-    char *b = (char *)_b;
-
-    return strcmp(a, b);
-}
-
-static void print_gate_cb(gpointer key, gpointer val, gpointer user_data) {
+static void print_gate_cb(const char *key, void *val, void *user_data) {
     Gate *gate = (Gate *)val;
     GateOp *op = gate->proto->op;
 
@@ -61,27 +50,22 @@ static void print_gate_cb(gpointer key, gpointer val, gpointer user_data) {
     puts("");
 }
 
-static void reset_gate_cache(gpointer key, gpointer val, gpointer unused) {
+static void reset_gate_cache(const char *key, void *val, void *unused) {
     Gate *gate = (Gate *)val;
 
     __(gate, clear_cache);
 }
 
-static void gates_foreach_sorted(GHashTable *gates, GHFunc cb) {
-    GList *sorted_keys = g_list_sort(g_hash_table_get_keys( gates ), cmp_keys);
-    for (GList *k = sorted_keys; k != NULL; k = k->next) {
-        cb( k->data, g_hash_table_lookup( gates, k->data ), NULL );
-    }
+static void gates_foreach_sorted(StrMap *gates, StrMapFunc cb) {
+    StrMap_foreach_sorted(gates, cb, NULL);
 }
 
 #pragma clang diagnostic pop
 
 static inline char *get_match(GMatchInfo *match, char *key) {
     char *val = g_match_info_fetch_named(match, key);
-    if( !val ) {
-        fprintf(stderr, "%s not found in %s\n", key, g_match_info_get_string(match));
-        exit(1);
-    }
+    if( !val )
+        die("%s not found in %s", key, g_match_info_get_string(match));
 
     return val;
 }
@@ -99,7 +83,7 @@ static bool is_number(char *key) {
     return true;
 }
 
-static Gate *read_gate_line(char *line, char **inputs) {
+static Gate *read_gate_line(GRegex *line_re, char *line, char **inputs) {
     GMatchInfo *match;
 
     if( is_blank(line) ) {
@@ -108,7 +92,7 @@ static Gate *read_gate_line(char *line, char **inputs) {
         return NULL;
     }
     
-    if( !g_regex_match(Gate_Line_Re, line, 0, &match) ) {
+    if( !g_regex_match(line_re, line, 0, &match) ) {
         fprintf(stderr, "Cannot understand %s.\n", line);
         return NULL;
     }
@@ -144,8 +128,8 @@ static Gate *read_gate_line(char *line, char **inputs) {
     return gate;
 }
 
-static Gate *make_input_gate(GHashTable *gates, char *var) {
-    Gate *gate = g_hash_table_lookup(gates, var);
+static Gate *make_input_gate(StrMap *gates, char *var) {
+    Gate *gate = StrMap_get(gates, var);
     if( gate )
         return gate;
     
@@ -157,7 +141,7 @@ static Gate *make_input_gate(GHashTable *gates, char *var) {
         gate = Gate_factory(&Op_Undef, var);
     }
 
-    g_hash_table_insert(gates, gate->name, gate);
+    StrMap_put(gates, gate->name, gate);
 
     return gate;
 }
@@ -167,7 +151,7 @@ static inline void change_gate_to_const(Gate *gate, GateVal val) {
     __(gate, set_cache, val);
 }
 
-static void set_gate_inputs(GHashTable *gates, Gate *gate, char **inputs) {
+static void set_gate_inputs(StrMap *gates, Gate *gate, char **inputs) {
     GateOpType optype = gate->proto->op->type;
 
     /* Turn 123 -> a into a CONST op */
@@ -184,17 +168,17 @@ static void set_gate_inputs(GHashTable *gates, Gate *gate, char **inputs) {
     }
 }
 
-static Gate *check_gate_cache(GHashTable *gates, Gate *gate) {
-    Gate *cached_gate = g_hash_table_lookup(gates, gate->name);
+static Gate *check_gate_cache(SolveContext *ctx, StrMap *gates, Gate *gate) {
+    Gate *cached_gate = StrMap_get(gates, gate->name);
 
     /* It's not cached, cache it */
     if( !cached_gate ) {
-        g_hash_table_insert(gates, gate->name, gate);
+        StrMap_put(gates, gate->name, gate);
         return gate;
     }
 
     if( cached_gate->proto->op->type != UNDEF ) {
-        printf("Redefining gate %s\n", gate->name);
+        SolveContext_printf(ctx, "Redefining gate %s\n", gate->name);
     }
     
     __(cached_gate, set_op, gate->proto->op);
@@ -203,72 +187,101 @@ static Gate *check_gate_cache(GHashTable *gates, Gate *gate) {
     return cached_gate;
 }
 
-static GHashTable *read_circuit(FILE *fp) {
-    char *line = NULL;
-    size_t line_size = 0;
-    char **inputs = calloc(2, sizeof(char *));
-    GHashTable *gates = g_hash_table_new_full(
-        g_str_hash,
-        g_str_equal,
-        NULL,
-        destroy_gate
-    );
+typedef struct {
+    SolveContext *ctx;
+    GRegex *line_re;
+    StrMap *gates;
+    char **inputs;
+} CircuitReader;
 
-    init_regexes();
-    
-    while( getline(&line, &line_size, fp) > 0 ) {
-        Gate *gate = read_gate_line(line, inputs);
-        if( !gate ) {
-            printf("Unknown line: %s", line);
-        }
-        else {
-            gate = check_gate_cache(gates, gate);
-            set_gate_inputs(gates, gate, inputs);
+static void read_circuit_line(char *line, void *_reader) {
+    CircuitReader *reader = _reader;
+    char **inputs = reader->inputs;
 
-            free(inputs[0]);
-            free(inputs[1]);
-        }
+    Gate *gate = read_gate_line(reader->line_re, line, inputs);
+    if( !gate ) {
+        SolveContext_printf(reader->ctx, "Unknown line: %s", line);
+        return;
     }
-    free(line);
-    free(inputs);
-    
-    free_regexes();
-    
-    return gates;
+
+    gate = check_gate_cache(reader->ctx, reader->gates, gate);
+    set_gate_inputs(reader->gates, gate, inputs);
+
+    free(inputs[0]);
+    free(inputs[1]);
 }
 
-int main(const int argc, char **argv) {
-    FILE *input = stdin;
+static void destroy_gates(void *gates) {
+    StrMap_destroy(gates, destroy_gate);
+}
 
-    if( argc > 4 ) {
-        char *argv_desc[4] = {argv[0], "<circuit file>", "<var>", "<override>"};
-        usage(4, argv_desc);
-        exit(1);
-    }
+static StrMap *read_circuit(SolveContext *ctx, FILE *fp) {
+    CircuitReader reader = {
+        .ctx     = ctx,
+        .line_re = gate_line_regex(ctx),
+        .inputs  = SolveContext_alloc(ctx, 2 * sizeof(char *)),
+        /* Keyed by each gate's own name, freed with the gate */
+        .gates   = SolveContext_own(ctx, StrMap_new(0), destroy_gates)
+    };
+
+    foreach_line(fp, read_circuit_line, &reader);
 
-    if( argc >= 2 )
-        input = open_file(argv[1], "r");
+    return reader.gates;
+}
 
-    GHashTable *gates = read_circuit(input);
+/* argv is the wire to read and, optionally, the wire to override with
+   its signal before reading it again */
+int day7_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    phase_begin("parse");
+    StrMap *gates = read_circuit(ctx, input);
+    TRACE_COUNTER("gates", StrMap_size(gates));
+    phase_items(StrMap_size(gates));
+    phase_end("parse");
     //gates_foreach_sorted(gates, print_gate_cb);
 
-    if( argc >= 3 ) {
-        char *var = argv[2];
-        Gate *gate = g_hash_table_lookup(gates, var);
+    if( argc >= 1 ) {
+        char *var = argv[0];
+        Gate *gate = StrMap_get(gates, var);
+        if( !gate )
+            die("There is no wire %s", var);
+
+        phase_begin("solve");
         GateVal signal = Gate_get(gate);
-        printf("%s == %d\n", var, signal);
+        phase_end("solve");
+
+        SolveContext_printf(ctx, "%s == %d\n", var, signal);
+
+        if( argc >= 2 ) {
+            char *override_var = argv[1];
+            Gate *override = StrMap_get(gates, override_var);
+            if( !override )
+                die("There is no wire %s", override_var);
 
-        if( argc >= 4 ) {
-            char *override_var = argv[3];
-            Gate *override = g_hash_table_lookup(gates, override_var);
-            g_hash_table_foreach(gates, reset_gate_cache, 0);
+            phase_begin("solve override");
+            StrMap_foreach(gates, reset_gate_cache, NULL);
             change_gate_to_const(override, signal);
-            printf("Overrode %s with %d\n", override_var, signal);
-            printf("%s == %d\n", var, Gate_get(gate));
+            GateVal new_signal = Gate_get(gate);
+            phase_end("solve override");
+
+            SolveContext_printf(ctx, "Overrode %s with %d\n", override_var, signal);
+            SolveContext_printf(ctx, "%s == %d\n", var, new_signal);
         }
     }
 
-    g_hash_table_destroy(gates);
-
     return 0;
 }
+
+int main(int argc, char **argv) {
+    common_options(&argc, argv);
+
+    if( argc > 4 ) {
+        char *argv_desc[4] = {argv[0], "<circuit file>", "<var>", "<override>"};
+        usage(4, argv_desc);
+        exit(1);
+    }
+
+    if( argc < 2 )
+        return solve_main(day7_solve, NULL, 0, NULL);
+
+    return solve_main(day7_solve, argv[1], argc - 2, argv + 2);
+}
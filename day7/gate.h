@@ -18,14 +18,14 @@ typedef struct GateOp {
     char *name;
 } GateOp;
 
-GateOp Op_Undef;
-GateOp Op_Const;
-GateOp Op_Set;
-GateOp Op_Not;
-GateOp Op_And;
-GateOp Op_Or;
-GateOp Op_LShift;
-GateOp Op_RShift;
+extern GateOp Op_Undef;
+extern GateOp Op_Const;
+extern GateOp Op_Set;
+extern GateOp Op_Not;
+extern GateOp Op_And;
+extern GateOp Op_Or;
+extern GateOp Op_LShift;
+extern GateOp Op_RShift;
 
 GateOp *Op_lookup(char *_opname);
 
@@ -47,7 +47,7 @@ struct GateProto {
     void (*set_op)(Gate *self, GateOp *op);
     void (*set_cache)(Gate *self, GateVal value);
     void (*clear_cache)(Gate *self);
-} GateProto;
+};
 
 Gate *Gate_factory(GateOp *op, char *name);
 GateVal Gate_get(Gate *self);
@@ -1,4 +1,8 @@
 #include "common.h"
+#include "phase.h"
+#include "cpu.h"
+#include "solve.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -8,11 +12,97 @@ typedef struct {
     int encoding_size;
 } StringInfo;
 
+/* How many bytes from the start are plain characters, which count once
+   in each size.  Anything else goes through the switch below. */
+typedef size_t (*PlainRunFunc)(const char *str, size_t len);
+
+static PlainRunFunc Plain_Run = NULL;
+static pthread_once_t Plain_Run_Once = PTHREAD_ONCE_INIT;
+
+static inline bool is_plain(char c) {
+    return c != '\\' && c != '"' && c != '\n' && c != ' ';
+}
+
+static size_t plain_run_generic(const char *str, size_t len) {
+    size_t run = 0;
+
+    while( run < len && is_plain(str[run]) )
+        run++;
+
+    return run;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/* A bit set for each byte of the block which isn't plain */
+#define SPECIAL_MASK(set1, cmpeq, or, movemask, block) \
+    movemask(or(or(cmpeq(block, set1('\\')), cmpeq(block, set1('"'))), \
+                or(cmpeq(block, set1('\n')),  cmpeq(block, set1(' ')))))
+
+__attribute__((target("sse4.2")))
+static size_t plain_run_sse42(const char *str, size_t len) {
+    size_t run = 0;
+
+    for( ; run + 16 <= len; run += 16 ) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(str + run));
+        unsigned mask = SPECIAL_MASK(_mm_set1_epi8, _mm_cmpeq_epi8, _mm_or_si128,
+                                     _mm_movemask_epi8, block);
+        if( mask )
+            return run + __builtin_ctz(mask);
+    }
+
+    return run + plain_run_generic(str + run, len - run);
+}
+
+__attribute__((target("avx2")))
+static size_t plain_run_avx2(const char *str, size_t len) {
+    size_t run = 0;
+
+    for( ; run + 32 <= len; run += 32 ) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(str + run));
+        unsigned mask = SPECIAL_MASK(_mm256_set1_epi8, _mm256_cmpeq_epi8, _mm256_or_si256,
+                                     _mm256_movemask_epi8, block);
+        if( mask )
+            return run + __builtin_ctz(mask);
+    }
+
+    return run + plain_run_sse42(str + run, len - run);
+}
+#endif
+
+static const CpuImpl Plain_Run_Impls[] = {
+    CPU_IMPL(CPU_GENERIC, plain_run_generic),
+#if defined(__x86_64__) || defined(__i386__)
+    CPU_IMPL(CPU_SSE42,   plain_run_sse42),
+    CPU_IMPL(CPU_AVX2,    plain_run_avx2),
+#endif
+    CPU_IMPL_END
+};
+
+static void resolve_plain_run() {
+    Plain_Run = (PlainRunFunc)cpu_dispatch("day8 plain_run", Plain_Run_Impls);
+}
+
+/* Once for all threads, it's the same CPU */
+static void init_plain_run() {
+    pthread_once(&Plain_Run_Once, resolve_plain_run);
+}
+
 static void string_info(char *line, void *_info) {
     StringInfo *info = (StringInfo *)_info;
     StringInfo lineinfo = { .string_size = 0, .mem_size = 0, .encoding_size = 2 };
+    const char *end = line + strlen(line);
+
+    for( const char *pos = line; pos < end; pos++ ) {
+        size_t run = Plain_Run(pos, end - pos);
+        lineinfo.string_size   += run;
+        lineinfo.mem_size      += run;
+        lineinfo.encoding_size += run;
+        pos += run;
+        if( pos >= end )
+            break;
 
-    for( const char *pos = line; *pos; pos++ ) {
         switch(pos[0]) {
             case '\\':
                 lineinfo.string_size++;
@@ -54,27 +144,32 @@ static void string_info(char *line, void *_info) {
 
 static StringInfo read_strings(FILE *input) {
     StringInfo info = { .string_size = 0, .mem_size = 0 };
+
+    init_plain_run();
     
     foreach_line(input, string_info, &info);
     
     return info;
 }
 
+int day8_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    phase_begin("solve");
+    StringInfo info = read_strings(input);
+    phase_end("solve");
+
+    SolveContext_printf(ctx, "%d - %d = %d\n", info.string_size, info.mem_size, info.string_size - info.mem_size);
+    SolveContext_printf(ctx, "%d - %d = %d\n", info.encoding_size, info.string_size, info.encoding_size - info.string_size);
+
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
-    FILE *input = stdin;
-    
+    common_options(&argc, argv);
+
     if( argc > 2 ) {
         char *desc[2] = {argv[0], "<inputfile>"};
         usage(2, desc);
     }
 
-    if( argc >= 2 ) {
-        input = open_file(argv[1], "r");
-    }
-
-    StringInfo info = read_strings(input);
-    printf("%d - %d = %d\n", info.string_size, info.mem_size, info.string_size - info.mem_size);
-    printf("%d - %d = %d\n", info.encoding_size, info.string_size, info.encoding_size - info.string_size);
-    
-    return 0;
+    return solve_main(day8_solve, argc >= 2 ? argv[1] : NULL, 0, NULL);
 }
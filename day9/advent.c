@@ -5,29 +5,31 @@
 #include <math.h>
 #include <assert.h>
 #include "graph.h"
+#include "trace.h"
+#include "phase.h"
+#include "solve.h"
 
-GRegex *Line_Re;
-
-static void init_regexes() {
-    if( !Line_Re )
-        Line_Re = compile_regex(
-            "^ \\s* "
-            "  (?<FROM>[[:alpha:]]+) \\s+ to \\s+ (?<TO>[[:alpha:]]+) \\s* = \\s* (?<COST>\\d+) "
-            "\\s* $ ",
-            G_REGEX_OPTIMIZE | G_REGEX_EXTENDED,
-            0
-        );
+/* Kept by the context, see solve.h */
+static GRegex *line_regex(SolveContext *ctx) {
+    return SolveContext_regex(ctx,
+        "^ \\s* "
+        "  (?<FROM>[[:alpha:]]+) \\s+ to \\s+ (?<TO>[[:alpha:]]+) \\s* = \\s* (?<COST>\\d+) "
+        "\\s* $ ",
+        G_REGEX_OPTIMIZE | G_REGEX_EXTENDED
+    );
 }
 
-static void free_regexes() {
-    g_regex_unref(Line_Re);
-}
+typedef struct {
+    GRegex *line_re;
+    Graph *graph;
+} GraphReader;
 
-static void read_node(char *line, void *_graph) {
-    Graph *graph = (Graph *)_graph;
+static void read_node(char *line, void *_reader) {
+    GraphReader *reader = _reader;
+    Graph *graph = reader->graph;
     GMatchInfo *match;
     
-    if( g_regex_match(Line_Re, line, 0, &match) ) {
+    if( g_regex_match(reader->line_re, line, 0, &match) ) {
         char *from              = g_match_info_fetch_named(match, "FROM");
         char *to                = g_match_info_fetch_named(match, "TO");
         char *cost_str          = g_match_info_fetch_named(match, "COST");
@@ -47,33 +49,38 @@ static void read_node(char *line, void *_graph) {
     }
 }
 
-static Graph *read_graph(FILE *input) {
-    Graph *graph = Graph_new(20);
+static Graph *read_graph(SolveContext *ctx, FILE *input) {
+    GraphReader reader = {
+        .line_re = line_regex(ctx),
+        .graph   = SolveContext_own(ctx, Graph_new(20), (GDestroyNotify)Graph_destroy)
+    };
 
-    init_regexes();
+    foreach_line(input, read_node, &reader);
 
-    foreach_line(input, read_node, graph);
-
-    free_regexes();
-    
-    return graph;
+    return reader.graph;
 }
 
-int main(int argc, char **argv) {
-    FILE *input = stdin;
-
-    if( argc >= 2 ) {
-        input = open_file(argv[1], "r");
-    }
+int day9_solve(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    phase_begin("parse");
+    Graph *graph = read_graph(ctx, input);
+    TRACE_COUNTER("nodes", graph->num_nodes);
+    phase_items(graph->num_nodes);
+    phase_end("parse");
 
-    Graph *graph = read_graph(input);
+    phase_begin("solve");
+    GraphCost cost = Graph_shortest_route_cost(graph, false);
+    phase_end("solve");
 
-    printf("%.0f\n", Graph_shortest_route_cost(graph, false));
+    SolveContext_printf(ctx, "%.0f\n", cost);
     
     if( DEBUG )
         Graph_print(graph);
-    
-    Graph_destroy(graph);
-    
+
     return 0;
 }
+
+int main(int argc, char **argv) {
+    common_options(&argc, argv);
+
+    return solve_main(day9_solve, argc >= 2 ? argv[1] : NULL, 0, NULL);
+}
@@ -0,0 +1,469 @@
+/* dl_iterate_phdr() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "common.h"
+#include "alloc.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+
+bool Alloc_Tracking = false;
+
+static atomic_uint_fast64_t Alloc_Count = 0;
+static atomic_uint_fast64_t Free_Count  = 0;
+static atomic_uint_fast64_t Alloc_Bytes = 0;
+static atomic_int_fast64_t  Alloc_Live  = 0;
+static atomic_int_fast64_t  Alloc_Peak  = 0;
+
+#ifdef __GLIBC__
+
+#include <malloc.h>
+#include <execinfo.h>
+#include <link.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void  __libc_free(void *ptr);
+
+/* Must be a power of 2.  Sites past this many go uncounted. */
+#define ALLOC_SITES         4096
+#define ALLOC_MAX_FRAMES    16
+#define ALLOC_REPORT_SITES  20
+
+typedef struct {
+    _Atomic uintptr_t addr;
+    atomic_uint_fast64_t allocs;
+    atomic_uint_fast64_t bytes;
+} AllocSite;
+
+/* Static, allocating in here would recurse */
+static AllocSite Alloc_Sites[ALLOC_SITES];
+
+/* Where the program's own code is loaded */
+static uintptr_t Exe_Start = 0;
+static uintptr_t Exe_End   = 0;
+static uintptr_t Exe_Bias  = 0;
+
+/* backtrace() can allocate, don't count ourselves */
+static _Thread_local bool In_Alloc_Hook = false;
+
+/* The blocks allocated while tracking.  Only their frees are counted,
+   a block from before tracking started, or from an allocator which
+   isn't wrapped, would take live bytes below zero.
+
+   An open addressed set with linear probing, under one lock, which is
+   fine for a debugging option.  It lives in mmap()ed memory, malloc()
+   would recurse.  Grown to keep it at most half full. */
+static pthread_mutex_t Tracked_Lock = PTHREAD_MUTEX_INITIALIZER;
+static uintptr_t *Tracked = NULL;
+static size_t Tracked_Slots = 0;
+static size_t Tracked_Count = 0;
+
+#define TRACKED_MIN_SLOTS (64 * 1024)
+
+static inline size_t tracked_slot(uintptr_t addr, size_t slots) {
+    return ((addr >> 4) * 0x9E3779B97F4A7C15ULL) & (slots - 1);
+}
+
+static void tracked_put(uintptr_t *table, size_t slots, uintptr_t addr) {
+    size_t i = tracked_slot(addr, slots);
+    while( table[i] != 0 && table[i] != addr )
+        i = (i + 1) & (slots - 1);
+    table[i] = addr;
+}
+
+static void tracked_grow() {
+    size_t slots = Tracked_Slots ? Tracked_Slots * 2 : TRACKED_MIN_SLOTS;
+    uintptr_t *table = mmap(NULL, slots * sizeof(uintptr_t), PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if( table == MAP_FAILED )
+        die("Could not grow the allocation tracking table: %s", strerror(errno));
+
+    for( size_t i = 0; i < Tracked_Slots; i++ ) {
+        if( Tracked[i] )
+            tracked_put(table, slots, Tracked[i]);
+    }
+
+    if( Tracked )
+        munmap(Tracked, Tracked_Slots * sizeof(uintptr_t));
+    Tracked = table;
+    Tracked_Slots = slots;
+}
+
+static void tracked_add(void *ptr) {
+    pthread_mutex_lock(&Tracked_Lock);
+
+    if( (Tracked_Count + 1) * 2 > Tracked_Slots )
+        tracked_grow();
+    tracked_put(Tracked, Tracked_Slots, (uintptr_t)ptr);
+    Tracked_Count++;
+
+    pthread_mutex_unlock(&Tracked_Lock);
+}
+
+/* Takes ptr out of the set, false if it was never in it */
+static bool tracked_remove(void *ptr) {
+    uintptr_t addr = (uintptr_t)ptr;
+    bool found = false;
+
+    pthread_mutex_lock(&Tracked_Lock);
+
+    size_t mask = Tracked_Slots - 1;
+    size_t i = Tracked ? tracked_slot(addr, Tracked_Slots) : 0;
+    while( Tracked && Tracked[i] != 0 ) {
+        if( Tracked[i] != addr ) {
+            i = (i + 1) & mask;
+            continue;
+        }
+
+        /* Shift back anything after it which probed past this slot */
+        found = true;
+        Tracked_Count--;
+        size_t hole = i;
+        for( size_t j = (i + 1) & mask; Tracked[j] != 0; j = (j + 1) & mask ) {
+            size_t home = tracked_slot(Tracked[j], Tracked_Slots);
+            if( ((j - home) & mask) >= ((j - hole) & mask) ) {
+                Tracked[hole] = Tracked[j];
+                hole = j;
+            }
+        }
+        Tracked[hole] = 0;
+        break;
+    }
+
+    pthread_mutex_unlock(&Tracked_Lock);
+
+    return found;
+}
+
+static int find_exe(struct dl_phdr_info *info, size_t size, void *data) {
+    /* The program is always first */
+    Exe_Bias  = info->dlpi_addr;
+    Exe_Start = UINTPTR_MAX;
+    Exe_End   = 0;
+
+    for( int i = 0; i < info->dlpi_phnum; i++ ) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if( phdr->p_type != PT_LOAD || !(phdr->p_flags & PF_X) )
+            continue;
+
+        uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+        Exe_Start = MIN(Exe_Start, start);
+        Exe_End   = MAX(Exe_End, start + phdr->p_memsz);
+    }
+
+    return 1;
+}
+
+static inline bool is_in_exe(uintptr_t addr) {
+    return addr >= Exe_Start && addr < Exe_End;
+}
+
+/* The first caller in the program, starting from whoever called malloc */
+static uintptr_t alloc_site(void *caller) {
+    if( is_in_exe((uintptr_t)caller) )
+        return (uintptr_t)caller;
+
+    void *frames[ALLOC_MAX_FRAMES];
+    int num_frames = backtrace(frames, ALLOC_MAX_FRAMES);
+
+    bool past_caller = false;
+    for( int i = 0; i < num_frames; i++ ) {
+        if( frames[i] == caller )
+            past_caller = true;
+        else if( past_caller && is_in_exe((uintptr_t)frames[i]) )
+            return (uintptr_t)frames[i];
+    }
+
+    return 0;
+}
+
+static void AllocSite_count(uintptr_t addr, size_t size) {
+    for( uintptr_t i = 0; i < ALLOC_SITES; i++ ) {
+        AllocSite *site = &Alloc_Sites[(addr + i) & (ALLOC_SITES - 1)];
+
+        uintptr_t have = atomic_load_explicit(&site->addr, memory_order_relaxed);
+        if( have == 0 && atomic_compare_exchange_strong(&site->addr, &have, addr) )
+            have = addr;
+
+        if( have == addr ) {
+            atomic_fetch_add_explicit(&site->allocs, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&site->bytes, size, memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+static inline void alloc_update_peak(int64_t live) {
+    int64_t peak = atomic_load_explicit(&Alloc_Peak, memory_order_relaxed);
+    while( live > peak && !atomic_compare_exchange_weak(&Alloc_Peak, &peak, live) )
+        ;
+}
+
+static void alloc_record(void *ptr, void *caller) {
+    if( In_Alloc_Hook )
+        return;
+    In_Alloc_Hook = true;
+
+    size_t size = malloc_usable_size(ptr);
+    tracked_add(ptr);
+
+    atomic_fetch_add_explicit(&Alloc_Count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&Alloc_Bytes, size, memory_order_relaxed);
+    alloc_update_peak(atomic_fetch_add_explicit(&Alloc_Live, size, memory_order_relaxed) + size);
+
+    uintptr_t site = alloc_site(caller);
+    if( site )
+        AllocSite_count(site, size);
+
+    In_Alloc_Hook = false;
+}
+
+static void free_count(size_t size) {
+    atomic_fetch_add_explicit(&Free_Count, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&Alloc_Live, size, memory_order_relaxed);
+}
+
+/* Before it's freed, the address could be handed out again */
+static void free_record(void *ptr) {
+    if( tracked_remove(ptr) )
+        free_count(malloc_usable_size(ptr));
+}
+
+void *malloc(size_t size) {
+    void *ptr = __libc_malloc(size);
+
+    if( G_UNLIKELY(Alloc_Tracking) && ptr )
+        alloc_record(ptr, __builtin_return_address(0));
+
+    return ptr;
+}
+
+void *calloc(size_t num, size_t size) {
+    void *ptr = __libc_calloc(num, size);
+
+    if( G_UNLIKELY(Alloc_Tracking) && ptr )
+        alloc_record(ptr, __builtin_return_address(0));
+
+    return ptr;
+}
+
+/* A move is a free of the old block and an allocation of the new */
+void *realloc(void *old, size_t size) {
+    bool tracking = G_UNLIKELY(Alloc_Tracking);
+    bool was_tracked = false;
+    size_t old_size = 0;
+    if( tracking && old ) {
+        old_size = malloc_usable_size(old);
+        was_tracked = tracked_remove(old);
+    }
+
+    void *ptr = __libc_realloc(old, size);
+
+    if( tracking ) {
+        /* realloc(old, 0) frees, a failed realloc leaves old alone */
+        if( old && !ptr && size != 0 ) {
+            if( was_tracked )
+                tracked_add(old);
+        }
+        else if( was_tracked ) {
+            free_count(old_size);
+        }
+
+        if( ptr )
+            alloc_record(ptr, __builtin_return_address(0));
+    }
+
+    return ptr;
+}
+
+void *memalign(size_t alignment, size_t size) {
+    void *ptr = __libc_memalign(alignment, size);
+
+    if( G_UNLIKELY(Alloc_Tracking) && ptr )
+        alloc_record(ptr, __builtin_return_address(0));
+
+    return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    void *ptr = __libc_memalign(alignment, size);
+
+    if( G_UNLIKELY(Alloc_Tracking) && ptr )
+        alloc_record(ptr, __builtin_return_address(0));
+
+    return ptr;
+}
+
+int posix_memalign(void **out, size_t alignment, size_t size) {
+    if( alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0 )
+        return EINVAL;
+
+    void *ptr = __libc_memalign(alignment, size);
+    if( !ptr )
+        return ENOMEM;
+
+    if( G_UNLIKELY(Alloc_Tracking) )
+        alloc_record(ptr, __builtin_return_address(0));
+
+    *out = ptr;
+    return 0;
+}
+
+void free(void *ptr) {
+    if( G_UNLIKELY(Alloc_Tracking) && ptr )
+        free_record(ptr);
+
+    __libc_free(ptr);
+}
+
+bool alloc_enable() {
+    static bool registered = false;
+
+    if( Alloc_Tracking )
+        return true;
+
+    dl_iterate_phdr(find_exe, NULL);
+
+    /* The first backtrace() loads libgcc, get that out of the way */
+    void *frames[2];
+    backtrace(frames, 2);
+
+    /* Older GLibs have their own slab allocator, make it use malloc */
+    setenv("G_SLICE", "always-malloc", 0);
+
+    if( !registered ) {
+        atexit(alloc_report_sites);
+        registered = true;
+    }
+
+    atomic_store(&Alloc_Peak, atomic_load(&Alloc_Live));
+    Alloc_Tracking = true;
+
+    return true;
+}
+
+static int AllocSite_cmp_allocs(const void *a, const void *b) {
+    const AllocSite *site_a = *(AllocSite **)a;
+    const AllocSite *site_b = *(AllocSite **)b;
+    uint64_t allocs_a = atomic_load(&site_a->allocs);
+    uint64_t allocs_b = atomic_load(&site_b->allocs);
+
+    return allocs_a < allocs_b ?  1
+         : allocs_a > allocs_b ? -1
+         :                        0;
+}
+
+/* Turns the addresses into "function file:line" with addr2line.  If
+   that doesn't work, they stay as offsets into the program. */
+static void print_site_names(FILE *out, AllocSite **sites, int num_sites) {
+    char exe[4096];
+    ssize_t exe_len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    exe[exe_len > 0 ? exe_len : 0] = '\0';
+
+    GString *cmd = g_string_new(NULL);
+    g_string_printf(cmd, "addr2line -f -s -C -e '%s'", exe);
+    for( int i = 0; i < num_sites; i++ ) {
+        /* The return address is after the call */
+        g_string_append_printf(cmd, " 0x%lx", (unsigned long)(sites[i]->addr - Exe_Bias - 1));
+    }
+
+    FILE *names = exe_len > 0 ? popen(cmd->str, "r") : NULL;
+    g_string_free(cmd, true);
+
+    char func[1024], line[1024];
+    for( int i = 0; i < num_sites; i++ ) {
+        AllocSite *site = sites[i];
+        bool named = names &&
+                     fgets(func, sizeof(func), names) &&
+                     fgets(line, sizeof(line), names) &&
+                     func[0] != '?';
+
+        fprintf(out, "alloc site ");
+        if( named ) {
+            func[strcspn(func, "\n")] = '\0';
+            line[strcspn(line, "\n")] = '\0';
+            fprintf(out, "%s %s", func, line);
+        }
+        else {
+            fprintf(out, "+0x%lx", (unsigned long)(site->addr - Exe_Bias));
+        }
+        fprintf(out, ": allocs=%llu bytes=%llu\n",
+                (unsigned long long)atomic_load(&site->allocs),
+                (unsigned long long)atomic_load(&site->bytes));
+    }
+
+    if( names )
+        pclose(names);
+}
+
+void alloc_report_sites() {
+    static AllocSite *sites[ALLOC_SITES];
+    int num_sites = 0;
+
+    if( !Alloc_Tracking )
+        return;
+    Alloc_Tracking = false;
+
+    for( int i = 0; i < ALLOC_SITES; i++ ) {
+        if( atomic_load(&Alloc_Sites[i].addr) )
+            sites[num_sites++] = &Alloc_Sites[i];
+    }
+    qsort(sites, num_sites, sizeof(AllocSite *), AllocSite_cmp_allocs);
+
+    fprintf(stderr, "allocs: allocs=%llu frees=%llu bytes=%llu peak_live_bytes=%lld\n",
+            (unsigned long long)atomic_load(&Alloc_Count),
+            (unsigned long long)atomic_load(&Free_Count),
+            (unsigned long long)atomic_load(&Alloc_Bytes),
+            (long long)atomic_load(&Alloc_Peak));
+    print_site_names(stderr, sites, MIN(num_sites, ALLOC_REPORT_SITES));
+}
+
+#else
+
+bool alloc_enable() {
+    fprintf(stderr, "Allocation tracking needs glibc.\n");
+    return false;
+}
+
+void alloc_report_sites() {
+}
+
+#endif
+
+void alloc_stats(AllocStats *stats) {
+    stats->allocs = atomic_load(&Alloc_Count);
+    stats->frees  = atomic_load(&Free_Count);
+    stats->bytes  = atomic_load(&Alloc_Bytes);
+    stats->live   = atomic_load(&Alloc_Live);
+    stats->peak   = atomic_load(&Alloc_Peak);
+}
+
+/* Start measuring a new peak from here, returns the peak so far */
+int64_t alloc_peak_reset() {
+    return atomic_exchange(&Alloc_Peak, atomic_load(&Alloc_Live));
+}
+
+/* Put back a peak from alloc_peak_reset(), unless it's been passed */
+void alloc_peak_restore(int64_t peak) {
+    int64_t have = atomic_load(&Alloc_Peak);
+    while( peak > have && !atomic_compare_exchange_weak(&Alloc_Peak, &have, peak) )
+        ;
+}
+
+/* Appends the allocations between begin and end.  The peak is how far
+   live bytes rose above where they were at the beginning. */
+void alloc_print(FILE *out, AllocStats *begin, AllocStats *end) {
+    fprintf(out, " allocs=%llu frees=%llu alloc_bytes=%llu peak_live_bytes=%lld",
+            (unsigned long long)(end->allocs - begin->allocs),
+            (unsigned long long)(end->frees - begin->frees),
+            (unsigned long long)(end->bytes - begin->bytes),
+            (long long)MAX(end->peak - begin->live, 0));
+}
@@ -0,0 +1,44 @@
+#ifndef _alloc_h
+#define _alloc_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Allocation accounting, turned on with --allocs.
+
+   malloc(), calloc(), realloc(), the aligned allocators and free() are
+   replaced with versions which count calls and bytes, then pass
+   through to glibc.  Only frees of blocks allocated while counting are
+   counted, anything older doesn't come off the live bytes.  GLib
+   allocates with malloc(), so g_malloc(), g_strdup() and friends are
+   counted too.  When it's off the cost is one branch per call.
+
+   Each allocation is charged to a call site: the first caller in the
+   program itself, so a g_strdup() inside g_match_info_fetch_named() is
+   charged to the line calling g_match_info_fetch_named().  The busiest
+   sites are printed to stderr at exit.  Phases report their own totals,
+   see phase.h.
+
+   Byte counts are what malloc really handed out, malloc_usable_size(),
+   which can be a bit more than was asked for.  Only available with
+   glibc. */
+
+typedef struct {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t bytes;         /* allocated, realloc counts the new size */
+    int64_t live;           /* allocated and not yet freed */
+    int64_t peak;           /* highest live since alloc_peak_reset() */
+} AllocStats;
+
+extern bool Alloc_Tracking;
+
+bool alloc_enable();
+void alloc_stats(AllocStats *stats);
+int64_t alloc_peak_reset();
+void alloc_peak_restore(int64_t peak);
+void alloc_print(FILE *out, AllocStats *begin, AllocStats *end);
+void alloc_report_sites();
+
+#endif
@@ -0,0 +1,89 @@
+#include "common.h"
+#include "bigbuf.h"
+#include "pool.h"
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static size_t round_up(size_t size, size_t to) {
+    return (size + to - 1) / to * to;
+}
+
+/* Plain pages, but 2MB aligned so transparent huge pages can back all of it */
+static void *bigbuf_map_aligned(size_t size) {
+    size_t padded = size + BIGBUF_HUGE_PAGE;
+    char *map = mmap(NULL, padded, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if( map == MAP_FAILED )
+        return NULL;
+
+    char *buf = (char *)round_up((uintptr_t)map, BIGBUF_HUGE_PAGE);
+    if( buf > map )
+        munmap(map, buf - map);
+    if( buf + size < map + padded )
+        munmap(buf + size, map + padded - (buf + size));
+
+#ifdef MADV_HUGEPAGE
+    madvise(buf, size, MADV_HUGEPAGE);
+#endif
+
+    return buf;
+}
+
+void *bigbuf_new(size_t size) {
+    if( size < BIGBUF_MIN )
+        return calloc(1, size);
+
+    /* Either way it's mapped in whole huge pages, so bigbuf_free()
+       doesn't need to know which it got */
+    size = round_up(size, BIGBUF_HUGE_PAGE);
+
+#ifdef MAP_HUGETLB
+    void *buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if( buf != MAP_FAILED )
+        return buf;
+#endif
+
+    void *aligned = bigbuf_map_aligned(size);
+    if( aligned == NULL )
+        die("Could not map a %zu byte buffer: %s", size, strerror(errno));
+
+    return aligned;
+}
+
+void bigbuf_free(void *buf, size_t size) {
+    if( buf == NULL )
+        return;
+
+    if( size < BIGBUF_MIN )
+        free(buf);
+    else
+        munmap(buf, round_up(size, BIGBUF_HUGE_PAGE));
+}
+
+typedef struct {
+    char *buf;
+    size_t item_size;
+} BigbufTouch;
+
+static void bigbuf_touch_range(long from, long to, void *_touch) {
+    BigbufTouch *touch = _touch;
+    char *start = touch->buf + from * touch->item_size;
+    char *end   = touch->buf + to   * touch->item_size;
+    long page = sysconf(_SC_PAGESIZE);
+
+    /* The first byte of every page in the range, it's already zero */
+    for( char *p = (char *)round_up((uintptr_t)start, page); p < end; p += page ) {
+        *(volatile char *)p = 0;
+    }
+    if( start < end )
+        *(volatile char *)start = 0;
+}
+
+void bigbuf_touch(void *buf, long items, long grain, size_t item_size) {
+    BigbufTouch touch = { .buf = buf, .item_size = item_size };
+
+    pool_for(0, items, grain, bigbuf_touch_range, &touch);
+}
@@ -0,0 +1,35 @@
+#ifndef _bigbuf_h
+#define _bigbuf_h
+
+#include <stddef.h>
+
+/* Zeroed buffers for big grids and tables, on huge pages if we can get
+   them.
+
+   A 1000x1000 grid of shorts is 2MB, 512 pages of 4KB, and walking it
+   misses the TLB constantly.  A bigbuf of BIGBUF_MIN or more is mapped
+   on its own, 2MB aligned.  It first tries explicit huge pages
+   (MAP_HUGETLB), which only works if some are reserved in
+   /proc/sys/vm/nr_hugepages.  Otherwise it asks for transparent huge
+   pages (MADV_HUGEPAGE).  Smaller buffers come from calloc(), they
+   wouldn't fill a huge page anyway.
+
+   The pages aren't touched until they're used.  On a NUMA machine a
+   page goes on the node of the thread which first writes it, so a
+   buffer which is filled in parallel should be first written by the
+   threads which will work on it.  bigbuf_touch() does that for a
+   buffer worked on with pool_for() over the same ranges.
+
+   Like munmap(), bigbuf_free() needs the size it was made with. */
+
+#define BIGBUF_MIN       (256 * 1024)
+#define BIGBUF_HUGE_PAGE (2 * 1024 * 1024)
+
+void *bigbuf_new(size_t size);
+void bigbuf_free(void *buf, size_t size);
+
+/* Write each page from the pool thread that gets its part of
+   pool_for(0, items, grain), item_size bytes per item */
+void bigbuf_touch(void *buf, long items, long grain, size_t item_size);
+
+#endif
@@ -1,30 +1,335 @@
+/* fopencookie(), pipe2(), tee() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdbool.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/errno.h>
 #include <string.h>
 #include <math.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "common.h"
+#include "counters.h"
+#include "alloc.h"
+#include "pool.h"
+#include "phase.h"
+#include "readahead.h"
+#include "solve.h"
+
+typedef struct {
+    const char *magic;
+    size_t magic_len;
+    const char *command;
+} Compression;
+
+static const Compression Compressions[] = {
+    { "\x1f\x8b",         2, "gzip" },
+    { "\x28\xb5\x2f\xfd", 4, "zstd" },
+    { NULL }
+};
+
+/* By its first bytes, NULL if it's not compressed */
+static const Compression *compression_of(const char *magic, ssize_t len) {
+    for( const Compression *comp = Compressions; comp->magic != NULL; comp++ ) {
+        if( len >= (ssize_t)comp->magic_len && memcmp(magic, comp->magic, comp->magic_len) == 0 )
+            return comp;
+    }
+
+    return NULL;
+}
+
+/* The first bytes of the input without taking them, so whatever reads
+   it next still starts at the beginning.  A regular file is read from
+   where it's at, a pipe's are copied out with tee().  Anything else,
+   like a terminal, isn't looked at. */
+static ssize_t peek_input(int fd, char *buf, size_t size) {
+    struct stat st;
+    if( fstat(fd, &st) != 0 )
+        return -1;
+
+    if( S_ISREG(st.st_mode) )
+        return pread(fd, buf, size, lseek(fd, 0, SEEK_CUR));
+    if( !S_ISFIFO(st.st_mode) )
+        return -1;
+
+    int scratch[2];
+    if( pipe2(scratch, O_CLOEXEC) != 0 )
+        return -1;
+
+    ssize_t len;
+    while( (len = tee(fd, scratch[1], size, 0)) < 0 && errno == EINTR )
+        ;
+    if( len > 0 )
+        len = read(scratch[0], buf, len);
+
+    close(scratch[0]);
+    close(scratch[1]);
+
+    return len;
+}
+
+/* The decompressor reads fd as its stdin and we read its output from a
+   pipe, so it runs alongside the solver.  posix_spawnp() rather than
+   fork(), a forked child of a process with threads could find a lock
+   taken which nobody will ever give back.  Our end of the pipe is
+   close-on-exec so a decompressor started by another thread doesn't
+   hold it open.  The read end, or -1 with errno set. */
+static int spawn_decompressor(int fd, const Compression *comp, pid_t *pid) {
+    int fds[2];
+    if( pipe2(fds, O_CLOEXEC) != 0 )
+        return -1;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fd, STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+
+    /* Closed before the end it gets SIGPIPE, that's how it's meant to stop */
+    posix_spawnattr_t attr;
+    sigset_t sigpipe;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigdefault(&attr, &sigpipe);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+    char *argv[] = { (char *)comp->command, "-dc", NULL };
+    int error = posix_spawnp(pid, comp->command, &actions, &attr, argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(fds[1]);
+
+    if( error ) {
+        close(fds[0]);
+        errno = error;
+        return -1;
+    }
+
+    return fds[0];
+}
+
+/* An input from a pipe, read ahead by a Readahead, see readahead.h.
+   If it's decompressed the decompressor is our child, reaped when the
+   stream is closed.  The stream's hooks never die(), they'd be
+   unwinding out of stdio with its lock held, so close_file() says if
+   reading or the decompressor failed. */
+typedef struct {
+    FILE *fp;
+    int fd;
+    /* stdin's descriptor stays open */
+    bool close_fd;
+    Readahead *reader;
+    int read_error;
+
+    /* The decompressor, 0 if there isn't one, so status stays 0 */
+    pid_t pid;
+    const Compression *comp;
+    char *name;
+
+    /* close_file() is waiting for the status, don't free it */
+    bool claimed;
+    int status;
+} Input;
+
+/* The stream to its Input, for close_file() */
+static GHashTable *Inputs = NULL;
+static pthread_mutex_t Inputs_Lock = PTHREAD_MUTEX_INITIALIZER;
+
+static ssize_t Input_read(void *cookie, char *buf, size_t size) {
+    Input *self = cookie;
+    ssize_t len = Readahead_read(self->reader, buf, size);
+
+    if( len < 0 )
+        self->read_error = errno;
+
+    return len;
+}
+
+static int Input_close(void *cookie) {
+    Input *self = cookie;
+
+    Readahead_destroy(self->reader);
+    if( self->close_fd )
+        close(self->fd);
+
+    while( self->pid && waitpid(self->pid, &self->status, 0) < 0 ) {
+        if( errno != EINTR ) {
+            /* Nothing to tell, call it a success */
+            self->status = 0;
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&Inputs_Lock);
+    g_hash_table_remove(Inputs, self->fp);
+    pthread_mutex_unlock(&Inputs_Lock);
+
+    if( !self->claimed ) {
+        free(self->name);
+        free(self);
+    }
+
+    return 0;
+}
+
+/* fp itself, or a stream of it decompressed if it's compressed.  A pipe
+   is read ahead, even when it's not compressed. */
+static FILE *open_input(FILE *fp, const char *name) {
+    int fd = fileno(fp);
+    char magic[8];
+    const Compression *comp = compression_of(magic, peek_input(fd, magic, sizeof(magic)));
+    struct stat st;
 
+    if( !comp && (fstat(fd, &st) != 0 || !S_ISFIFO(st.st_mode)) )
+        return fp;
+
+    pid_t pid = 0;
+    if( comp ) {
+        /* The decompressor has its own copy of the descriptor */
+        fd = spawn_decompressor(fd, comp, &pid);
+        int error = errno;
+        if( fp != stdin )
+            fclose(fp);
+
+        if( fd < 0 )
+            die("Could not run %s for %s: %s.", comp->command, name, strerror(error));
+    }
+    else if( fp != stdin ) {
+        /* The stream keeps the descriptor, not fp */
+        fd = dup(fd);
+        int error = errno;
+        fclose(fp);
+
+        if( fd < 0 )
+            die("Could not read %s: %s", name, strerror(error));
+    }
+
+    Input *self = malloc(sizeof(Input));
+    *self = (Input){
+        .fd       = fd,
+        .close_fd = fp != stdin || comp,
+        .pid      = pid,
+        .comp     = comp,
+        .name     = strdup(name)
+    };
+    self->reader = Readahead_new(self->fd);
+
+    cookie_io_functions_t io = {
+        .read  = Input_read,
+        .close = Input_close
+    };
+    self->fp = fopencookie(self, "r", io);
+    if( self->fp == NULL )
+        die("Could not read %s: %s", name, strerror(errno));
+
+    pthread_mutex_lock(&Inputs_Lock);
+    if( !Inputs )
+        Inputs = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_hash_table_insert(Inputs, self->fp, self);
+    pthread_mutex_unlock(&Inputs_Lock);
+
+    return self->fp;
+}
+
+/* Files compressed with gzip or zstd are read decompressed */
 FILE *open_file(const char *filename, const char *mode) {
     FILE *fp = fopen(filename, mode);
     if( fp == NULL ) {
+        /* A solve fails, anything else exits with the error */
+        if( solving() )
+            die("Could not open %s: %s.", filename, strerror(errno));
+
         fprintf(stderr, "Could not open %s: %s.\n", filename, strerror(errno));
         exit(errno);
     }
 
+    if( streq(mode, "r") )
+        return open_input(fp, filename);
+
     return fp;
 }
 
+FILE *open_stdin() {
+    return open_input(stdin, "stdin");
+}
+
+char *close_file(FILE *fp) {
+    if( fp == stdin )
+        return NULL;
+
+    pthread_mutex_lock(&Inputs_Lock);
+    Input *input = Inputs ? g_hash_table_lookup(Inputs, fp) : NULL;
+    if( input )
+        input->claimed = true;
+    pthread_mutex_unlock(&Inputs_Lock);
+
+    fclose(fp);
+    if( !input )
+        return NULL;
+
+    int status = input->status;
+    char *failed = NULL;
+    if( input->read_error )
+        failed = g_strdup_printf("Could not read %s: %s", input->name, strerror(input->read_error));
+    else if( WIFEXITED(status) && WEXITSTATUS(status) != 0 )
+        failed = g_strdup_printf("%s could not decompress %s, it exited with %d.", input->comp->command, input->name, WEXITSTATUS(status));
+    else if( WIFSIGNALED(status) && WTERMSIG(status) != SIGPIPE )
+        failed = g_strdup_printf("%s was killed by signal %d decompressing %s.", input->comp->command, WTERMSIG(status), input->name);
+
+    free(input->name);
+    free(input);
+
+    return failed;
+}
+
+/* Reading the descriptor picks up where stdio is at, if fflush() put the
+   descriptor there and dropped whatever stdio had buffered.  It can
+   only do that for a file it can seek. */
+static bool stdio_in_sync(FILE *fp, int fd) {
+    off_t pos = ftello(fp);
+
+    return pos >= 0 && fflush(fp) == 0 && lseek(fd, 0, SEEK_CUR) == pos;
+}
+
+/* Lines come from a Readahead, see readahead.h.  A file gets one of its
+   own, a pipe from open_file() or open_stdin() has one already. */
 void foreach_line(FILE *fp, LineCB cb, void *cb_data) {
-    char *line = NULL;
-    size_t line_len = 0;
+    int fd = fileno(fp);
+
+    if( fd < 0 || !stdio_in_sync(fp, fd) ) {
+        char *line = NULL;
+        size_t line_len = 0;
 
-    while( getline(&line, &line_len, fp) > 0 ) {
+        while( getline(&line, &line_len, fp) > 0 ) {
+            cb(line, cb_data);
+        }
+
+        free(line);
+        return;
+    }
+
+    /* Owned by the solve, if cb dies its thread is stopped */
+    Readahead *reader = solve_own(Readahead_new(fd), (GDestroyNotify)Readahead_destroy);
+    char *line;
+    size_t line_len;
+
+    while( (line = Readahead_line(reader, &line_len)) != NULL ) {
         cb(line, cb_data);
     }
 
-    free(line);
+    solve_release(reader, (GDestroyNotify)Readahead_destroy);
+
+    /* The descriptor is at the end, so is the stream */
+    fseeko(fp, 0, SEEK_END);
 }
 
 void usage(int argc, char *desc[]) {
@@ -35,6 +340,30 @@ void usage(int argc, char *desc[]) {
     fputs("\n", stderr);
 }
 
+/* Options every day understands, like --stats and --threads.  They're taken out
+   of argv so each main() only sees its own arguments. */
+void common_options(int *argc, char **argv) {
+    int kept = 1;
+
+    for( int i = 1; i < *argc; i++ ) {
+        if( streq(argv[i], "--stats") )
+            phase_stats_enable();
+        else if( streq(argv[i], "--counters") )
+            counters_enable();
+        else if( streq(argv[i], "--allocs") )
+            alloc_enable();
+        else if( streq(argv[i], "--threads") && i + 1 < *argc )
+            pool_set_threads(atoi(argv[++i]));
+        else if( strncmp(argv[i], "--threads=", 10) == 0 )
+            pool_set_threads(atoi(argv[i] + 10));
+        else
+            argv[kept++] = argv[i];
+    }
+
+    argv[kept] = NULL;
+    *argc = kept;
+}
+
 // Same as g_regex_new, but no error
 GRegex *compile_regex(
     const gchar *pattern,
@@ -46,31 +375,41 @@ GRegex *compile_regex(
     GRegex *re = g_regex_new(pattern, compile_options, match_options, &error);
 
     if( error != NULL ) {
-        fprintf(stderr, "Can't compile regex: %s\n", error->message);
+        char *message = g_strdup(error->message);
         g_error_free(error);
-        exit(1);
+        die("Can't compile regex: %s", message);
     }
 
     return re;
 }
 
+/* Only whitespace, same as /^\s*$/ but without a shared regex */
 bool is_blank(char *line) {
-    static GRegex *blank_line_re = NULL;
-
-    if( !blank_line_re ) {
-        blank_line_re = compile_regex(
-            "^ \\s* $",
-            G_REGEX_OPTIMIZE | G_REGEX_EXTENDED,
-            0
-        );
+    for( ; *line; line++ ) {
+        switch( *line ) {
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+            case '\f':
+            case '\v':
+                break;
+            default:
+                return false;
+        }
     }
 
-    return g_regex_match(blank_line_re, line, 0, NULL);
+    return true;
 }
 
+/* In a solve it fails the solve instead, see solve.h */
 void die(char *format, ...) {
     va_list args;
-    
+
+    va_start(args, format);
+    solve_fail(format, args);
+    va_end(args);
+
     va_start(args, format);
     vfprintf(stderr, format, args);
     va_end(args);
@@ -19,12 +19,22 @@
 
 typedef void (*LineCB)(char *line, void *cb_data);
 
+/* Read with mode "r", a file compressed with gzip or zstd comes out
+   decompressed, see close_file() */
 FILE *open_file(const char *filename, const char *mode);
+/* stdin, or a stream of it decompressed if it's compressed */
+FILE *open_stdin();
+/* Closes what open_file() or open_stdin() gave, leaving stdin itself
+   open.  If it was decompressed and the decompressor failed, the
+   message why, to g_free(), else NULL. */
+char *close_file(FILE *fp);
 
 void foreach_line(FILE *line, LineCB cb, void *cb_data);
 
 void usage(int argc, char *desc[]);
 
+void common_options(int *argc, char **argv);
+
 void die(char *format, ...);
 
 // Same as g_regex_new, but no error
@@ -0,0 +1,185 @@
+#include "common.h"
+#include "counters.h"
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+typedef struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} CounterDef;
+
+bool Counters_Enabled = false;
+
+/* See counters_add() */
+static _Thread_local CounterValues Counters_Helped;
+
+#ifdef __linux__
+
+#define CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/* In CounterType order */
+static const CounterDef Counter_Defs[NUM_COUNTERS] = {
+    { "cycles",         PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions",   PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "l1d_misses",     PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { "llc_misses",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "branch_misses",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+/* This thread's, opened by the process Counters_Pid */
+static _Thread_local int Counter_Fds[NUM_COUNTERS];
+static _Thread_local pid_t Counters_Pid = 0;
+
+static pthread_key_t Counters_Key;
+static pthread_once_t Counters_Key_Once = PTHREAD_ONCE_INIT;
+
+static int counter_open(const CounterDef *def) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = def->type;
+    attr.config         = def->config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static void counters_close(void *unused) {
+    for( int i = 0; i < NUM_COUNTERS; i++ ) {
+        if( Counter_Fds[i] >= 0 )
+            close(Counter_Fds[i]);
+        Counter_Fds[i] = -1;
+    }
+    Counters_Pid = 0;
+}
+
+static void counters_key_create() {
+    pthread_key_create(&Counters_Key, counters_close);
+}
+
+/* This thread's counters, how many opened.  Counters belong to the
+   process which opened them, so a forked worker opens its own. */
+static int counters_open(int *open_errno) {
+    pid_t pid = getpid();
+    int opened = 0;
+
+    if( Counters_Pid == pid ) {
+        for( int i = 0; i < NUM_COUNTERS; i++ ) {
+            opened += Counter_Fds[i] >= 0;
+        }
+        return opened;
+    }
+
+    if( Counters_Pid )
+        counters_close(NULL);
+
+    for( int i = 0; i < NUM_COUNTERS; i++ ) {
+        Counter_Fds[i] = counter_open(&Counter_Defs[i]);
+        if( Counter_Fds[i] >= 0 )
+            opened++;
+        else
+            *open_errno = errno;
+    }
+    Counters_Pid = pid;
+
+    /* Closed when the thread exits */
+    pthread_once(&Counters_Key_Once, counters_key_create);
+    pthread_setspecific(Counters_Key, &Counters_Pid);
+
+    return opened;
+}
+
+bool counters_enable() {
+    int open_errno = 0;
+
+    if( !counters_open(&open_errno) ) {
+        fprintf(stderr, "Hardware counters are not available: %s.\n", strerror(open_errno));
+        Counters_Enabled = false;
+        return false;
+    }
+
+    Counters_Enabled = true;
+    return true;
+}
+
+void counters_read(CounterValues *values) {
+    int open_errno;
+    counters_open(&open_errno);
+
+    for( int i = 0; i < NUM_COUNTERS; i++ ) {
+        /* value, time enabled, time running */
+        uint64_t buf[3];
+
+        values->valid[i] = Counter_Fds[i] >= 0 &&
+                           read(Counter_Fds[i], buf, sizeof(buf)) == sizeof(buf) &&
+                           buf[2] > 0;
+        if( !values->valid[i] ) {
+            values->values[i] = 0;
+            continue;
+        }
+
+        /* When there are more counters than the PMU has room for they
+           take turns, scale up to the whole time. */
+        values->values[i] = buf[2] < buf[1]
+                          ? (uint64_t)((double)buf[0] * buf[1] / buf[2])
+                          : buf[0];
+        values->values[i] += Counters_Helped.values[i];
+    }
+}
+
+#else
+
+static const CounterDef Counter_Defs[NUM_COUNTERS] = {
+    { "cycles" }, { "instructions" }, { "l1d_misses" }, { "llc_misses" }, { "branch_misses" }
+};
+
+bool counters_enable() {
+    fprintf(stderr, "Hardware counters are only available on Linux.\n");
+    return false;
+}
+
+void counters_read(CounterValues *values) {
+    memset(values, 0, sizeof(*values));
+}
+
+#endif
+
+/* A counter the helper couldn't read adds nothing */
+void counters_add(const CounterValues *begin, const CounterValues *end) {
+    for( int i = 0; i < NUM_COUNTERS; i++ ) {
+        if( begin->valid[i] && end->valid[i] )
+            Counters_Helped.values[i] += end->values[i] - begin->values[i];
+    }
+}
+
+/* Appends " name=count" for each counter between begin and end */
+void counters_print(FILE *out, CounterValues *begin, CounterValues *end) {
+    bool valid[NUM_COUNTERS];
+    uint64_t counts[NUM_COUNTERS];
+
+    for( int i = 0; i < NUM_COUNTERS; i++ ) {
+        valid[i]  = begin->valid[i] && end->valid[i];
+        counts[i] = valid[i] ? end->values[i] - begin->values[i] : 0;
+
+        if( valid[i] )
+            fprintf(out, " %s=%llu", Counter_Defs[i].name, (unsigned long long)counts[i]);
+        else
+            fprintf(out, " %s=n/a", Counter_Defs[i].name);
+    }
+
+    if( valid[COUNTER_CYCLES] && valid[COUNTER_INSTRUCTIONS] && counts[COUNTER_CYCLES] )
+        fprintf(out, " ipc=%.2f", (double)counts[COUNTER_INSTRUCTIONS] / counts[COUNTER_CYCLES]);
+    else
+        fprintf(out, " ipc=n/a");
+}
@@ -0,0 +1,45 @@
+#ifndef _counters_h
+#define _counters_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Hardware performance counters from Linux perf_event_open(2).
+
+   They count the thread which reads them, in user space.  Each thread
+   opens its own the first time it reads them, and they're closed when
+   it exits.  A pool thread counts what it does on a pool_for() job, and
+   so do a pipeline's stages, and that's added to the counts of the
+   thread they worked for (counters_add()).  So a phase counts its own
+   work and its helpers', but not other solves running alongside.  A
+   Readahead's thread isn't counted.
+
+   If a counter can't be opened (not Linux, no PMU in a VM,
+   perf_event_paranoid too strict) it is reported as n/a, and if none
+   can be opened there's one warning and everything else carries on. */
+
+typedef enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_BRANCH_MISSES,
+    NUM_COUNTERS
+} CounterType;
+
+typedef struct {
+    uint64_t values[NUM_COUNTERS];
+    bool valid[NUM_COUNTERS];
+} CounterValues;
+
+extern bool Counters_Enabled;
+
+bool counters_enable();
+void counters_read(CounterValues *values);
+/* What another thread counted between begin and end working for this
+   one, added to what this thread reads from now on */
+void counters_add(const CounterValues *begin, const CounterValues *end);
+void counters_print(FILE *out, CounterValues *begin, CounterValues *end);
+
+#endif
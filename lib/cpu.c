@@ -0,0 +1,95 @@
+#include "common.h"
+#include "cpu.h"
+
+static const char *Cpu_Level_Names[NUM_CPU_LEVELS] = {
+    [CPU_GENERIC] = "generic",
+    [CPU_SSE42]   = "sse4.2",
+    [CPU_AVX2]    = "avx2",
+    [CPU_AVX512]  = "avx512"
+};
+
+/* -1 until checked */
+static int Cpu_Level = -1;
+
+const char *cpu_level_name(CpuLevel level) {
+    if( level < 0 || level >= NUM_CPU_LEVELS )
+        return "unknown";
+
+    return Cpu_Level_Names[level];
+}
+
+int cpu_level_from_name(const char *name) {
+    for( int level = 0; level < NUM_CPU_LEVELS; level++ ) {
+        if( streq(name, Cpu_Level_Names[level]) )
+            return level;
+    }
+
+    return -1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+CpuLevel cpu_detect() {
+    __builtin_cpu_init();
+
+    /* The byte and word instructions are what our kernels want */
+    if( __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") )
+        return CPU_AVX512;
+    if( __builtin_cpu_supports("avx2") )
+        return CPU_AVX2;
+    if( __builtin_cpu_supports("sse4.2") )
+        return CPU_SSE42;
+
+    return CPU_GENERIC;
+}
+
+#else
+
+/* Only x86 kernels so far */
+CpuLevel cpu_detect() {
+    return CPU_GENERIC;
+}
+
+#endif
+
+CpuLevel cpu_level() {
+    if( Cpu_Level >= 0 )
+        return Cpu_Level;
+
+    CpuLevel level = cpu_detect();
+
+    const char *want = getenv("ADVENT_CPU");
+    if( want && !is_empty(want) ) {
+        int forced = cpu_level_from_name(want);
+        if( forced < 0 )
+            die("Unknown ADVENT_CPU '%s', try generic, sse4.2, avx2 or avx512", want);
+
+        if( forced > level )
+            fprintf(stderr, "ADVENT_CPU is %s, but this CPU can only do %s.\n",
+                    want, cpu_level_name(level));
+        else
+            level = forced;
+    }
+
+    Cpu_Level = level;
+
+    return level;
+}
+
+CpuFunc cpu_dispatch(const char *kernel, const CpuImpl impls[]) {
+    CpuLevel level = cpu_level();
+    const CpuImpl *best = NULL;
+
+    for( const CpuImpl *impl = impls; impl->func != NULL; impl++ ) {
+        if( impl->level <= level && (!best || impl->level >= best->level) )
+            best = impl;
+    }
+
+    if( !best )
+        die("%s has no implementation for %s", kernel, cpu_level_name(level));
+
+    if( DEBUG )
+        fprintf(stderr, "%s: using %s\n", kernel, cpu_level_name(best->level));
+
+    return best->func;
+}
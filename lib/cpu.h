@@ -0,0 +1,57 @@
+#ifndef _cpu_h
+#define _cpu_h
+
+#include <stdbool.h>
+
+/* Pick the best implementation of a kernel for the CPU we're on.
+
+   A kernel is written once per instruction set level, each compiled
+   with __attribute__((target(...))) so the rest of the build needs no
+   -m flags.  The implementations go in a table, lowest level first:
+
+       static const CpuImpl Count_Impls[] = {
+           CPU_IMPL(CPU_GENERIC, count_generic),
+           CPU_IMPL(CPU_AVX2,    count_avx2),
+           CPU_IMPL_END
+       };
+
+       CountFunc count = (CountFunc)cpu_dispatch("count", Count_Impls);
+
+   cpu_dispatch() returns the highest one the CPU can run.  Resolve once
+   and keep the pointer, it's a table walk.
+
+   Set ADVENT_CPU to generic, sse4.2, avx2 or avx512 to pretend the CPU
+   can do no more than that, to test the lower levels on a fast machine.
+   It can't raise the level past what the CPU has. */
+
+/* In order, each level can run everything below it */
+typedef enum {
+    CPU_GENERIC,
+    CPU_SSE42,
+    CPU_AVX2,
+    CPU_AVX512,
+    NUM_CPU_LEVELS
+} CpuLevel;
+
+typedef void (*CpuFunc)(void);
+
+typedef struct {
+    CpuLevel level;
+    CpuFunc func;
+} CpuImpl;
+
+#define CPU_IMPL(level, func) { level, (CpuFunc)(func) }
+#define CPU_IMPL_END          { CPU_GENERIC, NULL }
+
+/* What this CPU supports, capped by ADVENT_CPU */
+CpuLevel cpu_level();
+/* What this CPU supports, ignoring ADVENT_CPU */
+CpuLevel cpu_detect();
+
+const char *cpu_level_name(CpuLevel level);
+/* -1 if it isn't a level */
+int cpu_level_from_name(const char *name);
+
+CpuFunc cpu_dispatch(const char *kernel, const CpuImpl impls[]);
+
+#endif
@@ -3,19 +3,27 @@
 #include <stdlib.h>
 #include <glib.h>
 #include "graph.h"
+#include "trace.h"
+#include "pool.h"
+#include "bigbuf.h"
+#include "tune.h"
+
+const char *Graph_Engines[] = { "search", "dp", NULL };
+
+/* Untuned, GRAPH_DP is used from this many nodes */
+#define GRAPH_DP_MIN_NODES 6
 
 Graph *Graph_new(GraphNodeNum max_nodes) {
     Graph *graph = malloc(sizeof(Graph));
 
     graph->node2name  = calloc(max_nodes, sizeof(*(graph->node2name)));
-    graph->nodes      = calloc(max_nodes * max_nodes, sizeof(*(graph->nodes)));
-    graph->name2node  = g_hash_table_new_full(
-        g_str_hash, g_str_equal,
-        free, free
-    );
+    /* The cost matrix is the square of the nodes, it gets big */
+    graph->nodes      = bigbuf_new(max_nodes * max_nodes * sizeof(*(graph->nodes)));
+    graph->name2node  = StrMap_new(max_nodes);
 
     graph->num_nodes = 0;
     graph->max_nodes = max_nodes;
+    graph->min_cost_calls = 0;
 
     /* Set all node connections to infinite cost */
     for(GraphNodeNum x = 0; x < graph->num_nodes; x++) {
@@ -28,11 +36,13 @@ Graph *Graph_new(GraphNodeNum max_nodes) {
 }
 
 void Graph_destroy(Graph *self) {
-    free(self->nodes);
-
-    /* This frees the names in all structures */
-    g_hash_table_unref( self->name2node );
+    bigbuf_free(self->nodes, self->max_nodes * self->max_nodes * sizeof(*(self->nodes)));
 
+    /* The map's keys are these names */
+    StrMap_destroy( self->name2node, NULL );
+    for( GraphNodeNum i = 0; i < self->num_nodes; i++ ) {
+        free(self->node2name[i]);
+    }
     free(self->node2name);
     
     free(self);
@@ -71,8 +81,9 @@ static inline char *GraphNodeSet_to_human(GraphNodeSet set) {
     return human;
 }
 
-int Graph_min_cost_Calls = 0;
-static GraphCost Graph_min_cost(Graph *self, GraphNodeNum start, GraphNodeNum current, GraphNodeSet visited) {
+/* calls counts this search, the graph may be searched by several
+   threads at once */
+static GraphCost Graph_min_cost(Graph *self, long *calls, GraphNodeNum start, GraphNodeNum current, GraphNodeSet visited) {
     if( DEBUG ) {
         char *human = GraphNodeSet_to_human(visited);
         fprintf(stderr, "min_cost(%p, %d, %d, %s)\n", self, start, current, human);
@@ -90,11 +101,11 @@ static GraphCost Graph_min_cost(Graph *self, GraphNodeNum start, GraphNodeNum cu
        That is, if you swap your start and end points, but visit the same places
        in-between, it's going to be the same minimum distance. */
     if( start > current ) {
-        return Graph_min_cost( self, current, start, visited );
+        return Graph_min_cost( self, calls, current, start, visited );
     }
 
     /* After the symmetric optimization */
-    Graph_min_cost_Calls++;
+    (*calls)++;
 
     /* Remove ourselves from the visited set, we're going to ask how we got here. */
     visited = GraphNodeSet_remove_from_set(visited, current);
@@ -121,7 +132,7 @@ static GraphCost Graph_min_cost(Graph *self, GraphNodeNum start, GraphNodeNum cu
         if( DEBUG )
             fprintf(stderr, "\tedge cost: %.0f\n", prev_cost);
         
-        prev_cost += Graph_min_cost(self, start, prev, visited);
+        prev_cost += Graph_min_cost(self, calls, start, prev, visited);
 
         if( DEBUG )
             fprintf(stderr, "\tprev_cost: %.0f\n", prev_cost);
@@ -135,31 +146,194 @@ static GraphCost Graph_min_cost(Graph *self, GraphNodeNum start, GraphNodeNum cu
     return cost;
 }
 
-GraphCost Graph_shortest_route_cost(Graph *self, bool return_to_start) {
-    Graph_min_cost_Calls = 0;
-    
+static GraphEngine Graph_engine(Graph *self) {
+    if( self->num_nodes > GRAPH_DP_MAX_NODES )
+        return GRAPH_SEARCH;
+
+    GraphEngine fallback = self->num_nodes >= GRAPH_DP_MIN_NODES ? GRAPH_DP : GRAPH_SEARCH;
+    return tune_engine("graph", Graph_Engines, self->num_nodes, fallback);
+}
+
+typedef struct {
+    Graph *graph;
+    /* The cheapest path through each set of nodes, ending at each node */
+    GraphCost *costs;
+    /* Only paths from here, or -1 for from anywhere */
+    int start;
+    int layer;
+} GraphDP;
+
+#define DP_COST(dp, set, node) (dp)->costs[(size_t)(set) * (dp)->graph->num_nodes + (node)]
+
+/* The sets of one layer only look at the layer before, so they're
+   independent.  Every set is visited each layer, picking out its own,
+   which is cheap next to the n^2 work on each. */
+static void Graph_dp_layer(long from, long to, void *_dp) {
+    GraphDP *dp = _dp;
+    Graph *self = dp->graph;
+
+    for( GraphNodeSet set = from; set < to; set++ ) {
+        if( __builtin_popcount(set) != dp->layer )
+            continue;
+        if( dp->start >= 0 && !GraphNodeSet_is_in_set(set, dp->start) )
+            continue;
+
+        for( GraphNodeNum end = 0; end < self->num_nodes; end++ ) {
+            if( !GraphNodeSet_is_in_set(set, end) )
+                continue;
+
+            /* A path from start can't come back to it */
+            if( end == dp->start ) {
+                DP_COST(dp, set, end) = INFINITY;
+                continue;
+            }
+
+            GraphNodeSet before = GraphNodeSet_remove_from_set(set, end);
+            GraphCost cost = INFINITY;
+            for( GraphNodeNum prev = 0; prev < self->num_nodes; prev++ ) {
+                if( !GraphNodeSet_is_in_set(before, prev) )
+                    continue;
+
+                cost = MIN( cost, DP_COST(dp, before, prev) + Graph_edge_cost(self, prev, end) );
+            }
+
+            DP_COST(dp, set, end) = cost;
+        }
+    }
+}
+
+/* Held-Karp.  A round trip is the same from any start, so it starts at 0. */
+static GraphCost Graph_dp_route_cost(Graph *self, int start, bool return_to_start) {
+    GraphNodeNum num_nodes = self->num_nodes;
+
+    /* Same as the search, there's no route without somewhere to go */
+    if( num_nodes < 2 )
+        return INFINITY;
+
+    TRACE_BEGIN("Graph_dp_route_cost");
+
+    if( start < 0 && return_to_start )
+        start = 0;
+
+    long num_sets = 1L << num_nodes;
+    size_t size = num_sets * num_nodes * sizeof(GraphCost);
+    GraphDP dp = {
+        .graph = self,
+        .costs = bigbuf_new(size),
+        .start = start
+    };
+
+    for( GraphNodeNum node = 0; node < num_nodes; node++ ) {
+        bool can_start = start < 0 || node == start;
+        DP_COST(&dp, GraphNodeSet_mask(node), node) = can_start ? 0 : INFINITY;
+    }
+
+    for( dp.layer = 2; dp.layer <= num_nodes; dp.layer++ ) {
+        pool_for(1, num_sets, 4096, Graph_dp_layer, &dp);
+    }
+
+    GraphNodeSet all = GraphNodeSet_fill(num_nodes);
     GraphCost cost = INFINITY;
-    for(GraphNodeNum start = 0; start < self->num_nodes; start++) {
+    for( GraphNodeNum end = 0; end < num_nodes; end++ ) {
+        if( end == start )
+            continue;
+
+        GraphCost end_cost = DP_COST(&dp, all, end);
+        if( return_to_start )
+            end_cost += Graph_edge_cost(self, end, start);
+
+        cost = MIN( cost, end_cost );
+    }
+
+    bigbuf_free(dp.costs, size);
+
+    /* Each node of each set */
+    self->min_cost_calls = (long)num_nodes << (num_nodes - 1);
+    TRACE_COUNTER("Graph_dp_route_cost states", self->min_cost_calls);
+    TRACE_END("Graph_dp_route_cost");
+
+    return cost;
+}
+
+typedef struct {
+    GraphCost cost;
+    long min_cost_calls;
+} GraphRouteResult;
+
+typedef struct {
+    Graph *graph;
+    bool return_to_start;
+} GraphRouteSearch;
+
+static GraphCost Graph_route_cost_from(Graph *self, GraphNodeNum start, bool return_to_start, long *calls);
+
+static void Graph_shortest_route_cost_starts(long from, long to, void *_search, void *_result) {
+    GraphRouteSearch *search = _search;
+    GraphRouteResult *result = _result;
+
+    for( GraphNodeNum start = from; start < to; start++ ) {
         if( DEBUG )
             fprintf(stderr, "starting from %d\n", start);
 
-        GraphCost try_cost = Graph_shortest_route_cost_from(self, start, return_to_start);
+        GraphCost try_cost = Graph_route_cost_from(search->graph, start, search->return_to_start,
+                                                   &result->min_cost_calls);
 
         if( DEBUG )
-            fprintf(stderr, "cost: %.0f, try_cost: %.0f\n", cost, try_cost);
-        
-        cost = MIN( cost, try_cost );
+            fprintf(stderr, "cost: %.0f, try_cost: %.0f\n", result->cost, try_cost);
+
+        result->cost = MIN( result->cost, try_cost );
     }
+}
+
+static void Graph_shortest_route_cost_combine(void *_result, const void *_partial, void *data) {
+    GraphRouteResult *result = _result;
+    const GraphRouteResult *partial = _partial;
+
+    result->cost = MIN( result->cost, partial->cost );
+    result->min_cost_calls += partial->min_cost_calls;
+}
+
+/* Each starting node is an independent search, so they're spread
+   across the thread pool one at a time. */
+GraphCost Graph_shortest_route_cost(Graph *self, bool return_to_start) {
+    if( Graph_engine(self) == GRAPH_DP )
+        return Graph_dp_route_cost(self, -1, return_to_start);
+
+    TRACE_BEGIN("Graph_shortest_route_cost");
 
+    GraphRouteSearch search = { .graph = self, .return_to_start = return_to_start };
+    GraphRouteResult result = { .cost = INFINITY, .min_cost_calls = 0 };
+    pool_reduce(0, self->num_nodes, 1,
+                Graph_shortest_route_cost_starts, Graph_shortest_route_cost_combine,
+                &result, sizeof(result), &search);
+
+    self->min_cost_calls = result.min_cost_calls;
     if( DEBUG )
-        fprintf(stderr, "Graph_min_cost calls = %d\n", Graph_min_cost_Calls);
+        fprintf(stderr, "Graph_min_cost calls = %ld\n", result.min_cost_calls);
+
+    TRACE_COUNTER("Graph_min_cost calls", result.min_cost_calls);
+    TRACE_END("Graph_shortest_route_cost");
     
-    return cost;
+    return result.cost;
 }
 
 GraphCost Graph_shortest_route_cost_from(Graph *self, GraphNodeNum start, bool return_to_start) {
+    if( Graph_engine(self) == GRAPH_DP )
+        return Graph_dp_route_cost(self, start, return_to_start);
+
+    long calls = 0;
+    GraphCost cost = Graph_route_cost_from(self, start, return_to_start, &calls);
+
+    self->min_cost_calls = calls;
+
+    return cost;
+}
+
+static GraphCost Graph_route_cost_from(Graph *self, GraphNodeNum start, bool return_to_start, long *calls) {
     GraphCost cost = INFINITY;
 
+    TRACE_BEGIN("Graph_shortest_route_cost_from");
+
     for( GraphNodeNum end = 0; end < self->num_nodes; end++ ) {
         if( start == end )
             continue;
@@ -167,44 +341,46 @@ GraphCost Graph_shortest_route_cost_from(Graph *self, GraphNodeNum start, bool r
         GraphNodeSet visited = 0;
         visited = GraphNodeSet_fill(self->num_nodes);
 
-        GraphCost new_cost = Graph_min_cost(self, start, end, visited);
+        GraphCost new_cost = Graph_min_cost(self, calls, start, end, visited);
         if( return_to_start )
             new_cost += Graph_edge_cost(self, end, start);
         
         cost = MIN( cost, new_cost );
     }
 
+    TRACE_END("Graph_shortest_route_cost_from");
+
     return cost;
 }
 
+/* The node numbers are small, they're stored in the map's pointer */
 GraphNodeNum Graph_lookup(Graph *self, char *name) {
-    GHashTable *name2node = self->name2node;
-    GraphNodeNum *num = g_hash_table_lookup( name2node, name );
+    void *num;
+
+    if( !StrMap_lookup( self->name2node, name, &num ) )
+        die("There is no node named %s", name);
 
     if( DEBUG )
-        fprintf(stderr, "Graph_lookup(%p, %s) == %d\n", self, name, *num);
+        fprintf(stderr, "Graph_lookup(%p, %s) == %d\n", self, name, (GraphNodeNum)(uintptr_t)num);
     
-    return *num;
+    return (uintptr_t)num;
 }
 
 GraphNodeNum Graph_lookup_or_add(Graph *self, char *name) {
-    GHashTable *name2node = self->name2node;
-    GraphNodeNum *num = g_hash_table_lookup( name2node, name );
-    
-    if( !num ) {
-        num = malloc(sizeof(num));
-        *num = self->num_nodes;
+    void *num;
 
-        char *name_dup = strdup(name);
-        
-        g_hash_table_insert( name2node, name_dup, num );
+    if( StrMap_lookup( self->name2node, name, &num ) )
+        return (uintptr_t)num;
 
-        self->node2name[*num] = name_dup;
-        
-        self->num_nodes++;
-    }
+    GraphNodeNum new_num = self->num_nodes;
+    char *name_dup = strdup(name);
+
+    StrMap_put( self->name2node, name_dup, (void *)(uintptr_t)new_num );
+    self->node2name[new_num] = name_dup;
+
+    self->num_nodes++;
 
-    return *num;
+    return new_num;
 }
 
 void Graph_add(Graph *self, GraphNodeNum from, GraphNodeNum to, GraphCost cost) {
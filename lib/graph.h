@@ -3,6 +3,7 @@
 
 #include "common.h"
 #include <stdint.h>
+#include "map.h"
 #include <glib.h>
 #include <math.h>
 
@@ -20,13 +21,30 @@ typedef uint8_t GraphNodeNum;
 typedef int GraphNodeSet;
 
 typedef struct {
-    GHashTable *name2node;
+    StrMap *name2node;
     char **node2name;
     GraphCost *nodes;
     GraphNodeNum max_nodes;
     GraphNodeNum num_nodes;
+
+    /* How much work the last route search did */
+    long min_cost_calls;
 } Graph;
 
+/* The ways to find the shortest route, picked by size through tune.h.
+   GRAPH_SEARCH tries every route, which is quickest for a few nodes.
+   GRAPH_DP is Held-Karp, the cheapest path through each subset of the
+   nodes ending at each node, 2^n * n^2 time and 2^n * n memory. */
+typedef enum {
+    GRAPH_SEARCH,
+    GRAPH_DP
+} GraphEngine;
+
+extern const char *Graph_Engines[];
+
+/* Past this GRAPH_DP's table won't fit, GRAPH_SEARCH is used */
+#define GRAPH_DP_MAX_NODES 20
+
 Graph *Graph_new(GraphNodeNum max_nodes);
 void Graph_destroy(Graph *self);
 GraphCost Graph_shortest_route_cost(Graph *self, bool return_to_start);
@@ -0,0 +1,113 @@
+#include "common.h"
+#include "grid.h"
+#include "bigbuf.h"
+#include "pool.h"
+
+const char *Grid_Layout_Names[] = {
+    [GRID_ROWS]   = "rows",
+    [GRID_TILED]  = "tiled",
+    [GRID_MORTON] = "morton",
+    NULL
+};
+
+#define NUM_GRID_LAYOUTS (sizeof(Grid_Layout_Names) / sizeof(Grid_Layout_Names[0]) - 1)
+
+const char *grid_layout_name(GridLayout layout) {
+    if( layout < 0 || layout >= NUM_GRID_LAYOUTS )
+        return "unknown";
+
+    return Grid_Layout_Names[layout];
+}
+
+int grid_layout_from_name(const char *name) {
+    for( size_t layout = 0; layout < NUM_GRID_LAYOUTS; layout++ ) {
+        if( streq(name, Grid_Layout_Names[layout]) )
+            return layout;
+    }
+
+    return -1;
+}
+
+GridLayout grid_layout(GridLayout want) {
+    const char *name = getenv("ADVENT_GRID");
+    if( !name || is_empty(name) )
+        return want;
+
+    int layout = grid_layout_from_name(name);
+    if( layout < 0 )
+        die("Unknown ADVENT_GRID '%s', try rows, tiled or morton", name);
+
+    return layout;
+}
+
+static size_t round_up(size_t size, size_t to) {
+    return (size + to - 1) / to * to;
+}
+
+static size_t next_pow2(size_t size) {
+    size_t pow2 = 1;
+    while( pow2 < size )
+        pow2 *= 2;
+
+    return pow2;
+}
+
+Grid *Grid_new(size_t rows, size_t cols, size_t elem_size, GridLayout layout, size_t halo) {
+    Grid *self = malloc(sizeof(Grid));
+    size_t all_rows = rows + 2 * halo;
+    size_t all_cols = cols + 2 * halo;
+    size_t num_cells = 0;
+
+    self->layout    = layout;
+    self->rows      = rows;
+    self->cols      = cols;
+    self->halo      = halo;
+    self->elem_size = elem_size;
+
+    switch( layout ) {
+        case GRID_ROWS:
+            self->stride = all_cols;
+            num_cells = all_rows * all_cols;
+            break;
+        case GRID_TILED:
+            self->stride = round_up(all_cols, GRID_TILE) / GRID_TILE;
+            num_cells = round_up(all_rows, GRID_TILE) * self->stride * GRID_TILE;
+            break;
+        case GRID_MORTON: {
+            size_t side = next_pow2(all_rows > all_cols ? all_rows : all_cols);
+            self->stride = side;
+            num_cells = side * side;
+            break;
+        }
+        default:
+            die("Unknown grid layout %d", layout);
+    }
+
+    self->size  = num_cells * elem_size;
+    self->cells = bigbuf_new(self->size);
+
+    return self;
+}
+
+void Grid_destroy(Grid *self) {
+    bigbuf_free(self->cells, self->size);
+    free(self);
+}
+
+void Grid_clear(Grid *self) {
+    memset(self->cells, 0, self->size);
+}
+
+static void Grid_touch_rows(long from, long to, void *_self) {
+    Grid *self = _self;
+
+    for( long row = from; row < to; row++ ) {
+        for( long col = 0; col < (long)self->cols; col++ ) {
+            memset(Grid_ptr(self, row, col), 0, self->elem_size);
+        }
+    }
+}
+
+void Grid_touch(Grid *self, long grain) {
+    pool_for(0, self->rows, grain, Grid_touch_rows, self);
+}
@@ -0,0 +1,131 @@
+#ifndef _grid_h
+#define _grid_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A 2D grid of fixed size cells, in one of several memory layouts
+   behind the same accessors.
+
+   GRID_ROWS is plain row major, the same as TWOD().  Best when the
+   work sweeps along rows.
+
+   GRID_TILED stores GRID_TILE x GRID_TILE blocks, each contiguous, the
+   blocks in row major order.  Cells above and below each other are
+   usually in the same block, so a stencil touches fewer cache lines
+   and pages, and the stride doesn't alias in the cache whatever the
+   width.
+
+   GRID_MORTON is Z-order, the bits of the row and column interleaved.
+   Neighbors are close at every scale, but the grid is padded out to a
+   power of two square.
+
+   A grid can have a halo, extra zeroed cells on every side, so row
+   and column can go from -halo to rows + halo - 1.  A stencil can then
+   read its neighbors at the edges without checking bounds.
+
+   The cells start zeroed.  Grid_at() is the accessor:
+
+       Grid *grid = Grid_new(rows, cols, sizeof(short), GRID_TILED, 1);
+       Grid_at(grid, short, row, col) = 1;
+
+   Grid_at() checks the layout on every access, which costs in a hot
+   loop.  Write the loop as an inline function using Grid_at_in() with
+   the layout as an argument, and call it once per layout with a
+   constant, then each copy is compiled for its own layout.  See
+   Lights_step_rows() in day 18.
+
+   Set ADVENT_GRID to rows, tiled or morton to override the layout a
+   day picked through grid_layout(), to compare them. */
+
+typedef enum {
+    GRID_ROWS,
+    GRID_TILED,
+    GRID_MORTON
+} GridLayout;
+
+#define GRID_TILE_BITS 6
+#define GRID_TILE      (1 << GRID_TILE_BITS)
+
+typedef struct {
+    GridLayout layout;
+    size_t rows;
+    size_t cols;
+    size_t halo;
+    size_t elem_size;
+
+    /* Cells per padded row for GRID_ROWS, tiles per row of tiles for
+       GRID_TILED */
+    size_t stride;
+
+    char *cells;
+    size_t size;
+} Grid;
+
+Grid *Grid_new(size_t rows, size_t cols, size_t elem_size, GridLayout layout, size_t halo);
+void Grid_destroy(Grid *self);
+void Grid_clear(Grid *self);
+/* First write each row from the pool thread which gets it in
+   pool_for(0, rows, grain), see bigbuf.h */
+void Grid_touch(Grid *self, long grain);
+
+/* Indexed by GridLayout and NULL terminated, an engine table for
+   tune_engine() */
+extern const char *Grid_Layout_Names[];
+
+/* The layout, unless ADVENT_GRID says otherwise */
+GridLayout grid_layout(GridLayout want);
+const char *grid_layout_name(GridLayout layout);
+/* -1 if it isn't one */
+int grid_layout_from_name(const char *name);
+
+/* Spread the low 32 bits out to the even bits */
+static inline uint64_t grid_spread_bits(uint64_t x) {
+    x &= 0xffffffff;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+    x = (x | (x << 8))  & 0x00ff00ff00ff00ffULL;
+    x = (x | (x << 4))  & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | (x << 2))  & 0x3333333333333333ULL;
+    x = (x | (x << 1))  & 0x5555555555555555ULL;
+
+    return x;
+}
+
+/* The cell number of row, col, counting the halo */
+static inline size_t Grid_cell_in(const Grid *self, GridLayout layout, long row, long col) {
+    size_t r = row + self->halo;
+    size_t c = col + self->halo;
+
+    switch( layout ) {
+        case GRID_TILED: {
+            size_t tile = (r >> GRID_TILE_BITS) * self->stride + (c >> GRID_TILE_BITS);
+            size_t in_tile = ((r & (GRID_TILE - 1)) << GRID_TILE_BITS) | (c & (GRID_TILE - 1));
+            return (tile << (2 * GRID_TILE_BITS)) | in_tile;
+        }
+        case GRID_MORTON:
+            return (grid_spread_bits(r) << 1) | grid_spread_bits(c);
+        case GRID_ROWS:
+        default:
+            return r * self->stride + c;
+    }
+}
+
+static inline size_t Grid_cell(const Grid *self, long row, long col) {
+    return Grid_cell_in(self, self->layout, row, col);
+}
+
+static inline void *Grid_ptr(const Grid *self, long row, long col) {
+    return self->cells + Grid_cell(self, row, col) * self->elem_size;
+}
+
+#define Grid_at(grid, type, row, col) \
+    (((type *)(void *)(grid)->cells)[Grid_cell((grid), (row), (col))])
+#define Grid_at_in(grid, type, layout, row, col) \
+    (((type *)(void *)(grid)->cells)[Grid_cell_in((grid), (layout), (row), (col))])
+
+static inline bool Grid_in_bounds(const Grid *self, long row, long col) {
+    return row >= 0 && col >= 0 && (size_t)row < self->rows && (size_t)col < self->cols;
+}
+
+#endif
@@ -0,0 +1,263 @@
+#include "common.h"
+#include "map.h"
+
+#define MAP_MIN_SIZE 16
+
+/* Grow past 3/4 full, probe chains get long after that */
+static inline bool map_too_full(size_t size, size_t mask) {
+    return (size + 1) * 4 > (mask + 1) * 3;
+}
+
+static size_t map_capacity(size_t expected) {
+    size_t capacity = MAP_MIN_SIZE;
+
+    while( map_too_full(expected, capacity - 1) )
+        capacity *= 2;
+
+    return capacity;
+}
+
+/* The splitmix64 finalizer, so keys which differ in only the high bits
+   still spread over the low ones */
+static inline uint64_t hash_int(int64_t key) {
+    uint64_t hash = key;
+
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+
+    return hash;
+}
+
+/* FNV-1a */
+static inline uint64_t hash_str(const char *key) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for( ; *key; key++ ) {
+        hash ^= (unsigned char)*key;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/* -------- IntMap -------- */
+
+IntMap *IntMap_new(size_t expected) {
+    IntMap *self = malloc(sizeof(IntMap));
+    size_t capacity = map_capacity(expected);
+
+    self->entries = malloc(capacity * sizeof(IntMapEntry));
+    self->used    = calloc(capacity, sizeof(uint8_t));
+    self->size    = 0;
+    self->mask    = capacity - 1;
+
+    return self;
+}
+
+void IntMap_destroy(IntMap *self) {
+    free(self->entries);
+    free(self->used);
+    free(self);
+}
+
+/* Where the key is, or the empty slot where it would go */
+static inline size_t IntMap_slot(IntMap *self, int64_t key) {
+    size_t slot = hash_int(key) & self->mask;
+
+    while( self->used[slot] && self->entries[slot].key != key )
+        slot = (slot + 1) & self->mask;
+
+    return slot;
+}
+
+static void IntMap_grow(IntMap *self) {
+    IntMapEntry *old_entries = self->entries;
+    uint8_t *old_used = self->used;
+    size_t old_capacity = self->mask + 1;
+
+    self->entries = malloc(old_capacity * 2 * sizeof(IntMapEntry));
+    self->used    = calloc(old_capacity * 2, sizeof(uint8_t));
+    self->mask    = old_capacity * 2 - 1;
+
+    for( size_t i = 0; i < old_capacity; i++ ) {
+        if( !old_used[i] )
+            continue;
+
+        size_t slot = IntMap_slot(self, old_entries[i].key);
+        self->entries[slot] = old_entries[i];
+        self->used[slot] = 1;
+    }
+
+    free(old_entries);
+    free(old_used);
+}
+
+bool IntMap_put(IntMap *self, int64_t key, int64_t value) {
+    size_t slot = IntMap_slot(self, key);
+
+    if( self->used[slot] ) {
+        self->entries[slot].value = value;
+        return false;
+    }
+
+    if( map_too_full(self->size, self->mask) ) {
+        IntMap_grow(self);
+        slot = IntMap_slot(self, key);
+    }
+
+    self->entries[slot].key   = key;
+    self->entries[slot].value = value;
+    self->used[slot] = 1;
+    self->size++;
+
+    return true;
+}
+
+bool IntMap_get(IntMap *self, int64_t key, int64_t *value) {
+    size_t slot = IntMap_slot(self, key);
+
+    if( !self->used[slot] )
+        return false;
+
+    if( value )
+        *value = self->entries[slot].value;
+
+    return true;
+}
+
+bool IntMap_has(IntMap *self, int64_t key) {
+    return IntMap_get(self, key, NULL);
+}
+
+/* -------- StrMap -------- */
+
+StrMap *StrMap_new(size_t expected) {
+    StrMap *self = malloc(sizeof(StrMap));
+    size_t capacity = map_capacity(expected);
+
+    self->entries = calloc(capacity, sizeof(StrMapEntry));
+    self->size    = 0;
+    self->mask    = capacity - 1;
+
+    return self;
+}
+
+void StrMap_destroy(StrMap *self, StrMapFreeFunc free_value) {
+    if( free_value ) {
+        for( size_t i = 0; i <= self->mask; i++ ) {
+            if( self->entries[i].key )
+                free_value(self->entries[i].value);
+        }
+    }
+
+    free(self->entries);
+    free(self);
+}
+
+/* The hash is checked first, so a miss rarely reaches strcmp() */
+static inline size_t StrMap_slot(StrMap *self, const char *key, uint64_t hash) {
+    size_t slot = hash & self->mask;
+
+    for(;;) {
+        StrMapEntry *entry = &self->entries[slot];
+        if( !entry->key )
+            return slot;
+        if( entry->hash == hash && streq(entry->key, key) )
+            return slot;
+
+        slot = (slot + 1) & self->mask;
+    }
+}
+
+static void StrMap_grow(StrMap *self) {
+    StrMapEntry *old_entries = self->entries;
+    size_t old_capacity = self->mask + 1;
+
+    self->entries = calloc(old_capacity * 2, sizeof(StrMapEntry));
+    self->mask    = old_capacity * 2 - 1;
+
+    for( size_t i = 0; i < old_capacity; i++ ) {
+        if( !old_entries[i].key )
+            continue;
+
+        size_t slot = old_entries[i].hash & self->mask;
+        while( self->entries[slot].key )
+            slot = (slot + 1) & self->mask;
+        self->entries[slot] = old_entries[i];
+    }
+
+    free(old_entries);
+}
+
+bool StrMap_put(StrMap *self, const char *key, void *value) {
+    uint64_t hash = hash_str(key);
+    size_t slot = StrMap_slot(self, key, hash);
+
+    if( self->entries[slot].key ) {
+        self->entries[slot].value = value;
+        return false;
+    }
+
+    if( map_too_full(self->size, self->mask) ) {
+        StrMap_grow(self);
+        slot = StrMap_slot(self, key, hash);
+    }
+
+    self->entries[slot] = (StrMapEntry){ .key = key, .value = value, .hash = hash };
+    self->size++;
+
+    return true;
+}
+
+bool StrMap_lookup(StrMap *self, const char *key, void **value) {
+    size_t slot = StrMap_slot(self, key, hash_str(key));
+
+    if( !self->entries[slot].key )
+        return false;
+
+    if( value )
+        *value = self->entries[slot].value;
+
+    return true;
+}
+
+void *StrMap_get(StrMap *self, const char *key) {
+    void *value = NULL;
+
+    StrMap_lookup(self, key, &value);
+
+    return value;
+}
+
+void StrMap_foreach(StrMap *self, StrMapFunc func, void *data) {
+    for( size_t i = 0; i <= self->mask; i++ ) {
+        StrMapEntry *entry = &self->entries[i];
+        if( entry->key )
+            func(entry->key, entry->value, data);
+    }
+}
+
+static int cmp_entry_keys(const void *a, const void *b) {
+    return strcmp((*(StrMapEntry **)a)->key, (*(StrMapEntry **)b)->key);
+}
+
+void StrMap_foreach_sorted(StrMap *self, StrMapFunc func, void *data) {
+    StrMapEntry **sorted = malloc(self->size * sizeof(StrMapEntry *));
+    size_t num = 0;
+
+    for( size_t i = 0; i <= self->mask; i++ ) {
+        if( self->entries[i].key )
+            sorted[num++] = &self->entries[i];
+    }
+
+    qsort(sorted, num, sizeof(StrMapEntry *), cmp_entry_keys);
+
+    for( size_t i = 0; i < num; i++ ) {
+        func(sorted[i]->key, sorted[i]->value, data);
+    }
+
+    free(sorted);
+}
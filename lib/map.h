@@ -0,0 +1,77 @@
+#ifndef _map_h
+#define _map_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Open addressing hash maps for the hot paths, instead of GHashTable.
+
+   Entries live in one flat array probed linearly, so a lookup is a
+   hash and usually a single cache line, with no node per entry.
+
+   IntMap has int64_t keys and values stored inline, no boxing.  Use it
+   as a set by ignoring the values.
+
+   StrMap has string keys and pointer values.  It doesn't copy or free
+   the keys, they must live as long as the map, which is usually true
+   because the value holds its own name.
+
+   Neither supports removal, nothing needs it yet. */
+
+typedef struct {
+    int64_t key;
+    int64_t value;
+} IntMapEntry;
+
+typedef struct {
+    IntMapEntry *entries;
+    uint8_t *used;
+    size_t size;
+    size_t mask;
+} IntMap;
+
+IntMap *IntMap_new(size_t expected);
+void IntMap_destroy(IntMap *self);
+/* True if the key is new */
+bool IntMap_put(IntMap *self, int64_t key, int64_t value);
+bool IntMap_get(IntMap *self, int64_t key, int64_t *value);
+bool IntMap_has(IntMap *self, int64_t key);
+
+static inline size_t IntMap_size(IntMap *self) {
+    return self->size;
+}
+
+typedef struct {
+    const char *key;
+    void *value;
+    uint64_t hash;
+} StrMapEntry;
+
+typedef struct {
+    StrMapEntry *entries;
+    size_t size;
+    size_t mask;
+} StrMap;
+
+typedef void (*StrMapFunc)(const char *key, void *value, void *data);
+typedef void (*StrMapFreeFunc)(void *value);
+
+StrMap *StrMap_new(size_t expected);
+/* free_value may be NULL */
+void StrMap_destroy(StrMap *self, StrMapFreeFunc free_value);
+/* Replaces any value already there, true if the key is new */
+bool StrMap_put(StrMap *self, const char *key, void *value);
+/* NULL if it's not there */
+void *StrMap_get(StrMap *self, const char *key);
+/* For when NULL is a value */
+bool StrMap_lookup(StrMap *self, const char *key, void **value);
+void StrMap_foreach(StrMap *self, StrMapFunc func, void *data);
+/* In strcmp order */
+void StrMap_foreach_sorted(StrMap *self, StrMapFunc func, void *data);
+
+static inline size_t StrMap_size(StrMap *self) {
+    return self->size;
+}
+
+#endif
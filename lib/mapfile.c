@@ -0,0 +1,77 @@
+#include "common.h"
+#include "mapfile.h"
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAPFILE_READ_SIZE (1024 * 1024)
+
+/* Only a regular file read from its start, with nothing in stdio's
+   buffer, can be mapped as it is */
+static bool can_map(FILE *fp, struct stat *st) {
+    int fd = fileno(fp);
+    if( fd < 0 || fstat(fd, st) != 0 || !S_ISREG(st->st_mode) || st->st_size == 0 )
+        return false;
+
+    return ftello(fp) == 0;
+}
+
+static void MappedFile_read(MappedFile *self, FILE *fp) {
+    size_t size = MAPFILE_READ_SIZE;
+    char *data = malloc(size);
+    size_t len = 0;
+    size_t got;
+
+    while( (got = fread(data + len, 1, size - len, fp)) > 0 ) {
+        len += got;
+        if( len == size ) {
+            size *= 2;
+            data = realloc(data, size);
+        }
+    }
+
+    if( ferror(fp) ) {
+        int error = errno;
+        free(data);
+        free(self);
+        die("Could not read the input: %s", strerror(error));
+    }
+
+    self->data = data;
+    self->len  = len;
+}
+
+MappedFile *MappedFile_new(FILE *fp) {
+    MappedFile *self = calloc(1, sizeof(MappedFile));
+    struct stat st;
+
+    if( !can_map(fp, &st) ) {
+        MappedFile_read(self, fp);
+        return self;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if( data == MAP_FAILED ) {
+        MappedFile_read(self, fp);
+        return self;
+    }
+
+#ifdef MADV_SEQUENTIAL
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+#endif
+
+    self->data   = data;
+    self->len    = st.st_size;
+    self->mapped = true;
+
+    return self;
+}
+
+void MappedFile_destroy(MappedFile *self) {
+    if( self->mapped )
+        munmap((void *)self->data, self->len);
+    else
+        free((void *)self->data);
+
+    free(self);
+}
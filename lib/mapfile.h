@@ -0,0 +1,27 @@
+#ifndef _mapfile_h
+#define _mapfile_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* All of a file in memory at once, for solvers which scan the input as
+   one buffer rather than line by line.
+
+   A regular file is mapped read only and marked for sequential reading,
+   so even a gigabyte input isn't copied and costs no memory beyond the
+   page cache.  Anything else, such as the pipe from a compressed input,
+   is read into a buffer which grows as it goes.
+
+   It starts from where fp is.  The data is not \0 terminated. */
+
+typedef struct {
+    const char *data;
+    size_t len;
+    bool mapped;
+} MappedFile;
+
+MappedFile *MappedFile_new(FILE *fp);
+void MappedFile_destroy(MappedFile *self);
+
+#endif
@@ -0,0 +1,187 @@
+#include "common.h"
+#include "phase.h"
+#include "trace.h"
+#include "counters.h"
+#include "alloc.h"
+#include "solve.h"
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define MAX_PHASE_DEPTH 16
+
+typedef struct {
+    double wall;
+    double cpu;
+    long rss_kb;
+} PhaseTimes;
+
+typedef struct {
+    const char *name;
+    PhaseTimes times;
+    long items;
+    CounterValues counters;
+    AllocStats allocs;
+    int64_t outer_peak;
+} Phase;
+
+bool Phase_Stats = false;
+
+static _Thread_local Phase Phases[MAX_PHASE_DEPTH];
+static _Thread_local int Phase_Depth = 0;
+/* See phase_add_cpu() */
+static _Thread_local double Helped_Cpu = 0;
+
+void phase_stats_enable() {
+    Phase_Stats = true;
+}
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* What's resident now, not the peak, so a phase can shrink it.  Read
+   without stdio, so --allocs doesn't see us. */
+static long rss_kb() {
+    char buf[128];
+    long size, pages;
+
+    int fd = open("/proc/self/statm", O_RDONLY);
+    if( fd >= 0 ) {
+        ssize_t len = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+
+        if( len > 0 ) {
+            buf[len] = '\0';
+            if( sscanf(buf, "%ld %ld", &size, &pages) == 2 )
+                return pages * (sysconf(_SC_PAGESIZE) / 1024);
+        }
+    }
+
+    /* Not Linux, the peak will have to do */
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+double phase_thread_cpu() {
+    return clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void phase_add_cpu(double seconds) {
+    Helped_Cpu += seconds;
+}
+
+/* Not the whole process's CPU, that's every solve's in a threaded batch */
+static void phase_times(PhaseTimes *times) {
+    times->rss_kb = rss_kb();
+    times->cpu    = phase_thread_cpu() + Helped_Cpu;
+    times->wall   = clock_seconds(CLOCK_MONOTONIC);
+}
+
+static void phase_times_print(FILE *out, Phase *phase, PhaseTimes *end) {
+    fprintf(out, " wall=%.6f cpu=%.6f rss=%+ld",
+            end->wall - phase->times.wall,
+            end->cpu  - phase->times.cpu,
+            end->rss_kb - phase->times.rss_kb);
+
+    if( phase->items >= 0 )
+        fprintf(out, " items=%ld", phase->items);
+    else
+        fprintf(out, " items=n/a");
+}
+
+void phase_items(long items) {
+    solve_items(items);
+
+    if( Phase_Depth <= 0 )
+        return;
+
+    Phase *phase = &Phases[Phase_Depth - 1];
+    phase->items = phase->items < 0 ? items : phase->items + items;
+}
+
+void phase_begin(const char *name) {
+    TRACE_BEGIN(name);
+
+    if( Phase_Depth >= MAX_PHASE_DEPTH )
+        die("Phase %s is nested too deep", name);
+
+    Phase *phase = &Phases[Phase_Depth++];
+    phase->name = name;
+    phase->items = -1;
+
+    if( Alloc_Tracking ) {
+        alloc_stats(&phase->allocs);
+        phase->outer_peak = alloc_peak_reset();
+    }
+
+    if( Phase_Stats )
+        phase_times(&phase->times);
+
+    /* Last, so the counters don't count us */
+    if( Counters_Enabled )
+        counters_read(&phase->counters);
+}
+
+void phase_end(const char *name) {
+    CounterValues counters;
+    AllocStats allocs;
+    PhaseTimes times;
+
+    /* First, so the counters don't count us */
+    if( Counters_Enabled )
+        counters_read(&counters);
+
+    if( Phase_Stats )
+        phase_times(&times);
+
+    if( Phase_Depth <= 0 )
+        die("Phase %s ended but never began", name);
+
+    Phase *phase = &Phases[--Phase_Depth];
+    if( !streq(phase->name, name) )
+        die("Phase %s ended inside phase %s", name, phase->name);
+
+    if( Alloc_Tracking ) {
+        alloc_stats(&allocs);
+        alloc_peak_restore(phase->outer_peak);
+    }
+
+    if( Phase_Stats || Counters_Enabled || Alloc_Tracking ) {
+        fprintf(stderr, "phase %s:", name);
+        if( Phase_Stats )
+            phase_times_print(stderr, phase, &times);
+        if( Counters_Enabled )
+            counters_print(stderr, &phase->counters, &counters);
+        if( Alloc_Tracking )
+            alloc_print(stderr, &phase->allocs, &allocs);
+        fputc('\n', stderr);
+    }
+
+    TRACE_END(name);
+}
+
+int phase_depth() {
+    return Phase_Depth;
+}
+
+/* Like phase_end() for each, but nothing is reported */
+void phase_abandon(int depth) {
+    while( Phase_Depth > depth ) {
+        Phase *phase = &Phases[--Phase_Depth];
+
+        if( Alloc_Tracking )
+            alloc_peak_restore(phase->outer_peak);
+
+        TRACE_END(phase->name);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef _phase_h
+#define _phase_h
+
+#include <stdbool.h>
+
+/* The named phases of a solver, such as "parse" and "solve".
+
+   Every phase is traced (see trace.h).  With --stats, --counters or
+   --allocs each phase also reports to stderr as one line
+
+       phase <name>: wall=... cpu=... rss=... items=... cycles=... allocs=...
+
+   --stats gives the wall clock and CPU seconds, the change in resident
+   memory in kB, and how many items the phase worked through, or n/a if
+   it doesn't say.  The CPU is this thread's, plus what pool threads
+   spent on its pool_for() loops and pipeline stages on its
+   pipeline_run(), so solves on other threads don't count.  A
+   Readahead's thread isn't counted.  What an item is is up to the day: a gate, a line, a
+   light.  --counters adds the hardware counters (see counters.h) and
+   --allocs the allocations (see alloc.h).  The fields are always in
+   that order, so lines from different days can be compared.
+
+   Phases nest, and must end in the order they began.  Names must be
+   string constants. */
+
+extern bool Phase_Stats;
+
+void phase_stats_enable();
+
+void phase_begin(const char *name);
+void phase_end(const char *name);
+
+/* Count items worked through by the innermost phase */
+void phase_items(long items);
+
+/* This thread's CPU seconds so far */
+double phase_thread_cpu();
+/* CPU seconds another thread spent working for this one, counted in
+   this thread's phases from now on */
+void phase_add_cpu(double seconds);
+
+/* How many phases this thread is in */
+int phase_depth();
+/* End the phases begun since phase_depth() was depth, for a solve
+   which died part way (see solve.h) */
+void phase_abandon(int depth);
+
+#endif
@@ -0,0 +1,416 @@
+#include "common.h"
+#include "counters.h"
+#include "phase.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "solve.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* -------- SpscQueue -------- */
+
+/* A ring of pointers with one thread pushing and one popping.  Each
+   side owns its own index and only reads the other's, so there are no
+   locks and no compare and swap.  The indexes are on separate cache
+   lines so the two threads don't fight over one.
+
+   The lock is only for a side which has waited long enough to sleep,
+   see SpscQueue_sleep(). */
+typedef struct {
+    void **slots;
+    size_t mask;
+    char pad0[64 - sizeof(void **) - sizeof(size_t)];
+    atomic_size_t head;
+    char pad1[64 - sizeof(atomic_size_t)];
+    atomic_size_t tail;
+    char pad2[64 - sizeof(atomic_size_t)];
+
+    atomic_int sleepers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} SpscQueue;
+
+static void SpscQueue_init(SpscQueue *self, size_t capacity) {
+    size_t size = 1;
+    while( size < capacity )
+        size *= 2;
+
+    self->slots = calloc(size, sizeof(void *));
+    self->mask  = size - 1;
+    atomic_init(&self->head, 0);
+    atomic_init(&self->tail, 0);
+    atomic_init(&self->sleepers, 0);
+    pthread_mutex_init(&self->lock, NULL);
+    pthread_cond_init(&self->wake, NULL);
+}
+
+static void SpscQueue_free(SpscQueue *self) {
+    free(self->slots);
+    pthread_mutex_destroy(&self->lock);
+    pthread_cond_destroy(&self->wake);
+}
+
+static bool SpscQueue_full(SpscQueue *self) {
+    size_t head = atomic_load_explicit(&self->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+
+    return tail - head > self->mask;
+}
+
+static bool SpscQueue_empty(SpscQueue *self) {
+    size_t head = atomic_load_explicit(&self->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+
+    return head == tail;
+}
+
+static bool SpscQueue_try_push(SpscQueue *self, void *item) {
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&self->head, memory_order_acquire);
+
+    if( tail - head > self->mask )
+        return false;
+
+    self->slots[tail & self->mask] = item;
+    atomic_store_explicit(&self->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+static bool SpscQueue_try_pop(SpscQueue *self, void **item) {
+    size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+
+    if( head == tail )
+        return false;
+
+    *item = self->slots[head & self->mask];
+    atomic_store_explicit(&self->head, head + 1, memory_order_release);
+
+    return true;
+}
+
+/* Spin a little, the other side is usually just about to get there,
+   then sleep until it does.  A stage stuck behind a slow one, like the
+   reader on a pipe which has gone quiet, doesn't burn a CPU. */
+#define SPSC_SPINS 64
+
+static inline void spsc_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/* The sleeper says it's sleeping before it checks again, the other side
+   moves its index before it checks for sleepers.  With a fence between
+   each pair at least one of them sees the other, so a wake can't be
+   lost between the check and the wait. */
+static void SpscQueue_sleep(SpscQueue *self, bool (*blocked)(SpscQueue *)) {
+    pthread_mutex_lock(&self->lock);
+    atomic_fetch_add(&self->sleepers, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    while( blocked(self) )
+        pthread_cond_wait(&self->wake, &self->lock);
+
+    atomic_fetch_sub(&self->sleepers, 1);
+    pthread_mutex_unlock(&self->lock);
+}
+
+static void SpscQueue_wake(SpscQueue *self) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if( atomic_load_explicit(&self->sleepers, memory_order_relaxed) == 0 )
+        return;
+
+    pthread_mutex_lock(&self->lock);
+    pthread_cond_signal(&self->wake);
+    pthread_mutex_unlock(&self->lock);
+}
+
+/* Returns true if it had to wait */
+static bool SpscQueue_push(SpscQueue *self, void *item) {
+    int tries = 0;
+
+    while( !SpscQueue_try_push(self, item) ) {
+        if( tries++ < SPSC_SPINS )
+            spsc_relax();
+        else
+            SpscQueue_sleep(self, SpscQueue_full);
+    }
+    SpscQueue_wake(self);
+
+    return tries > 0;
+}
+
+static bool SpscQueue_pop(SpscQueue *self, void **item) {
+    int tries = 0;
+
+    while( !SpscQueue_try_pop(self, item) ) {
+        if( tries++ < SPSC_SPINS )
+            spsc_relax();
+        else
+            SpscQueue_sleep(self, SpscQueue_empty);
+    }
+    SpscQueue_wake(self);
+
+    return tries > 0;
+}
+
+/* -------- Batches -------- */
+
+typedef struct {
+    /* The lines, each with its \0, one after another */
+    char *text;
+    size_t text_used;
+    size_t text_size;
+    size_t *starts;
+    size_t num_lines;
+    bool last;
+} LineBatch;
+
+typedef struct {
+    char *records;
+    size_t num_records;
+    bool last;
+} RecordBatch;
+
+typedef struct {
+    const Pipeline *pipeline;
+    size_t batch_lines;
+    FILE *fp;
+
+    SpscQueue full_lines;
+    SpscQueue free_lines;
+    SpscQueue full_records;
+    SpscQueue free_records;
+
+    /* Each only written by its own stage */
+    long read_waits;
+    long parse_waits;
+    long fold_waits;
+    long batches;
+    /* With --stats, the reader's and parser's CPU seconds */
+    double read_cpu;
+    double parse_cpu;
+    /* With --counters, theirs from start to end */
+    CounterValues read_counters[2];
+    CounterValues parse_counters[2];
+} PipelineRun;
+
+static LineBatch *LineBatch_new(size_t batch_lines) {
+    LineBatch *self = malloc(sizeof(LineBatch));
+
+    self->text_size = batch_lines * 16;
+    self->text      = malloc(self->text_size);
+    self->starts    = malloc(batch_lines * sizeof(size_t));
+
+    return self;
+}
+
+static void LineBatch_free(LineBatch *self) {
+    free(self->text);
+    free(self->starts);
+    free(self);
+}
+
+static void LineBatch_add(LineBatch *self, const char *line, size_t len) {
+    if( self->text_used + len + 1 > self->text_size ) {
+        while( self->text_used + len + 1 > self->text_size )
+            self->text_size *= 2;
+        self->text = realloc(self->text, self->text_size);
+    }
+
+    self->starts[self->num_lines++] = self->text_used;
+    memcpy(self->text + self->text_used, line, len + 1);
+    self->text_used += len + 1;
+}
+
+static RecordBatch *RecordBatch_new(size_t batch_lines, size_t record_size) {
+    RecordBatch *self = malloc(sizeof(RecordBatch));
+
+    self->records = malloc(batch_lines * record_size);
+
+    return self;
+}
+
+static void RecordBatch_free(RecordBatch *self) {
+    free(self->records);
+    free(self);
+}
+
+/* -------- Stages -------- */
+
+static void *pipeline_reader(void *arg) {
+    PipelineRun *run = arg;
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    bool done = false;
+
+    if( Counters_Enabled )
+        counters_read(&run->read_counters[0]);
+
+    while( !done ) {
+        void *item;
+        run->read_waits += SpscQueue_pop(&run->free_lines, &item);
+        LineBatch *batch = item;
+
+        batch->text_used = 0;
+        batch->num_lines = 0;
+        while( batch->num_lines < run->batch_lines ) {
+            if( (len = getline(&line, &line_size, run->fp)) <= 0 ) {
+                done = true;
+                break;
+            }
+            LineBatch_add(batch, line, len);
+        }
+
+        batch->last = done;
+        SpscQueue_push(&run->full_lines, batch);
+    }
+
+    free(line);
+    if( Phase_Stats )
+        run->read_cpu = phase_thread_cpu();
+    if( Counters_Enabled )
+        counters_read(&run->read_counters[1]);
+
+    return NULL;
+}
+
+static void *pipeline_parser(void *arg) {
+    PipelineRun *run = arg;
+    const Pipeline *pipeline = run->pipeline;
+    bool done = false;
+
+    if( Counters_Enabled )
+        counters_read(&run->parse_counters[0]);
+
+    while( !done ) {
+        void *item;
+        run->parse_waits += SpscQueue_pop(&run->full_lines, &item);
+        LineBatch *lines = item;
+
+        run->parse_waits += SpscQueue_pop(&run->free_records, &item);
+        RecordBatch *records = item;
+
+        records->num_records = 0;
+        for( size_t i = 0; i < lines->num_lines; i++ ) {
+            char *record = records->records + records->num_records * pipeline->record_size;
+            if( pipeline->parse(lines->text + lines->starts[i], record, pipeline->data) )
+                records->num_records++;
+        }
+
+        done = records->last = lines->last;
+        SpscQueue_push(&run->free_lines, lines);
+        SpscQueue_push(&run->full_records, records);
+    }
+
+    if( Phase_Stats )
+        run->parse_cpu = phase_thread_cpu();
+    if( Counters_Enabled )
+        counters_read(&run->parse_counters[1]);
+
+    return NULL;
+}
+
+static long pipeline_fold(PipelineRun *run) {
+    const Pipeline *pipeline = run->pipeline;
+    long num_records = 0;
+    bool done = false;
+
+    while( !done ) {
+        void *item;
+        run->fold_waits += SpscQueue_pop(&run->full_records, &item);
+        RecordBatch *records = item;
+
+        for( size_t i = 0; i < records->num_records; i++ ) {
+            pipeline->fold(records->records + i * pipeline->record_size, pipeline->data);
+        }
+
+        num_records += records->num_records;
+        run->batches++;
+        done = records->last;
+        SpscQueue_push(&run->free_records, records);
+    }
+
+    return num_records;
+}
+
+/* No threads, for --threads 1 */
+static long pipeline_run_serial(const Pipeline *pipeline, FILE *fp) {
+    char *line = NULL;
+    size_t line_size = 0;
+    char *record = malloc(pipeline->record_size);
+    long num_records = 0;
+
+    while( getline(&line, &line_size, fp) > 0 ) {
+        if( pipeline->parse(line, record, pipeline->data) ) {
+            pipeline->fold(record, pipeline->data);
+            num_records++;
+        }
+    }
+
+    free(record);
+    free(line);
+
+    return num_records;
+}
+
+long pipeline_run(const Pipeline *pipeline, FILE *fp) {
+    if( pool_num_threads() == 1 )
+        return pipeline_run_serial(pipeline, fp);
+
+    size_t depth = pipeline->queue_depth ? pipeline->queue_depth : PIPELINE_QUEUE_DEPTH;
+    PipelineRun run = {
+        .pipeline    = pipeline,
+        .batch_lines = pipeline->batch_lines ? pipeline->batch_lines : PIPELINE_BATCH_LINES,
+        .fp          = fp
+    };
+
+    SpscQueue_init(&run.full_lines,   depth);
+    SpscQueue_init(&run.free_lines,   depth);
+    SpscQueue_init(&run.full_records, depth);
+    SpscQueue_init(&run.free_records, depth);
+
+    for( size_t i = 0; i < depth; i++ ) {
+        SpscQueue_push(&run.free_lines,   LineBatch_new(run.batch_lines));
+        SpscQueue_push(&run.free_records, RecordBatch_new(run.batch_lines, pipeline->record_size));
+    }
+
+    pthread_t reader, parser;
+    if( pthread_create(&reader, NULL, pipeline_reader, &run) != 0 ||
+        pthread_create(&parser, NULL, pipeline_parser, &run) != 0 )
+        die("Could not start the pipeline threads");
+
+    /* The other stages are using run, a die() can't unwind past it */
+    solve_unwind_disable();
+    long num_records = pipeline_fold(&run);
+    solve_unwind_enable();
+
+    pthread_join(reader, NULL);
+    pthread_join(parser, NULL);
+
+    /* The stage threads worked for us, it's our phase's CPU and counts */
+    phase_add_cpu(run.read_cpu + run.parse_cpu);
+    counters_add(&run.read_counters[0], &run.read_counters[1]);
+    counters_add(&run.parse_counters[0], &run.parse_counters[1]);
+
+    /* Every batch is back on its free queue */
+    void *item;
+    while( SpscQueue_try_pop(&run.free_lines, &item) )
+        LineBatch_free(item);
+    while( SpscQueue_try_pop(&run.free_records, &item) )
+        RecordBatch_free(item);
+
+    SpscQueue_free(&run.full_lines);
+    SpscQueue_free(&run.free_lines);
+    SpscQueue_free(&run.full_records);
+    SpscQueue_free(&run.free_records);
+
+    if( Phase_Stats )
+        fprintf(stderr, "pipeline: batches=%ld read_waits=%ld parse_waits=%ld fold_waits=%ld\n",
+                run.batches, run.read_waits, run.parse_waits, run.fold_waits);
+
+    return num_records;
+}
@@ -0,0 +1,54 @@
+#ifndef _pipeline_h
+#define _pipeline_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Read, parse and fold a line oriented input in three stages at once,
+   so waiting on the disk or a pipe doesn't stall the compute and the
+   compute doesn't stall the reads.
+
+       reader thread --lines--> parse thread --records--> fold (caller)
+
+   The reader fills batches of lines, the parser turns each batch into
+   a batch of fixed size records, and the calling thread folds the
+   records in input order.  Stages are joined by bounded single
+   producer, single consumer queues which need no locks, a stage only
+   takes one to sleep when it has waited more than a moment.  Used batches
+   go back to their producer on a second queue, so there are only ever
+   queue_depth batches of each kind: a slow fold makes the parser wait,
+   which makes the reader wait.  That's the backpressure, and it keeps
+   memory flat however big the input.
+
+   Bigger batches mean fewer handoffs, smaller ones get the stages
+   going sooner and keep less in flight.  The defaults are fine for
+   the inputs we have, --stats shows how often each stage waited.
+
+   With --threads 1 it all runs in the calling thread, one line at a
+   time, which is handy for debugging a parse. */
+
+/* Fill in record from line, false to skip it, like a blank line */
+typedef bool (*PipelineParseFunc)(char *line, void *record, void *data);
+typedef void (*PipelineFoldFunc)(void *record, void *data);
+
+typedef struct {
+    size_t record_size;
+    PipelineParseFunc parse;
+    PipelineFoldFunc fold;
+    /* Passed to parse and fold.  Parse runs in its own thread, it
+       must not touch what fold changes. */
+    void *data;
+
+    /* 0 for the defaults */
+    size_t batch_lines;
+    size_t queue_depth;
+} Pipeline;
+
+#define PIPELINE_BATCH_LINES 1024
+#define PIPELINE_QUEUE_DEPTH 4
+
+/* The number of records folded */
+long pipeline_run(const Pipeline *pipeline, FILE *fp);
+
+#endif
@@ -0,0 +1,384 @@
+#include "common.h"
+#include "counters.h"
+#include "phase.h"
+#include "pool.h"
+#include "solve.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/* Splitting in halves, a deque never holds more than one piece per bit
+   of the range, so it never wraps. */
+#define POOL_DEQUE_SIZE 128
+
+typedef struct {
+    atomic_long from;
+    atomic_long to;
+} PoolRange;
+
+/* Chase-Lev deque, with the C11 orderings from Le et al. "Correct and
+   Efficient Work-Stealing for Weak Memory Models".  The owner pushes
+   and takes at the bottom, thieves steal from the top. */
+typedef struct {
+    atomic_long top;
+    char pad1[64 - sizeof(atomic_long)];
+    atomic_long bottom;
+    char pad2[64 - sizeof(atomic_long)];
+    PoolRange ranges[POOL_DEQUE_SIZE];
+} PoolDeque;
+
+/* Work a pool thread did for the thread which ran the job */
+typedef struct {
+    double cpu;
+    CounterValues begin;
+    CounterValues end;
+} PoolHelp;
+
+typedef struct {
+    PoolForFunc for_body;
+    PoolReduceFunc reduce_body;
+    void *data;
+    long grain;
+
+    /* One partial result per thread, for pool_reduce() */
+    char *partials;
+    size_t partial_size;
+
+    atomic_long remaining;
+    atomic_int workers;
+    /* The first body to die()'s message, see pool_run_job() */
+    _Atomic(char *) error;
+
+    /* With --stats or --counters, what each pool thread spent on it,
+       by thread id */
+    PoolHelp *help;
+} PoolJob;
+
+typedef struct {
+    PoolJob *job;
+    int id;
+    long from;
+    long to;
+} PoolChunk;
+
+static int Pool_Num_Threads = 0;
+static bool Pool_Started = false;
+static PoolDeque *Pool_Deques = NULL;
+
+/* One job at a time, held by the thread running it */
+static pthread_mutex_t Pool_Submit_Lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t Pool_Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  Pool_Wake = PTHREAD_COND_INITIALIZER;
+static PoolJob *Pool_Job = NULL;
+static uint64_t Pool_Generation = 0;
+
+/* -1 outside the pool.  Deque 0 belongs to whichever thread is
+   running the current job. */
+static _Thread_local int Pool_Thread_Id = -1;
+static _Thread_local bool Pool_In_Job = false;
+
+/* Only before the pool starts, after that it keeps its threads */
+void pool_set_threads(int num_threads) {
+    if( Pool_Started ) {
+        if( num_threads != Pool_Num_Threads )
+            fprintf(stderr, "The thread pool is already running with %d threads.\n", Pool_Num_Threads);
+        return;
+    }
+
+    Pool_Num_Threads = num_threads;
+}
+
+int pool_num_threads() {
+    if( Pool_Num_Threads < 1 ) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        Pool_Num_Threads = cpus > 0 ? cpus : 1;
+    }
+
+    return Pool_Num_Threads;
+}
+
+static void PoolDeque_push(PoolDeque *self, long from, long to) {
+    long bottom = atomic_load_explicit(&self->bottom, memory_order_relaxed);
+    PoolRange *range = &self->ranges[bottom % POOL_DEQUE_SIZE];
+
+    atomic_store_explicit(&range->from, from, memory_order_relaxed);
+    atomic_store_explicit(&range->to,   to,   memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&self->bottom, bottom + 1, memory_order_relaxed);
+}
+
+static bool PoolDeque_take(PoolDeque *self, long *from, long *to) {
+    long bottom = atomic_load_explicit(&self->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&self->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long top = atomic_load_explicit(&self->top, memory_order_relaxed);
+
+    if( top > bottom ) {
+        atomic_store_explicit(&self->bottom, bottom + 1, memory_order_relaxed);
+        return false;
+    }
+
+    PoolRange *range = &self->ranges[bottom % POOL_DEQUE_SIZE];
+    *from = atomic_load_explicit(&range->from, memory_order_relaxed);
+    *to   = atomic_load_explicit(&range->to,   memory_order_relaxed);
+
+    /* The last one, race the thieves for it */
+    bool got = true;
+    if( top == bottom ) {
+        got = atomic_compare_exchange_strong_explicit(
+            &self->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed
+        );
+        atomic_store_explicit(&self->bottom, bottom + 1, memory_order_relaxed);
+    }
+
+    return got;
+}
+
+static bool PoolDeque_steal(PoolDeque *self, long *from, long *to) {
+    long top = atomic_load_explicit(&self->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long bottom = atomic_load_explicit(&self->bottom, memory_order_acquire);
+
+    if( top >= bottom )
+        return false;
+
+    PoolRange *range = &self->ranges[top % POOL_DEQUE_SIZE];
+    *from = atomic_load_explicit(&range->from, memory_order_relaxed);
+    *to   = atomic_load_explicit(&range->to,   memory_order_relaxed);
+
+    return atomic_compare_exchange_strong_explicit(
+        &self->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed
+    );
+}
+
+/* Try every other thread once, starting somewhere different each time */
+static bool pool_steal(int id, long *from, long *to) {
+    static _Thread_local uint32_t seed = 0;
+    if( !seed )
+        seed = 2654435761u * (id + 1);
+
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    int num_threads = Pool_Num_Threads;
+    int start = seed % num_threads;
+    for( int i = 0; i < num_threads; i++ ) {
+        int victim = (start + i) % num_threads;
+        if( victim != id && PoolDeque_steal(&Pool_Deques[victim], from, to) )
+            return true;
+    }
+
+    return false;
+}
+
+static void pool_run_chunk(void *arg) {
+    PoolChunk *chunk = arg;
+    PoolJob *job = chunk->job;
+
+    if( job->reduce_body )
+        job->reduce_body(chunk->from, chunk->to, job->data, job->partials + chunk->id * job->partial_size);
+    else
+        job->for_body(chunk->from, chunk->to, job->data);
+}
+
+static void pool_run(PoolJob *job, int id, long from, long to) {
+    /* Keep the first half, leave the rest for us later or a thief */
+    while( to - from > job->grain ) {
+        long middle = from + (to - from) / 2;
+        PoolDeque_push(&Pool_Deques[id], middle, to);
+        to = middle;
+    }
+
+    /* Once a body has died the rest is skipped, the job only drains */
+    if( !atomic_load_explicit(&job->error, memory_order_relaxed) ) {
+        PoolChunk chunk = { .job = job, .id = id, .from = from, .to = to };
+        char *error = solve_try(pool_run_chunk, &chunk);
+        char *none = NULL;
+
+        if( error && !atomic_compare_exchange_strong(&job->error, &none, error) )
+            g_free(error);
+    }
+
+    atomic_fetch_sub_explicit(&job->remaining, to - from, memory_order_acq_rel);
+}
+
+static void pool_work(PoolJob *job, int id) {
+    long from, to;
+
+    Pool_In_Job = true;
+    while( atomic_load_explicit(&job->remaining, memory_order_acquire) > 0 ) {
+        if( PoolDeque_take(&Pool_Deques[id], &from, &to) || pool_steal(id, &from, &to) )
+            pool_run(job, id, from, to);
+        else
+            sched_yield();
+    }
+    Pool_In_Job = false;
+}
+
+static void *pool_thread(void *arg) {
+    uint64_t seen = 0;
+
+    Pool_Thread_Id = (intptr_t)arg;
+
+    for(;;) {
+        pthread_mutex_lock(&Pool_Lock);
+        while( Pool_Generation == seen )
+            pthread_cond_wait(&Pool_Wake, &Pool_Lock);
+        seen = Pool_Generation;
+
+        /* Registering under the lock, the job can't end before we do */
+        PoolJob *job = Pool_Job;
+        if( job )
+            atomic_fetch_add(&job->workers, 1);
+        pthread_mutex_unlock(&Pool_Lock);
+
+        if( job ) {
+            PoolHelp *help = job->help ? &job->help[Pool_Thread_Id] : NULL;
+            double cpu = help ? phase_thread_cpu() : 0;
+
+            if( help && Counters_Enabled )
+                counters_read(&help->begin);
+            pool_work(job, Pool_Thread_Id);
+            if( help && Counters_Enabled )
+                counters_read(&help->end);
+
+            if( help )
+                help->cpu = phase_thread_cpu() - cpu;
+            atomic_fetch_sub(&job->workers, 1);
+        }
+    }
+
+    return NULL;
+}
+
+static void pool_start() {
+    int num_threads = pool_num_threads();
+
+    Pool_Deques = calloc(num_threads, sizeof(PoolDeque));
+
+    for( intptr_t id = 1; id < num_threads; id++ ) {
+        pthread_t thread;
+        if( pthread_create(&thread, NULL, pool_thread, (void *)id) != 0 )
+            die("Could not start pool thread %ld", (long)id);
+        pthread_detach(thread);
+    }
+
+    Pool_Started = true;
+}
+
+/* A body which died is the job's error, to g_free(), once every thread
+   has let go of the job.  It's NULL if they all returned. */
+static char *pool_run_job(PoolJob *job, long start, long end) {
+    if( job->grain < 1 )
+        job->grain = 1;
+
+    /* Nothing to gain from the pool, run it here, a die() is ours */
+    if( Pool_In_Job || pool_num_threads() == 1 || end - start <= job->grain ) {
+        if( job->reduce_body )
+            job->reduce_body(start, end, job->data, job->partials);
+        else
+            job->for_body(start, end, job->data);
+        return NULL;
+    }
+
+    /* Jobs from different threads take turns.  The job is on our stack
+       and the others are working on it, a die() can't unwind past it.
+       A body's die() is caught in pool_run(). */
+    solve_unwind_disable();
+    pthread_mutex_lock(&Pool_Submit_Lock);
+    if( !Pool_Started )
+        pool_start();
+
+    atomic_init(&job->remaining, end - start);
+    atomic_init(&job->workers, 0);
+    atomic_init(&job->error, NULL);
+    job->help = Phase_Stats || Counters_Enabled ? calloc(Pool_Num_Threads, sizeof(PoolHelp)) : NULL;
+    PoolDeque_push(&Pool_Deques[0], start, end);
+
+    pthread_mutex_lock(&Pool_Lock);
+    Pool_Job = job;
+    Pool_Generation++;
+    pthread_cond_broadcast(&Pool_Wake);
+    pthread_mutex_unlock(&Pool_Lock);
+
+    pool_work(job, 0);
+
+    /* Wait for stragglers to let go of the job */
+    pthread_mutex_lock(&Pool_Lock);
+    Pool_Job = NULL;
+    pthread_mutex_unlock(&Pool_Lock);
+    while( atomic_load(&job->workers) > 0 )
+        sched_yield();
+
+    /* Counted in our phases, as if we'd done it */
+    for( int i = 0; job->help && i < Pool_Num_Threads; i++ ) {
+        phase_add_cpu(job->help[i].cpu);
+        counters_add(&job->help[i].begin, &job->help[i].end);
+    }
+    free(job->help);
+
+    pthread_mutex_unlock(&Pool_Submit_Lock);
+    solve_unwind_enable();
+
+    return atomic_load(&job->error);
+}
+
+/* Dies with a body's message in the calling thread, which fails its
+   solve if it's in one */
+static void pool_raise(char *error) {
+    solve_own(error, g_free);
+    die("%s", error);
+}
+
+void pool_for(long start, long end, long grain, PoolForFunc body, void *data) {
+    if( start >= end )
+        return;
+
+    PoolJob job = {
+        .for_body = body,
+        .data     = data,
+        .grain    = grain
+    };
+
+    char *error = pool_run_job(&job, start, end);
+    if( error )
+        pool_raise(error);
+}
+
+void pool_reduce(long start, long end, long grain,
+                 PoolReduceFunc body, PoolCombineFunc combine,
+                 void *result, size_t result_size, void *data)
+{
+    if( start >= end )
+        return;
+
+    int num_partials = Pool_In_Job ? 1 : pool_num_threads();
+    PoolJob job = {
+        .reduce_body  = body,
+        .data         = data,
+        .grain        = grain,
+        /* A body run here which dies unwinds past us */
+        .partials     = solve_own(malloc(num_partials * result_size), free),
+        .partial_size = result_size
+    };
+
+    for( int i = 0; i < num_partials; i++ ) {
+        memcpy(job.partials + i * result_size, result, result_size);
+    }
+
+    char *error = pool_run_job(&job, start, end);
+    if( error ) {
+        solve_release(job.partials, free);
+        pool_raise(error);
+    }
+
+    for( int i = 0; i < num_partials; i++ ) {
+        combine(result, job.partials + i * result_size, data);
+    }
+
+    solve_release(job.partials, free);
+}
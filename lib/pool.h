@@ -0,0 +1,46 @@
+#ifndef _pool_h
+#define _pool_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A work-stealing thread pool for loops whose iterations don't depend
+   on each other.
+
+   pool_for() splits [start, end) in halves until pieces are no bigger
+   than grain.  Each thread keeps the halves it split off on its own
+   deque and works through them newest first; a thread which runs out
+   steals the oldest, biggest piece from someone else.  The calling
+   thread works too, and pool_for() returns when every iteration is
+   done.
+
+   The pool is started on first use with --threads threads, or one per
+   CPU.  Calling pool_for() from inside a pool_for() body runs the inner
+   loop in the calling thread.  Any other thread can call pool_for(),
+   the pool runs one loop at a time and the others wait their turn.
+
+   A body which calls die() doesn't take the process with it.  The
+   rest of the loop is skipped and, once every thread is done with it,
+   pool_for() dies with the same message in the calling thread.  In a
+   solve that fails the solve, see solve.h. */
+
+typedef void (*PoolForFunc)(long from, long to, void *data);
+
+/* partial is this thread's own result, see pool_reduce() */
+typedef void (*PoolReduceFunc)(long from, long to, void *data, void *partial);
+typedef void (*PoolCombineFunc)(void *result, const void *partial, void *data);
+
+void pool_set_threads(int num_threads);
+int pool_num_threads();
+
+void pool_for(long start, long end, long grain, PoolForFunc body, void *data);
+
+/* Like pool_for(), but each thread accumulates into its own partial
+   result, which starts as a copy of *result, so *result must start as
+   the identity: 0 for a sum, INFINITY for a minimum.  At the end each
+   partial is combined into *result, in no particular order. */
+void pool_reduce(long start, long end, long grain,
+                 PoolReduceFunc body, PoolCombineFunc combine,
+                 void *result, size_t result_size, void *data);
+
+#endif
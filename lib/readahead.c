@@ -0,0 +1,350 @@
+/* pipe2() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "common.h"
+#include "readahead.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READAHEAD_ALIGN 4096
+
+typedef struct {
+    /* buf_size + 1, room for the \0 after a last line with no newline */
+    char *data;
+    size_t len;
+    bool full;
+    bool eof;
+    int error;
+} ReadaheadBuf;
+
+struct Readahead {
+    int fd;
+    size_t buf_size;
+    ReadaheadBuf bufs[2];
+    bool threaded;
+
+    /* The consumer's side */
+    ReadaheadBuf *buf;
+    int next_buf;
+    size_t pos;
+    bool at_eof;
+    /* The byte overwritten by the \0 after the line handed out */
+    char *restore_at;
+    char restore_char;
+    /* A line split across two buffers */
+    char *carry;
+    size_t carry_len;
+    size_t carry_size;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t drained;
+    atomic_bool stop;
+    /* The consumer is waiting, hand over what's read so far */
+    atomic_bool hungry;
+    /* Written to when it's stopped or hungry, so the thread doesn't sit
+       waiting on a pipe which has nothing more to say yet */
+    int wake_pipe[2];
+};
+
+static void ReadaheadBuf_init(ReadaheadBuf *self, size_t size) {
+    if( posix_memalign((void **)&self->data, READAHEAD_ALIGN, size + 1) != 0 )
+        die("Could not allocate a %zu byte read buffer", size);
+
+    self->len   = 0;
+    self->full  = false;
+    self->eof   = false;
+    self->error = 0;
+}
+
+/* If the pipe is full it's already awake.  Nothing else goes wrong
+   writing to our own pipe, and this mustn't die(), Readahead_read()
+   calls it under a stream's lock. */
+static void Readahead_wake(Readahead *self) {
+    ssize_t ignored = write(self->wake_pipe[1], "", 1);
+    (void)ignored;
+}
+
+/* False if it was woken up first */
+static bool Readahead_wait_readable(Readahead *self) {
+    struct pollfd fds[2] = {
+        { .fd = self->fd,           .events = POLLIN },
+        { .fd = self->wake_pipe[0], .events = POLLIN }
+    };
+
+    for(;;) {
+        if( poll(fds, 2, -1) < 0 ) {
+            if( errno == EINTR )
+                continue;
+            /* Let the read report it */
+            return true;
+        }
+
+        if( fds[1].revents ) {
+            char junk[64];
+            while( read(self->wake_pipe[0], junk, sizeof(junk)) > 0 )
+                ;
+            return false;
+        }
+        if( fds[0].revents )
+            return true;
+    }
+}
+
+/* Reads until the buffer is full, the input ends, or the consumer is
+   waiting on it. */
+static void Readahead_fill(Readahead *self, ReadaheadBuf *buf) {
+    buf->len = 0;
+
+    while( buf->len < self->buf_size ) {
+        if( self->threaded && !Readahead_wait_readable(self) ) {
+            if( atomic_load(&self->stop) ) {
+                buf->eof = true;
+                return;
+            }
+            if( buf->len > 0 )
+                return;
+            continue;
+        }
+
+        ssize_t got = read(self->fd, buf->data + buf->len, self->buf_size - buf->len);
+        if( got < 0 && errno == EINTR )
+            continue;
+        if( got < 0 ) {
+            buf->error = errno;
+            buf->eof = true;
+            return;
+        }
+        if( got == 0 ) {
+            buf->eof = true;
+            return;
+        }
+
+        buf->len += got;
+        if( atomic_load_explicit(&self->hungry, memory_order_relaxed) )
+            return;
+    }
+}
+
+/* Fills the two buffers in turn, each once the consumer is done with it */
+static void *Readahead_thread(void *arg) {
+    Readahead *self = arg;
+
+    for( int i = 0; ; i ^= 1 ) {
+        ReadaheadBuf *buf = &self->bufs[i];
+
+        pthread_mutex_lock(&self->lock);
+        while( buf->full && !atomic_load(&self->stop) )
+            pthread_cond_wait(&self->drained, &self->lock);
+        pthread_mutex_unlock(&self->lock);
+
+        if( atomic_load(&self->stop) )
+            break;
+
+        Readahead_fill(self, buf);
+
+        pthread_mutex_lock(&self->lock);
+        buf->full = true;
+        pthread_cond_signal(&self->filled);
+        pthread_mutex_unlock(&self->lock);
+
+        if( buf->eof )
+            break;
+    }
+
+    return NULL;
+}
+
+Readahead *Readahead_new(int fd) {
+    Readahead *self = calloc(1, sizeof(Readahead));
+    struct stat st;
+
+    self->fd = fd;
+    self->buf_size = READAHEAD_BUF_SIZE;
+
+    pthread_mutex_init(&self->lock, NULL);
+    pthread_cond_init(&self->filled, NULL);
+    pthread_cond_init(&self->drained, NULL);
+    atomic_init(&self->stop, false);
+    atomic_init(&self->hungry, false);
+
+    /* Small enough to read at once, nothing to overlap with */
+    bool small = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size < READAHEAD_BUF_SIZE;
+    if( small )
+        self->buf_size = st.st_size + 1;
+
+    ReadaheadBuf_init(&self->bufs[0], self->buf_size);
+    ReadaheadBuf_init(&self->bufs[1], self->buf_size);
+
+    /* If there's no thread the consumer reads for itself */
+    if( !small && pipe2(self->wake_pipe, O_NONBLOCK) == 0 ) {
+        self->threaded = true;
+        if( pthread_create(&self->thread, NULL, Readahead_thread, self) != 0 ) {
+            self->threaded = false;
+            close(self->wake_pipe[0]);
+            close(self->wake_pipe[1]);
+        }
+    }
+
+    return self;
+}
+
+void Readahead_destroy(Readahead *self) {
+    if( self->threaded ) {
+        pthread_mutex_lock(&self->lock);
+        atomic_store(&self->stop, true);
+        pthread_cond_broadcast(&self->drained);
+        pthread_mutex_unlock(&self->lock);
+
+        Readahead_wake(self);
+        pthread_join(self->thread, NULL);
+
+        close(self->wake_pipe[0]);
+        close(self->wake_pipe[1]);
+    }
+
+    pthread_mutex_destroy(&self->lock);
+    pthread_cond_destroy(&self->filled);
+    pthread_cond_destroy(&self->drained);
+
+    free(self->bufs[0].data);
+    free(self->bufs[1].data);
+    free(self->carry);
+    free(self);
+}
+
+static ReadaheadBuf *Readahead_take(Readahead *self) {
+    ReadaheadBuf *buf = &self->bufs[self->next_buf];
+
+    if( !self->threaded ) {
+        Readahead_fill(self, buf);
+    }
+    else {
+        pthread_mutex_lock(&self->lock);
+        if( !buf->full ) {
+            atomic_store_explicit(&self->hungry, true, memory_order_relaxed);
+            Readahead_wake(self);
+            while( !buf->full )
+                pthread_cond_wait(&self->filled, &self->lock);
+            atomic_store_explicit(&self->hungry, false, memory_order_relaxed);
+        }
+        pthread_mutex_unlock(&self->lock);
+    }
+
+    self->pos = 0;
+    return buf;
+}
+
+static void Readahead_give_back(Readahead *self) {
+    /* Once it's given back the thread can refill it */
+    self->at_eof = self->buf->eof;
+
+    if( self->threaded ) {
+        pthread_mutex_lock(&self->lock);
+        self->buf->full = false;
+        pthread_cond_signal(&self->drained);
+        pthread_mutex_unlock(&self->lock);
+    }
+
+    self->buf = NULL;
+    self->next_buf ^= 1;
+}
+
+static void Readahead_carry(Readahead *self, const char *from, size_t len) {
+    if( self->carry_len + len + 1 > self->carry_size ) {
+        self->carry_size = (self->carry_len + len + 1) * 2;
+        self->carry = realloc(self->carry, self->carry_size);
+    }
+
+    memcpy(self->carry + self->carry_len, from, len);
+    self->carry_len += len;
+    self->carry[self->carry_len] = '\0';
+}
+
+char *Readahead_line(Readahead *self, size_t *len) {
+    if( self->restore_at ) {
+        *self->restore_at = self->restore_char;
+        self->restore_at = NULL;
+    }
+
+    self->carry_len = 0;
+
+    for(;;) {
+        if( !self->buf ) {
+            if( self->at_eof )
+                break;
+            self->buf = Readahead_take(self);
+            if( self->buf->error )
+                die("Could not read the input: %s", strerror(self->buf->error));
+        }
+
+        char *start = self->buf->data + self->pos;
+        size_t avail = self->buf->len - self->pos;
+        char *newline = memchr(start, '\n', avail);
+
+        if( newline ) {
+            size_t line_len = newline + 1 - start;
+            self->pos += line_len;
+
+            if( self->carry_len > 0 ) {
+                Readahead_carry(self, start, line_len);
+                break;
+            }
+
+            /* Hand it out in place */
+            self->restore_at   = newline + 1;
+            self->restore_char = newline[1];
+            newline[1] = '\0';
+
+            *len = line_len;
+            return start;
+        }
+
+        /* The line goes on into the next buffer, if there is one */
+        Readahead_carry(self, start, avail);
+        Readahead_give_back(self);
+    }
+
+    if( self->carry_len == 0 )
+        return NULL;
+
+    *len = self->carry_len;
+    return self->carry;
+}
+
+ssize_t Readahead_read(Readahead *self, char *to, size_t size) {
+    if( self->restore_at ) {
+        *self->restore_at = self->restore_char;
+        self->restore_at = NULL;
+    }
+
+    while( !self->buf || self->pos == self->buf->len ) {
+        if( self->buf )
+            Readahead_give_back(self);
+        if( self->at_eof )
+            return 0;
+
+        self->buf = Readahead_take(self);
+        if( self->buf->error ) {
+            errno = self->buf->error;
+            return -1;
+        }
+    }
+
+    size_t len = self->buf->len - self->pos;
+    if( len > size )
+        len = size;
+
+    memcpy(to, self->buf->data + self->pos, len);
+    self->pos += len;
+
+    return len;
+}
@@ -0,0 +1,40 @@
+#ifndef _readahead_h
+#define _readahead_h
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Lines from a file descriptor, read ahead by a background thread.
+
+   getline() on a pipe does one small read at a time, and the solver
+   waits for each.  A Readahead has two big page aligned buffers: a
+   thread reads into one while the lines of the other are handed out.
+   Lines are handed out where they sit in the buffer, not copied, only
+   a line split across two buffers is put back together.
+
+   A regular file which fits in one buffer is read in one go with no
+   thread, there's nothing to overlap.
+
+   Reading stops at the end of the input, or when it's destroyed.  The
+   descriptor is not closed.
+
+   Readahead_read() hands out the same buffers as plain bytes, for a
+   stream to read from, see open_stdin(). */
+
+typedef struct Readahead Readahead;
+
+#define READAHEAD_BUF_SIZE (1024 * 1024)
+
+Readahead *Readahead_new(int fd);
+void Readahead_destroy(Readahead *self);
+
+/* The next line with its newline, if it has one, and \0 terminated.
+   It can be changed in place, but only lives until the next call.
+   NULL at the end. */
+char *Readahead_line(Readahead *self, size_t *len);
+
+/* Up to size bytes, 0 at the end.  It doesn't die(), a read which
+   failed is -1 with errno set, as read() would. */
+ssize_t Readahead_read(Readahead *self, char *to, size_t size);
+
+#endif
@@ -0,0 +1,317 @@
+#include "common.h"
+#include "solve.h"
+#include "phase.h"
+#include "mapfile.h"
+#include <errno.h>
+#include <time.h>
+
+typedef struct {
+    void *thing;
+    /* NULL for a stream from SolveContext_open() */
+    GDestroyNotify destroy;
+} SolveOwned;
+
+/* A solve_try() in progress */
+typedef struct SolveTry {
+    jmp_buf fail;
+    char *error;
+    /* Unwind_Disabled when it began */
+    int unwind_disabled;
+    int phase_depth;
+    struct SolveTry *outer;
+} SolveTry;
+
+/* The solve this thread is in, and whether die() can unwind it now.
+   A die() goes to the newest solve_try() begun in the solve, if there
+   is one, else it fails the solve. */
+static _Thread_local SolveContext *Solving = NULL;
+static _Thread_local SolveTry *Trying = NULL;
+static _Thread_local int Unwind_Disabled = 0;
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+SolveContext *SolveContext_new() {
+    SolveContext *self = calloc(1, sizeof(SolveContext));
+
+    self->output  = g_string_new("");
+    self->regexes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_regex_unref);
+    self->owned   = Vec_new(sizeof(SolveOwned), 16);
+
+    return self;
+}
+
+void SolveContext_destroy(SolveContext *self) {
+    g_string_free(self->output, true);
+    g_free(self->error);
+    g_hash_table_destroy(self->regexes);
+    Vec_destroy(self->owned);
+    free(self);
+}
+
+static void close_stream(void *fp) {
+    fclose(fp);
+}
+
+/* Newest first, a stream might be reading from something owned before it.
+   A decompressor which failed fails the solve, whatever else it said,
+   a parse error of its cut short output is no help. */
+static int SolveContext_free_owned(SolveContext *self, int status) {
+    for( size_t i = self->owned->len; i-- > 0; ) {
+        SolveOwned *owned = &Vec_index(self->owned, SolveOwned, i);
+        if( owned->destroy ) {
+            owned->destroy(owned->thing);
+            continue;
+        }
+
+        char *failed = close_file(owned->thing);
+        if( failed ) {
+            g_free(self->error);
+            self->error = failed;
+            status = 1;
+        }
+    }
+
+    Vec_clear(self->owned);
+
+    return status;
+}
+
+/* With filename set, the file is opened inside the solve so a missing
+   one fails it like anything else */
+static int SolveContext_run(SolveContext *self, SolveFunc solve, const char *buf, size_t len,
+                            bool from_file, const char *filename, int argc, char **argv)
+{
+    SolveContext *outer = Solving;
+    SolveTry *outer_try = Trying;
+    int status;
+
+    g_string_truncate(self->output, 0);
+    g_free(self->error);
+    self->error = NULL;
+    self->stats = (SolveStats){ .items = -1 };
+    self->input_name  = filename;
+    self->buffer_fp   = NULL;
+    self->phase_depth = phase_depth();
+
+    double wall = clock_seconds(CLOCK_MONOTONIC);
+    double cpu  = clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+
+    Solving = self;
+    Trying  = NULL;
+    if( setjmp(self->fail) == 0 ) {
+        FILE *input;
+
+        if( from_file ) {
+            input = SolveContext_open(self, filename);
+        }
+        else {
+            /* fmemopen() won't take a NULL buffer, even an empty one */
+            input = fmemopen(len ? (void *)buf : "", len, "r");
+            if( !input )
+                die("Could not read the input: %s", strerror(errno));
+            SolveContext_own(self, input, close_stream);
+
+            self->buffer_fp  = input;
+            self->buffer     = buf;
+            self->buffer_len = len;
+            self->stats.input_len = len;
+        }
+
+        status = solve(self, input, argc, argv);
+    }
+    else {
+        phase_abandon(self->phase_depth);
+        status = 1;
+    }
+    Solving = outer;
+    Trying  = outer_try;
+
+    status = SolveContext_free_owned(self, status);
+    self->input_name = NULL;
+    self->buffer_fp  = NULL;
+
+    self->stats.wall = clock_seconds(CLOCK_MONOTONIC) - wall;
+    self->stats.cpu  = clock_seconds(CLOCK_THREAD_CPUTIME_ID) - cpu;
+
+    return status;
+}
+
+int SolveContext_solve(SolveContext *self, SolveFunc solve, const char *buf, size_t len,
+                       int argc, char **argv)
+{
+    return SolveContext_run(self, solve, buf, len, false, NULL, argc, argv);
+}
+
+int SolveContext_solve_file(SolveContext *self, SolveFunc solve, const char *filename,
+                            int argc, char **argv)
+{
+    return SolveContext_run(self, solve, NULL, 0, true, filename, argc, argv);
+}
+
+void SolveContext_printf(SolveContext *self, const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    g_string_append_vprintf(self->output, format, args);
+    va_end(args);
+}
+
+GRegex *SolveContext_regex(SolveContext *self, const char *pattern, GRegexCompileFlags flags) {
+    GRegex *re = g_hash_table_lookup(self->regexes, pattern);
+
+    if( !re ) {
+        re = compile_regex(pattern, flags, 0);
+        g_hash_table_insert(self->regexes, g_strdup(pattern), re);
+    }
+
+    return re;
+}
+
+void *SolveContext_own(SolveContext *self, void *thing, GDestroyNotify destroy) {
+    SolveOwned owned = { .thing = thing, .destroy = destroy };
+    Vec_push_val(self->owned, owned);
+
+    return thing;
+}
+
+void *SolveContext_alloc(SolveContext *self, size_t size) {
+    return SolveContext_own(self, calloc(1, size), free);
+}
+
+char *SolveContext_strndup(SolveContext *self, const char *input, size_t len) {
+    while( len > 0 && input[len - 1] == '\n' )
+        len--;
+
+    return SolveContext_own(self, strndup(input, len), free);
+}
+
+/* A buffer from SolveContext_solve() is already in memory */
+const char *SolveContext_map(SolveContext *self, FILE *input, size_t *len) {
+    if( input == self->buffer_fp ) {
+        *len = self->buffer_len;
+        return self->buffer;
+    }
+
+    MappedFile *file = SolveContext_own(self, MappedFile_new(input), (GDestroyNotify)MappedFile_destroy);
+    self->stats.input_len = file->len;
+
+    *len = file->len;
+    return file->data;
+}
+
+FILE *SolveContext_open(SolveContext *self, const char *filename) {
+    FILE *fp = filename ? open_file(filename, "r") : open_stdin();
+
+    return SolveContext_own(self, fp, NULL);
+}
+
+static int solve_print(SolveContext *ctx, int status) {
+    fwrite(ctx->output->str, 1, ctx->output->len, stdout);
+    if( ctx->error )
+        fprintf(stderr, "%s\n", ctx->error);
+
+    SolveContext_destroy(ctx);
+
+    return status;
+}
+
+int solve_main(SolveFunc solve, const char *filename, int argc, char **argv) {
+    SolveContext *ctx = SolveContext_new();
+    int status = SolveContext_solve_file(ctx, solve, filename, argc, argv);
+
+    return solve_print(ctx, status);
+}
+
+int solve_main_string(SolveFunc solve, const char *input, int argc, char **argv) {
+    SolveContext *ctx = SolveContext_new();
+    int status = SolveContext_solve(ctx, solve, input, strlen(input), argc, argv);
+
+    return solve_print(ctx, status);
+}
+
+bool solving() {
+    if( Trying )
+        return Trying->unwind_disabled == Unwind_Disabled;
+
+    return Solving != NULL && Unwind_Disabled == 0;
+}
+
+char *solve_try(void (*func)(void *arg), void *arg) {
+    SolveTry try = {
+        .unwind_disabled = Unwind_Disabled,
+        .phase_depth     = phase_depth(),
+        .outer           = Trying
+    };
+
+    Trying = &try;
+    if( setjmp(try.fail) == 0 )
+        func(arg);
+    else
+        phase_abandon(Trying->phase_depth);
+
+    /* Through Trying, try's fields might be stale after the longjmp */
+    char *error = Trying->error;
+    Trying = Trying->outer;
+
+    return error;
+}
+
+/* A pool thread can be in a solve_try() but not a solve */
+void *solve_own(void *thing, GDestroyNotify destroy) {
+    if( Solving && solving() )
+        SolveContext_own(Solving, thing, destroy);
+
+    return thing;
+}
+
+/* Most likely the newest, but whatever was owned after it stays owned */
+void solve_release(void *thing, GDestroyNotify destroy) {
+    Vec *owned = Solving ? Solving->owned : NULL;
+
+    for( size_t i = owned ? owned->len : 0; i-- > 0; ) {
+        if( Vec_index(owned, SolveOwned, i).thing != thing )
+            continue;
+
+        memmove(&Vec_index(owned, SolveOwned, i), &Vec_index(owned, SolveOwned, i + 1),
+                (owned->len - i - 1) * sizeof(SolveOwned));
+        owned->len--;
+        break;
+    }
+
+    destroy(thing);
+}
+
+void solve_unwind_disable() {
+    Unwind_Disabled++;
+}
+
+void solve_unwind_enable() {
+    Unwind_Disabled--;
+}
+
+void solve_fail(const char *format, va_list args) {
+    if( !solving() )
+        return;
+
+    if( Trying ) {
+        Trying->error = g_strdup_vprintf(format, args);
+        longjmp(Trying->fail, 1);
+    }
+
+    SolveContext *self = Solving;
+    self->error = g_strdup_vprintf(format, args);
+    longjmp(self->fail, 1);
+}
+
+void solve_items(long items) {
+    if( !Solving )
+        return;
+
+    SolveStats *stats = &Solving->stats;
+    stats->items = stats->items < 0 ? items : stats->items + items;
+}
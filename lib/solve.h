@@ -0,0 +1,161 @@
+#ifndef _solve_h
+#define _solve_h
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <glib.h>
+#include "vec.h"
+
+/* Each day's solver as a library call, linked together as libadvent.
+
+   A day's main() reads a file and prints its answer, once per process.
+   dayN_solve() does the same work on a buffer or a file and writes its
+   answer to a SolveContext, so one process can solve many inputs, and
+   on many threads at once.
+
+       SolveContext *ctx = SolveContext_new();
+       if( SolveContext_solve(ctx, day9_solve, buf, len, 0, NULL) == 0 )
+           fputs(ctx->output->str, stdout);
+       else
+           fprintf(stderr, "%s\n", ctx->error);
+       SolveContext_destroy(ctx);
+
+   Whatever a solve needs beyond its stack comes from its context.
+   Regexes are compiled the first time a context asks for them and kept
+   for its next solve.  Memory and streams handed to the context with
+   SolveContext_own() are freed when the solve ends, however it ends.
+   A context is not shared, each thread has its own.
+
+   The input is a stream, a file's or one over a buffer given to
+   SolveContext_solve().  A day which reads it line by line reads the
+   stream, one which scans it as a buffer asks for SolveContext_map().
+   Only a regular file is mapped, a pipe is read ahead as it's solved.
+
+   A solve which calls die() fails instead of exiting.  The message is
+   in ctx->error, what it owned is freed and the phases it began are
+   abandoned.  That's only for the thread which called
+   SolveContext_solve().  A die() in a pool_for() body is passed back
+   to that thread, see pool.h, one in a pipeline stage still exits the
+   process.
+
+   argv is what comes after the input, argc of them, such as day 18's
+   number of steps.  Day 6 is a flex/bison parser and has no solve. */
+
+typedef struct {
+    double wall;
+    /* This thread's only, not the pool's */
+    double cpu;
+    /* Summed from phase_items(), -1 if the solve didn't say */
+    long items;
+    /* 0 if it was read as a stream, it's not known up front */
+    size_t input_len;
+} SolveStats;
+
+typedef struct {
+    GString *output;
+    /* Why the last solve failed, NULL if it didn't */
+    char *error;
+    SolveStats stats;
+    /* The file the input came from, NULL for stdin or a buffer */
+    const char *input_name;
+
+    /* Pattern to GRegex */
+    GHashTable *regexes;
+    /* What to free when the solve ends, see SolveContext_own() */
+    Vec *owned;
+    /* The stream over SolveContext_solve()'s buffer, and the buffer */
+    FILE *buffer_fp;
+    const char *buffer;
+    size_t buffer_len;
+    jmp_buf fail;
+    int phase_depth;
+} SolveContext;
+
+typedef int (*SolveFunc)(SolveContext *ctx, FILE *input, int argc, char **argv);
+
+SolveContext *SolveContext_new();
+void SolveContext_destroy(SolveContext *self);
+
+/* The exit status, the solve's own or 1 if it died.  The input is
+   len bytes of buf. */
+int SolveContext_solve(SolveContext *self, SolveFunc solve, const char *buf, size_t len,
+                       int argc, char **argv);
+
+/* Same, with the input read from a file, or stdin if it's NULL.  A file
+   which can't be read fails the solve. */
+int SolveContext_solve_file(SolveContext *self, SolveFunc solve, const char *filename,
+                            int argc, char **argv);
+
+void SolveContext_printf(SolveContext *self, const char *format, ...);
+
+/* Compiled on first use and kept by the context.  A pattern is always
+   compiled with the same flags. */
+GRegex *SolveContext_regex(SolveContext *self, const char *pattern, GRegexCompileFlags flags);
+
+/* Destroyed when the solve ends, returns thing */
+void *SolveContext_own(SolveContext *self, void *thing, GDestroyNotify destroy);
+/* Zeroed memory which lives until the solve ends */
+void *SolveContext_alloc(SolveContext *self, size_t size);
+/* The input as a \0 terminated string without its trailing newline,
+   for the days which take a word */
+char *SolveContext_strndup(SolveContext *self, const char *input, size_t len);
+/* All of the input in memory, len bytes and not \0 terminated, for the
+   days which scan it as a buffer.  See mapfile.h, it lives until the
+   solve ends. */
+const char *SolveContext_map(SolveContext *self, FILE *input, size_t *len);
+/* open_file() for reading, or open_stdin() if filename is NULL, closed
+   when the solve ends */
+FILE *SolveContext_open(SolveContext *self, const char *filename);
+
+/* For a day's main(): solve the file, or stdin if it's NULL, print the
+   answer and return the exit status */
+int solve_main(SolveFunc solve, const char *filename, int argc, char **argv);
+/* Same, for the days whose input is an argument */
+int solve_main_string(SolveFunc solve, const char *input, int argc, char **argv);
+
+/* True if a die() in this thread would fail a solve or a solve_try(),
+   not exit */
+bool solving();
+/* Calls func(arg).  If it dies, the message to g_free() instead of
+   exiting, NULL if it returned.  Phases it began are abandoned, but
+   nothing it owned is freed until the solve ends.  For a thread which
+   must carry on, like a pool thread. */
+char *solve_try(void (*func)(void *arg), void *arg);
+/* For die(), fails the solve_try() or solve this thread is in, if
+   it's in one */
+void solve_fail(const char *format, va_list args);
+/* Around code which can't be unwound, like a pool job other threads
+   are working on, a die() exits even in a solve.  A solve_try() begun
+   inside still catches it. */
+void solve_unwind_disable();
+void solve_unwind_enable();
+/* SolveContext_own() for the solve this thread is in, if it's in one,
+   for library code which can die() holding something.  solve_release()
+   takes it back and destroys it, owned or not. */
+void *solve_own(void *thing, GDestroyNotify destroy);
+void solve_release(void *thing, GDestroyNotify destroy);
+/* For phase_items() */
+void solve_items(long items);
+
+int day1_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day2_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day3_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day4_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day5_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day7_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day8_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day9_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day10_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day11_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day12_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day13_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day14_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day15_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day16_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day17_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+int day18_solve(SolveContext *ctx, FILE *input, int argc, char **argv);
+
+#endif
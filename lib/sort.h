@@ -0,0 +1,42 @@
+#ifndef _sort_h
+#define _sort_h
+
+#include <stdint.h>
+#include <string.h>
+
+/* qsort() comparators for the common element types, so each day
+   doesn't write its own.  cmp_str is for arrays of char *. */
+
+static inline int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+static inline int cmp_long(const void *a, const void *b) {
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+
+    return (x > y) - (x < y);
+}
+
+static inline int cmp_int64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static inline int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static inline int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+#endif
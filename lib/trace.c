@@ -0,0 +1,147 @@
+#include "common.h"
+#include "trace.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* Events per thread.  When a thread records more, the oldest are lost. */
+#define TRACE_BUFFER_EVENTS (1 << 16)
+
+typedef struct {
+    uint64_t ns;
+    const char *name;
+    int64_t value;
+    TraceEventType type;
+} TraceEvent;
+
+/* Each thread only writes to its own buffer, so recording is a store
+   and an increment.  Buffers are never freed, they're dumped at exit. */
+typedef struct TraceBuffer {
+    struct TraceBuffer *next;
+    int tid;
+    atomic_uint_fast64_t head;
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+} TraceBuffer;
+
+int Trace_Enabled = -1;
+
+static const char *Trace_File = NULL;
+static uint64_t Trace_Start_ns = 0;
+static _Atomic(TraceBuffer *) Trace_Buffers = NULL;
+static atomic_int Trace_Num_Threads = 0;
+static _Thread_local TraceBuffer *Trace_My_Buffer = NULL;
+
+static inline uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+bool trace_init() {
+    static atomic_flag registered = ATOMIC_FLAG_INIT;
+
+    Trace_File = getenv("ADVENT_TRACE");
+    if( !Trace_File || is_empty(Trace_File) ) {
+        Trace_Enabled = 0;
+        return false;
+    }
+
+    if( !atomic_flag_test_and_set(&registered) ) {
+        Trace_Start_ns = now_ns();
+        atexit(trace_dump);
+    }
+
+    Trace_Enabled = 1;
+    return true;
+}
+
+static TraceBuffer *TraceBuffer_new() {
+    TraceBuffer *self = calloc(1, sizeof(TraceBuffer));
+    if( !self )
+        die("Could not allocate a trace buffer");
+
+    self->tid = atomic_fetch_add(&Trace_Num_Threads, 1) + 1;
+    atomic_init(&self->head, 0);
+
+    /* Lock-free push onto the list of all buffers */
+    TraceBuffer *next = atomic_load(&Trace_Buffers);
+    do {
+        self->next = next;
+    } while( !atomic_compare_exchange_weak(&Trace_Buffers, &next, self) );
+
+    return self;
+}
+
+void trace_record(TraceEventType type, const char *name, int64_t value) {
+    TraceBuffer *buf = Trace_My_Buffer;
+    if( G_UNLIKELY(!buf) )
+        buf = Trace_My_Buffer = TraceBuffer_new();
+
+    uint64_t head = atomic_load_explicit(&buf->head, memory_order_relaxed);
+    TraceEvent *event = &buf->events[head % TRACE_BUFFER_EVENTS];
+
+    event->ns    = now_ns();
+    event->name  = name;
+    event->value = value;
+    event->type  = type;
+
+    atomic_store_explicit(&buf->head, head + 1, memory_order_release);
+}
+
+static void print_json_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for( ; *str; str++ ) {
+        if( *str == '"' || *str == '\\' )
+            fputc('\\', out);
+        fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+static void TraceBuffer_dump(TraceBuffer *self, FILE *out, int pid, bool *first) {
+    uint64_t head  = atomic_load_explicit(&self->head, memory_order_acquire);
+    uint64_t start = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+
+    for( uint64_t i = start; i < head; i++ ) {
+        TraceEvent *event = &self->events[i % TRACE_BUFFER_EVENTS];
+        double ts = (double)(event->ns - Trace_Start_ns) / 1000.0;
+
+        fputs(*first ? "\n" : ",\n", out);
+        *first = false;
+
+        fputs("{\"name\":", out);
+        print_json_string(out, event->name);
+        fprintf(out, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+                event->type, ts, pid, self->tid);
+        if( event->type == TRACE_COUNTER_EVENT )
+            fprintf(out, ",\"args\":{\"value\":%lld}", (long long)event->value);
+        fputc('}', out);
+    }
+}
+
+/* Writes everything recorded so far to $ADVENT_TRACE */
+void trace_dump() {
+    if( Trace_Enabled != 1 )
+        return;
+
+    FILE *out = fopen(Trace_File, "w");
+    if( !out ) {
+        fprintf(stderr, "Could not write trace to %s: %s.\n", Trace_File, strerror(errno));
+        return;
+    }
+
+    int pid = getpid();
+    bool first = true;
+
+    fputs("{\"traceEvents\":[", out);
+    for( TraceBuffer *buf = atomic_load(&Trace_Buffers); buf != NULL; buf = buf->next ) {
+        TraceBuffer_dump(buf, out, pid, &first);
+    }
+    fputs("\n],\"displayTimeUnit\":\"ns\"}\n", out);
+
+    fclose(out);
+}
@@ -0,0 +1,47 @@
+#ifndef _trace_h
+#define _trace_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+
+/* Low overhead tracing of hot paths.
+
+   Set ADVENT_TRACE to a file name and begin/end/counter events are
+   recorded into a per-thread ring buffer, then written to that file as
+   Chrome trace JSON at exit.  Load it in chrome://tracing or
+   ui.perfetto.dev.  When ADVENT_TRACE is not set, each macro is a
+   single predictable branch.
+
+   Names must be string constants, only the pointer is recorded. */
+
+typedef enum {
+    TRACE_BEGIN_EVENT   = 'B',
+    TRACE_END_EVENT     = 'E',
+    TRACE_COUNTER_EVENT = 'C'
+} TraceEventType;
+
+/* -1 until the environment is checked, then 0 or 1 */
+extern int Trace_Enabled;
+
+bool trace_init();
+void trace_record(TraceEventType type, const char *name, int64_t value);
+void trace_dump();
+
+static inline bool trace_enabled() {
+    if( G_UNLIKELY(Trace_Enabled < 0) )
+        return trace_init();
+
+    return Trace_Enabled;
+}
+
+#define TRACE_BEGIN(name) \
+    do { if( G_UNLIKELY(trace_enabled()) ) trace_record(TRACE_BEGIN_EVENT, name, 0); } while(0)
+
+#define TRACE_END(name) \
+    do { if( G_UNLIKELY(trace_enabled()) ) trace_record(TRACE_END_EVENT, name, 0); } while(0)
+
+#define TRACE_COUNTER(name, value) \
+    do { if( G_UNLIKELY(trace_enabled()) ) trace_record(TRACE_COUNTER_EVENT, name, value); } while(0)
+
+#endif
@@ -0,0 +1,181 @@
+#include "common.h"
+#include "tune.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define TUNE_NAME_MAX 64
+
+char *tune_file() {
+    const char *file = getenv("ADVENT_TUNE");
+    if( file && !is_empty(file) )
+        return g_strdup(file);
+
+    const char *dir = getenv("XDG_CONFIG_HOME");
+    if( dir && !is_empty(dir) )
+        return g_build_filename(dir, "advent", "tune", NULL);
+
+    dir = getenv("HOME");
+    if( !dir || is_empty(dir) )
+        return NULL;
+
+    return g_build_filename(dir, ".config", "advent", "tune", NULL);
+}
+
+static void tune_host(char *host, size_t size) {
+    if( gethostname(host, size) < 0 || is_empty(host) )
+        snprintf(host, size, "localhost");
+    host[size-1] = '\0';
+}
+
+int tune_bucket(long size) {
+    if( size < 2 )
+        return 0;
+
+    return floor(2 * log2(size));
+}
+
+static int engine_index(const char *engines[], const char *name) {
+    for( int i = 0; engines[i] != NULL; i++ ) {
+        if( streq(engines[i], name) )
+            return i;
+    }
+
+    return -1;
+}
+
+/* The engine ADVENT_ENGINE forces for this solver, or -1 */
+static int tune_forced(const char *solver, const char *engines[]) {
+    const char *want = getenv("ADVENT_ENGINE");
+    if( !want || is_empty(want) )
+        return -1;
+
+    char *copy = strdup(want);
+    char *save = NULL;
+    int engine = -1;
+
+    for( char *pair = strtok_r(copy, ",", &save); pair != NULL; pair = strtok_r(NULL, ",", &save) ) {
+        char *name = strchr(pair, '=');
+        if( !name )
+            die("ADVENT_ENGINE wants solver=engine, not '%s'", pair);
+        *name++ = '\0';
+
+        if( !streq(pair, solver) )
+            continue;
+
+        engine = engine_index(engines, name);
+        if( engine < 0 )
+            die("%s has no engine '%s'", solver, name);
+    }
+
+    free(copy);
+
+    return engine;
+}
+
+/* One line of the tune file, false if it's a comment or junk */
+static bool tune_parse(const char *line, char *host, char *solver, int *bucket, char *engine) {
+    return sscanf(line, "%63s %63s %d %63s", host, solver, bucket, engine) == 4 &&
+           host[0] != '#';
+}
+
+/* The file is a few lines, so it's read on every call rather than
+   cached, it might be being tuned. */
+int tune_engine(const char *solver, const char *engines[], long size, int fallback) {
+    int forced = tune_forced(solver, engines);
+    if( forced >= 0 )
+        return forced;
+
+    char *file = tune_file();
+    FILE *fp = file ? fopen(file, "r") : NULL;
+    g_free(file);
+    if( !fp )
+        return fallback;
+
+    char my_host[TUNE_NAME_MAX];
+    tune_host(my_host, sizeof(my_host));
+    int want_bucket = tune_bucket(size);
+
+    int best = fallback;
+    int best_distance = INT_MAX;
+    char *line = NULL;
+    size_t len = 0;
+    while( getline(&line, &len, fp) > 0 ) {
+        char host[TUNE_NAME_MAX], name[TUNE_NAME_MAX], engine_name[TUNE_NAME_MAX];
+        int bucket;
+
+        if( !tune_parse(line, host, name, &bucket, engine_name) )
+            continue;
+        if( !streq(host, my_host) || !streq(name, solver) )
+            continue;
+
+        /* An engine which has since been removed */
+        int engine = engine_index(engines, engine_name);
+        if( engine < 0 )
+            continue;
+
+        /* Ties go to the smaller bucket, it's the one measured */
+        int distance = abs(bucket - want_bucket);
+        if( distance < best_distance || (distance == best_distance && bucket < want_bucket) ) {
+            best = engine;
+            best_distance = distance;
+        }
+    }
+
+    free(line);
+    fclose(fp);
+
+    return best;
+}
+
+/* The file is rewritten whole, as a temp file renamed into place, so
+   a solver reading it never sees half of it. */
+void tune_save(const char *solver, int bucket, const char *engine) {
+    char *file = tune_file();
+    if( !file )
+        die("Set ADVENT_TUNE to say where to save the tuning");
+
+    char *dir = g_path_get_dirname(file);
+    if( g_mkdir_with_parents(dir, 0777) < 0 )
+        die("Could not make %s: %s", dir, strerror(errno));
+    g_free(dir);
+
+    char *tmp = g_strdup_printf("%s.XXXXXX", file);
+    int fd = mkstemp(tmp);
+    if( fd < 0 )
+        die("Could not make %s: %s", tmp, strerror(errno));
+    FILE *out = fdopen(fd, "w");
+
+    char my_host[TUNE_NAME_MAX];
+    tune_host(my_host, sizeof(my_host));
+
+    /* Everything but the line this replaces */
+    FILE *in = fopen(file, "r");
+    if( in ) {
+        char *line = NULL;
+        size_t len = 0;
+        while( getline(&line, &len, in) > 0 ) {
+            char host[TUNE_NAME_MAX], name[TUNE_NAME_MAX], old_engine[TUNE_NAME_MAX];
+            int old_bucket;
+
+            if( tune_parse(line, host, name, &old_bucket, old_engine) &&
+                streq(host, my_host) && streq(name, solver) && old_bucket == bucket )
+                continue;
+
+            fputs(line, out);
+        }
+        free(line);
+        fclose(in);
+    }
+
+    fprintf(out, "%s %s %d %s\n", my_host, solver, bucket, engine);
+
+    if( fclose(out) != 0 )
+        die("Could not write %s: %s", tmp, strerror(errno));
+    if( rename(tmp, file) < 0 )
+        die("Could not rename %s to %s: %s", tmp, file, strerror(errno));
+
+    g_free(tmp);
+    g_free(file);
+}
@@ -0,0 +1,43 @@
+#ifndef _tune_h
+#define _tune_h
+
+/* Pick between a solver's engines by the size of its input.
+
+   Some solvers have more than one way to do the work, each best at a
+   different scale.  The graph route search is quickest by brute force
+   on a handful of cities and by dynamic programming past that.  The
+   engines are named in a NULL terminated table, and the solver asks
+   which one to use at this size:
+
+       const char *Graph_Engines[] = { "search", "dp", NULL };
+
+       int engine = tune_engine("graph", Graph_Engines, num_nodes, GRAPH_SEARCH);
+
+   The answer comes from the tune file, which advent --tune writes by
+   timing each engine on generated inputs and recording the winner for
+   each size bucket on each host.  A bucket is half a power of two.  An
+   untuned bucket takes the winner of the nearest tuned one.  If nothing
+   is tuned for the solver on this host, it gets the fallback.
+
+   The tune file is $ADVENT_TUNE, else $XDG_CONFIG_HOME/advent/tune,
+   else ~/.config/advent/tune.  It has one line per winner, which can
+   be edited by hand:
+
+       <host> <solver> <bucket> <engine>
+
+   Set ADVENT_ENGINE to solver=engine[,solver=engine...] to force an
+   engine.  That's how advent --tune tries each one. */
+
+int tune_engine(const char *solver, const char *engines[], long size, int fallback);
+
+/* floor(2 * log2(size)), 0 below 2 */
+int tune_bucket(long size);
+
+/* Record engine as the winner in solver's bucket on this host */
+void tune_save(const char *solver, int bucket, const char *engine);
+
+/* The path to the tune file, to be freed, or NULL if there's no home
+   to put it in */
+char *tune_file();
+
+#endif
@@ -0,0 +1,32 @@
+#include "common.h"
+#include "vec.h"
+
+Vec *Vec_new(size_t elem_size, size_t expected) {
+    Vec *self = calloc(1, sizeof(Vec));
+
+    self->elem_size = elem_size;
+    if( expected )
+        Vec_reserve(self, expected);
+
+    return self;
+}
+
+void Vec_destroy(Vec *self) {
+    free(self->data);
+    free(self);
+}
+
+void Vec_reserve(Vec *self, size_t capacity) {
+    if( capacity <= self->capacity )
+        return;
+
+    self->data = realloc(self->data, capacity * self->elem_size);
+    if( !self->data )
+        die("Out of memory growing a vector to %zu", capacity);
+
+    self->capacity = capacity;
+}
+
+void Vec_sort(Vec *self, int (*cmp)(const void *, const void *)) {
+    qsort(self->data, self->len, self->elem_size, cmp);
+}
@@ -0,0 +1,45 @@
+#ifndef _vec_h
+#define _vec_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A growable array of fixed size elements, instead of GArray.
+
+   Vec_index() is the same as g_array_index(), it's a plain array
+   underneath.  Growth doubles, so appends are amortized constant. */
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+    size_t elem_size;
+} Vec;
+
+#define Vec_index(vec, type, i) (((type *)(void *)(vec)->data)[(i)])
+
+Vec *Vec_new(size_t elem_size, size_t expected);
+void Vec_destroy(Vec *self);
+void Vec_reserve(Vec *self, size_t capacity);
+void Vec_sort(Vec *self, int (*cmp)(const void *, const void *));
+
+static inline void *Vec_push(Vec *self, const void *elem) {
+    if( self->len == self->capacity )
+        Vec_reserve(self, self->capacity ? self->capacity * 2 : 8);
+
+    void *slot = self->data + self->len * self->elem_size;
+    memcpy(slot, elem, self->elem_size);
+    self->len++;
+
+    return slot;
+}
+
+#define Vec_push_val(vec, val) Vec_push((vec), &(val))
+
+static inline void Vec_clear(Vec *self) {
+    self->len = 0;
+}
+
+#endif
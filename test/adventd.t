@@ -0,0 +1,52 @@
+#!/bin/sh
+
+# adventd answers the same as running the day directly, both for
+# input files and for input sent inline.
+
+. `dirname $0`/lib.sh
+
+advent=${ADVENT:-./advent/advent}
+case $advent in
+    /*) ;;
+    *)  advent=`pwd`/$advent ;;
+esac
+socket=`mktemp -u /tmp/adventd.t.XXXXXX`
+
+$advent --daemon $socket 2 2>/dev/null &
+daemon=$!
+trap 'kill $daemon' EXIT
+
+# Wait for the daemon to start listening
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    test -S $socket && break
+    sleep 0.1
+done
+
+for day in 1 2 9; do
+    want=`$advent $day day$day/input`
+
+    check "day$day from a file" \
+        "`$advent --client $socket $day day$day/input`" "$want"
+    check "day$day inline" \
+        "`$advent --client $socket $day - < day$day/input`" "$want"
+done
+
+check "status" "`$advent --client $socket 1 day1/input > /dev/null; echo $?`" 0
+
+# Relative to the client, not the daemon
+check "relative path" \
+    "`cd day2 && $advent --client $socket 2 input`" "`$advent 2 day2/input`"
+
+# A solver dying takes out its worker, the daemon replaces it
+check "dying solver's status" \
+    "`$advent --client $socket 1 /no/such/file > /dev/null 2>&1; echo $?`" \
+    "`$advent 1 /no/such/file > /dev/null 2>&1; echo $?`"
+check "still serving after a worker dies" \
+    "`$advent --client $socket 1 day1/input`" "`$advent 1 day1/input`"
+
+check "unknown day" \
+    "`$advent --client $socket 42`" "There is no solver for day 42"
+check "unknown day's status" \
+    "`$advent --client $socket 42 > /dev/null; echo $?`" 1
+
+done_testing
@@ -0,0 +1,37 @@
+#!/bin/sh
+
+# advent --batch gives the same answers as running each input
+# directly, one line per input, in file name order.
+
+. `dirname $0`/lib.sh
+
+advent=${ADVENT:-./advent/advent}
+gen=${GEN:-./bench/gen}
+dir=`mktemp -d /tmp/batch.t.XXXXXX`
+trap 'rm -rf $dir' EXIT
+
+# Like a batch result, but from running the day directly
+direct() {
+    day=$1
+    file=$2
+    printf '%s\t0\t' $file
+    $advent $day $file | awk 'NR > 1 { printf "\\n" } { printf "%s", $0 } END { print "" }'
+}
+
+for day in 1 2; do
+    mkdir $dir/day$day
+    for i in 1 2 3 4 5 6 7 8 9 10 11 12; do
+        $gen $day $((i * 100)) $i > $dir/day$day/input`printf %02d $i`
+    done
+
+    want=`for file in $dir/day$day/*; do direct $day $file; done`
+    check "day$day batch" "`$advent --batch $day $dir/day$day`" "$want"
+    check "day$day batch with one worker" \
+        "`$advent --batch --workers 1 $day $dir/day$day`" "$want"
+done
+
+check "json lines" \
+    "`$advent --batch --json 1 $dir/day1/input01 | sed 's/,"output".*//'`" \
+    "{\"input\":\"$dir/day1/input01\",\"status\":0"
+
+done_testing
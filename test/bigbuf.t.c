@@ -0,0 +1,59 @@
+#include "common.h"
+#include "bigbuf.h"
+#include "pool.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static void check_buf(size_t size) {
+    unsigned char *buf = bigbuf_new(size);
+    assert( buf != NULL );
+
+    for( size_t i = 0; i < size; i++ ) {
+        assert( buf[i] == 0 );
+    }
+
+    /* Big ones are on their own huge page boundary */
+    if( size >= BIGBUF_MIN )
+        assert( (uintptr_t)buf % BIGBUF_HUGE_PAGE == 0 );
+
+    memset(buf, 0xff, size);
+    bigbuf_free(buf, size);
+}
+
+static void test_sizes() {
+    check_buf(1);
+    check_buf(4096);
+    check_buf(BIGBUF_MIN - 1);
+    check_buf(BIGBUF_MIN);
+    check_buf(BIGBUF_HUGE_PAGE + 3);
+    check_buf(1000 * 1000 * sizeof(int16_t));
+
+    /* Freeing nothing is fine, like free() */
+    bigbuf_free(NULL, BIGBUF_HUGE_PAGE);
+}
+
+static void test_touch() {
+    long rows = 1000;
+    size_t row_size = 1000 * sizeof(short);
+    short *grid = bigbuf_new(rows * row_size);
+
+    bigbuf_touch(grid, rows, 16, row_size);
+
+    for( long i = 0; i < rows * 1000; i++ ) {
+        assert( grid[i] == 0 );
+    }
+
+    bigbuf_free(grid, rows * row_size);
+}
+
+int main(int argc, char **argv) {
+    pool_set_threads(4);
+
+    test_sizes();
+    test_touch();
+
+    printf("%s: PASS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+
+# advent --cache gives the same answers as running directly, keeps
+# them, and misses when the input or arguments change.
+
+. `dirname $0`/lib.sh
+
+advent=${ADVENT:-./advent/advent}
+gen=${GEN:-./bench/gen}
+dir=`mktemp -d /tmp/cache.t.XXXXXX`
+trap 'rm -rf $dir' EXIT
+
+ADVENT_CACHE=$dir/cache
+export ADVENT_CACHE
+
+num_entries() {
+    find $ADVENT_CACHE -mindepth 2 -maxdepth 2 -type d | grep -vc '\.tmp\.'
+}
+
+$gen 1 1000 1 > $dir/input
+answer=`$advent 1 $dir/input`
+
+check "first run" "`$advent --cache 1 $dir/input`" "$answer"
+check "saved" "`num_entries`" 1
+check "second run" "`$advent --cache 1 $dir/input`" "$answer"
+check "no new entry" "`num_entries`" 1
+
+# Edited in place, same name
+$gen 1 1000 2 > $dir/input
+check "changed input" "`$advent --cache 1 $dir/input`" "`$advent 1 $dir/input`"
+check "new entry" "`num_entries`" 2
+
+# No input file, so stdin is part of the key
+check "arguments" "`$advent --cache 10 1 5 < /dev/null`" "`$advent 10 1 5`"
+check "different arguments" "`$advent --cache 10 1 6 < /dev/null`" "`$advent 10 1 6`"
+check "entry per argument" "`num_entries`" 4
+
+$gen 8 100 1 > $dir/stdin1
+$gen 8 100 2 > $dir/stdin2
+check "stdin" "`$advent --cache 8 < $dir/stdin1`" "`$advent 8 < $dir/stdin1`"
+check "different stdin" "`$advent --cache 8 < $dir/stdin2`" "`$advent 8 < $dir/stdin2`"
+check "same stdin" "`$advent --cache 8 < $dir/stdin1`" "`$advent 8 < $dir/stdin1`"
+check "entry per stdin" "`num_entries`" 6
+
+# Failures are not kept
+$advent --cache 1 $dir/no-such-file > /dev/null 2>&1
+check "failure not saved" "`num_entries`" 6
+
+done_testing
@@ -0,0 +1,45 @@
+#!/bin/sh
+
+# Inputs compressed with gzip or zstd give the same answers as the
+# plain input, from a file, stdin or a pipe, and one which can't be
+# decompressed fails.
+
+. `dirname $0`/lib.sh
+
+advent=${ADVENT:-./advent/advent}
+gen=${GEN:-./bench/gen}
+dir=`mktemp -d /tmp/compressed.t.XXXXXX`
+trap 'rm -rf $dir' EXIT
+
+for day in 2 5 8; do
+    $gen $day 2000 1 > $dir/input$day
+    answer=`$advent $day $dir/input$day`
+
+    gzip -c $dir/input$day > $dir/input$day.gz
+    check "day $day gzip" "`$advent $day $dir/input$day.gz`" "$answer"
+    check "day $day gzip redirected" "`$advent $day /dev/stdin < $dir/input$day.gz`" "$answer"
+    check "day $day gzip pipe" "`cat $dir/input$day.gz | $advent $day /dev/stdin`" "$answer"
+
+    if command -v zstd > /dev/null; then
+        zstd -q -c $dir/input$day > $dir/input$day.zst
+        check "day $day zstd" "`$advent $day $dir/input$day.zst`" "$answer"
+    else
+        echo "ok - day $day zstd # skip no zstd"
+    fi
+done
+
+# Day 8 reads stdin when it's given no file
+check "gzip stdin" "`cat $dir/input8.gz | $advent 8`" "`$advent 8 $dir/input8`"
+
+# Cut short, gzip complains at the end, then we do
+head -c 1000 $dir/input2.gz > $dir/corrupt.gz
+$advent 2 $dir/corrupt.gz > /dev/null 2> $dir/err
+check "corrupt gzip fails" "$?" 1
+check "corrupt gzip says so" "`tail -1 $dir/err`" "gzip could not decompress $dir/corrupt.gz, it exited with 1."
+
+# No gzip to run
+(PATH=/nonexistent; $advent 2 $dir/input2.gz > /dev/null 2> $dir/err)
+check "missing gzip fails" "$?" 1
+check "missing gzip says so" "`cat $dir/err`" "Could not run gzip for $dir/input2.gz: No such file or directory."
+
+done_testing
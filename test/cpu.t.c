@@ -0,0 +1,91 @@
+#include "common.h"
+#include "cpu.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static int which_generic() { return CPU_GENERIC; }
+static int which_sse42()   { return CPU_SSE42; }
+static int which_avx2()    { return CPU_AVX2; }
+static int which_avx512()  { return CPU_AVX512; }
+
+typedef int (*WhichFunc)();
+
+void test_names() {
+    for( int level = 0; level < NUM_CPU_LEVELS; level++ ) {
+        assert( cpu_level_from_name(cpu_level_name(level)) == level );
+    }
+
+    assert( cpu_level_from_name("avx9000") == -1 );
+    assert( streq(cpu_level_name(NUM_CPU_LEVELS), "unknown") );
+}
+
+void test_best_available() {
+    /* Nothing forced, so it's what the CPU has */
+    unsetenv("ADVENT_CPU");
+    assert( cpu_level() == cpu_detect() );
+
+    const CpuImpl every_level[] = {
+        CPU_IMPL(CPU_GENERIC, which_generic),
+        CPU_IMPL(CPU_SSE42,   which_sse42),
+        CPU_IMPL(CPU_AVX2,    which_avx2),
+        CPU_IMPL(CPU_AVX512,  which_avx512),
+        CPU_IMPL_END
+    };
+    WhichFunc which = (WhichFunc)cpu_dispatch("which", every_level);
+    assert( which() == (int)cpu_detect() );
+
+    /* Out of order and with a gap, the highest runnable one wins */
+    const CpuImpl impls[] = {
+        CPU_IMPL(CPU_AVX2,    which_avx2),
+        CPU_IMPL(CPU_GENERIC, which_generic),
+        CPU_IMPL_END
+    };
+    which = (WhichFunc)cpu_dispatch("which", impls);
+    assert( which() == (cpu_detect() >= CPU_AVX2 ? CPU_AVX2 : CPU_GENERIC) );
+}
+
+/* Run by test_forced_generic() in a fresh copy of the test */
+int forced_generic() {
+    const CpuImpl impls[] = {
+        CPU_IMPL(CPU_GENERIC, which_generic),
+        CPU_IMPL(CPU_SSE42,   which_sse42),
+        CPU_IMPL(CPU_AVX2,    which_avx2),
+        CPU_IMPL(CPU_AVX512,  which_avx512),
+        CPU_IMPL_END
+    };
+    WhichFunc which = (WhichFunc)cpu_dispatch("which", impls);
+
+    return cpu_level() == CPU_GENERIC && which() == CPU_GENERIC ? 0 : 1;
+}
+
+/* The level is worked out once per process, so this runs again */
+void test_forced_generic(char *self) {
+    pid_t pid = fork();
+    assert( pid >= 0 );
+
+    if( pid == 0 ) {
+        setenv("ADVENT_CPU", "generic", 1);
+        execl(self, self, "--forced-generic", (char *)NULL);
+        _exit(127);
+    }
+
+    int status;
+    assert( waitpid(pid, &status, 0) == pid );
+    assert( WIFEXITED(status) && WEXITSTATUS(status) == 0 );
+}
+
+int main(int argc, char **argv) {
+    if( argc == 2 && streq(argv[1], "--forced-generic") )
+        return forced_generic();
+
+    test_names();
+    test_best_available();
+    test_forced_generic(argv[0]);
+
+    printf("%s: PASS\n", argv[0]);
+
+    return 0;
+}
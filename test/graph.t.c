@@ -1,6 +1,7 @@
 #include "graph.h"
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 void test_increment() {
     Graph *graph = Graph_new(20);
@@ -24,8 +25,41 @@ void test_lookup_or_add() {
     assert( foo_num != bar_num );
 }
 
+static GraphCost route_cost(Graph *graph, const char *engine, int start, bool return_to_start) {
+    setenv("ADVENT_ENGINE", engine, 1);
+    GraphCost cost = start < 0 ? Graph_shortest_route_cost(graph, return_to_start)
+                               : Graph_shortest_route_cost_from(graph, start, return_to_start);
+    unsetenv("ADVENT_ENGINE");
+
+    return cost;
+}
+
+/* Every engine finds the same routes */
+void test_engines() {
+    for( GraphNodeNum num_nodes = 2; num_nodes <= 8; num_nodes++ ) {
+        Graph *graph = Graph_new(20);
+
+        for( GraphNodeNum from = 0; from < num_nodes; from++ ) {
+            for( GraphNodeNum to = from + 1; to < num_nodes; to++ ) {
+                Graph_add(graph, from, to, (from * 37 + to * 91) % 50 + 1);
+            }
+        }
+        graph->num_nodes = num_nodes;
+
+        for( int start = -1; start < 2; start++ ) {
+            for( int round = 0; round < 2; round++ ) {
+                assert( route_cost(graph, "graph=search", start, round) ==
+                        route_cost(graph, "graph=dp",     start, round) );
+            }
+        }
+
+        Graph_destroy(graph);
+    }
+}
+
 int main(int argc, char **argv) {
     test_lookup_or_add();
     test_increment();
+    test_engines();
     printf("%s: PASS\n", argv[0]);
 }
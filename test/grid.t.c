@@ -0,0 +1,68 @@
+#include "common.h"
+#include "grid.h"
+#include <assert.h>
+#include <stdio.h>
+
+static const GridLayout Layouts[] = { GRID_ROWS, GRID_TILED, GRID_MORTON };
+#define NUM_LAYOUTS (sizeof(Layouts) / sizeof(Layouts[0]))
+
+/* Every cell, halo and all, has its own place */
+static void test_cells(GridLayout layout, size_t rows, size_t cols, size_t halo) {
+    Grid *grid = Grid_new(rows, cols, sizeof(int), layout, halo);
+    long lo = -(long)halo;
+
+    for( long row = lo; row < (long)(rows + halo); row++ ) {
+        for( long col = lo; col < (long)(cols + halo); col++ ) {
+            assert( Grid_at(grid, int, row, col) == 0 );
+            assert( Grid_cell(grid, row, col) * sizeof(int) < grid->size );
+            Grid_at(grid, int, row, col) = row * 100000 + col;
+        }
+    }
+
+    for( long row = lo; row < (long)(rows + halo); row++ ) {
+        for( long col = lo; col < (long)(cols + halo); col++ ) {
+            assert( Grid_at(grid, int, row, col) == row * 100000 + col );
+            assert( Grid_at_in(grid, int, layout, row, col) == row * 100000 + col );
+        }
+    }
+
+    assert( Grid_in_bounds(grid, 0, 0) );
+    assert( Grid_in_bounds(grid, rows - 1, cols - 1) );
+    assert( !Grid_in_bounds(grid, -1, 0) );
+    assert( !Grid_in_bounds(grid, 0, cols) );
+
+    Grid_clear(grid);
+    assert( Grid_at(grid, int, rows - 1, cols - 1) == 0 );
+
+    Grid_destroy(grid);
+}
+
+static void test_layouts() {
+    for( size_t i = 0; i < NUM_LAYOUTS; i++ ) {
+        test_cells(Layouts[i], 1, 1, 0);
+        test_cells(Layouts[i], 6, 6, 1);
+        test_cells(Layouts[i], 100, 37, 1);
+        test_cells(Layouts[i], 5, 300, 2);
+    }
+}
+
+static void test_names() {
+    for( size_t i = 0; i < NUM_LAYOUTS; i++ ) {
+        assert( grid_layout_from_name(grid_layout_name(Layouts[i])) == (int)Layouts[i] );
+    }
+    assert( grid_layout_from_name("diagonal") == -1 );
+
+    setenv("ADVENT_GRID", "morton", 1);
+    assert( grid_layout(GRID_ROWS) == GRID_MORTON );
+    unsetenv("ADVENT_GRID");
+    assert( grid_layout(GRID_ROWS) == GRID_ROWS );
+}
+
+int main(int argc, char **argv) {
+    test_layouts();
+    test_names();
+
+    printf("%s: PASS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+# Shared by the shell tests, sourced with
+#
+#     . `dirname $0`/lib.sh
+#
+# Each check prints a TAP style "ok" or "not ok" line.  done_testing
+# prints the PASS line if they all passed and exits with the result.
+
+fail=0
+
+check() {
+    name="$1"
+    have="$2"
+    want="$3"
+
+    if [ "$have" = "$want" ]; then
+        echo "ok - $name"
+    else
+        echo "not ok - $name"
+        echo "# have: $have"
+        echo "# want: $want"
+        fail=1
+    fi
+}
+
+done_testing() {
+    if [ $fail = 0 ]; then
+        echo "$0: PASS"
+    fi
+    exit $fail
+}
@@ -0,0 +1,116 @@
+#include "common.h"
+#include "map.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void test_intmap() {
+    IntMap *map = IntMap_new(0);
+    int64_t value;
+
+    assert( IntMap_size(map) == 0 );
+    assert( !IntMap_has(map, 0) );
+
+    assert( IntMap_put(map, 0, 10) );
+    assert( IntMap_put(map, -1, 20) );
+    assert( IntMap_put(map, INT64_MAX, 30) );
+    assert( !IntMap_put(map, 0, 11) );
+    assert( IntMap_size(map) == 3 );
+
+    assert( IntMap_get(map, 0, &value) && value == 11 );
+    assert( IntMap_get(map, -1, &value) && value == 20 );
+    assert( IntMap_get(map, INT64_MAX, &value) && value == 30 );
+    assert( !IntMap_get(map, 1, &value) );
+
+    IntMap_destroy(map);
+}
+
+void test_intmap_grow() {
+    IntMap *map = IntMap_new(0);
+
+    /* Keys which differ only in their high bits */
+    for( int64_t i = 0; i < 100000; i++ ) {
+        assert( IntMap_put(map, i << 32, i) );
+    }
+    assert( IntMap_size(map) == 100000 );
+
+    for( int64_t i = 0; i < 100000; i++ ) {
+        int64_t value;
+        assert( IntMap_get(map, i << 32, &value) && value == i );
+    }
+    assert( !IntMap_has(map, 1) );
+
+    IntMap_destroy(map);
+}
+
+static void count_entries(const char *key, void *value, void *count) {
+    (*(int *)count)++;
+}
+
+static void check_sorted(const char *key, void *value, void *last) {
+    assert( strcmp(*(const char **)last, key) < 0 );
+    *(const char **)last = key;
+}
+
+void test_strmap() {
+    StrMap *map = StrMap_new(0);
+    void *value;
+
+    assert( StrMap_get(map, "a") == NULL );
+
+    assert( StrMap_put(map, "a", "one") );
+    assert( StrMap_put(map, "b", NULL) );
+    assert( !StrMap_put(map, "a", "uno") );
+    assert( StrMap_size(map) == 2 );
+
+    assert( streq(StrMap_get(map, "a"), "uno") );
+
+    /* Keys are compared by value, not pointer */
+    char key[] = "a";
+    assert( streq(StrMap_get(map, key), "uno") );
+
+    /* Present with a NULL value is different from absent */
+    assert( StrMap_lookup(map, "b", &value) && value == NULL );
+    assert( !StrMap_lookup(map, "c", &value) );
+
+    StrMap_destroy(map, NULL);
+}
+
+void test_strmap_grow() {
+    StrMap *map = StrMap_new(0);
+    char **keys = calloc(5000, sizeof(char *));
+
+    for( int i = 0; i < 5000; i++ ) {
+        keys[i] = num_to_str(i);
+        assert( StrMap_put(map, keys[i], keys[i]) );
+    }
+    assert( StrMap_size(map) == 5000 );
+
+    for( int i = 0; i < 5000; i++ ) {
+        char *key = num_to_str(i);
+        assert( StrMap_get(map, key) == keys[i] );
+        free(key);
+    }
+
+    int count = 0;
+    StrMap_foreach(map, count_entries, &count);
+    assert( count == 5000 );
+
+    const char *last = "";
+    StrMap_foreach_sorted(map, check_sorted, &last);
+    assert( streq(last, "999") );
+
+    StrMap_destroy(map, free);
+    free(keys);
+}
+
+int main(int argc, char **argv) {
+    test_intmap();
+    test_intmap_grow();
+    test_strmap();
+    test_strmap_grow();
+
+    printf("%s: PASS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,357 @@
+#include "common.h"
+#include "graph.h"
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Times the lib/ primitives on their own, so a change to one can be
+   measured without the noise of a whole solver.
+
+   microbench [--samples <n>] [--min-time <ms>] [<name>...]
+
+   Each benchmark runs in two variants.
+
+   warm: the iteration count is doubled until one sample takes at least
+   --min-time, then that many iterations are timed over and over.  The
+   data and code stay in cache, this is the best case.
+
+   cold: a buffer bigger than the last level cache is walked before
+   each sample, then a single iteration is timed.  This is closer to a
+   helper called once in a while between other work.
+
+   Times are per item: a line for foreach_line and is_blank, a call for
+   the rest.  Only the benchmarks whose names contain one of the
+   arguments are run. */
+
+typedef struct {
+    const char *name;
+    /* What one item is, for the report */
+    const char *item;
+    void *(*setup)(long *items);
+    void  (*run)(void *data);
+    void  (*teardown)(void *data);
+} Bench;
+
+typedef struct {
+    double min;
+    double median;
+    double mean;
+    double stddev;
+} BenchStats;
+
+/* Bigger than any last level cache we're likely to run on */
+#define EVICT_SIZE (64 * 1024 * 1024)
+
+static int Samples  = 31;
+static double Min_Time = 0.01;
+
+/* Results go here so the compiler can't throw the work away */
+static volatile long Sink = 0;
+
+static double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* -------- foreach_line -------- */
+
+#define BENCH_LINES 10000
+
+static void count_line(char *line, void *count) {
+    (*(long *)count)++;
+}
+
+static void *foreach_line_setup(long *items) {
+    FILE *fp = tmpfile();
+    if( !fp )
+        die("Could not make a temp file");
+
+    for( int i = 0; i < BENCH_LINES; i++ ) {
+        fprintf(fp, "%dx%dx%d\n", i % 30 + 1, i % 17 + 1, i % 11 + 1);
+    }
+
+    *items = BENCH_LINES;
+    return fp;
+}
+
+static void foreach_line_run(void *fp) {
+    long count = 0;
+
+    rewind(fp);
+    foreach_line(fp, count_line, &count);
+
+    Sink += count;
+}
+
+static void foreach_line_teardown(void *fp) {
+    fclose(fp);
+}
+
+/* -------- is_blank -------- */
+
+static char *Blank_Lines[] = {
+    "", "\n", "   \n", "\t \n",
+    "turn on 0,0 through 999,999\n",
+    "Alice would gain 54 happiness units by sitting next to Bob.\n",
+    "  x\n", "123 -> x\n",
+    NULL
+};
+
+static void *is_blank_setup(long *items) {
+    long num = 0;
+    while( Blank_Lines[num] )
+        num++;
+
+    *items = num;
+    return Blank_Lines;
+}
+
+static void is_blank_run(void *_lines) {
+    char **lines = _lines;
+
+    for( int i = 0; lines[i] != NULL; i++ ) {
+        Sink += is_blank(lines[i]);
+    }
+}
+
+/* -------- num_to_str -------- */
+
+static long Nums[] = { 0, 7, 42, 1234, 99999, 1234567, 2147483647, -35 };
+
+static void *num_to_str_setup(long *items) {
+    *items = sizeof(Nums) / sizeof(Nums[0]);
+    return Nums;
+}
+
+static void num_to_str_run(void *_nums) {
+    long *nums = _nums;
+
+    for( size_t i = 0; i < sizeof(Nums) / sizeof(Nums[0]); i++ ) {
+        char *str = num_to_str(nums[i]);
+        Sink += str[0];
+        free(str);
+    }
+}
+
+/* -------- compile_regex -------- */
+
+static void *compile_regex_setup(long *items) {
+    *items = 1;
+    return "^(\\w+) would (gain|lose) (\\d+) happiness units by sitting next to (\\w+)\\.$";
+}
+
+static void compile_regex_run(void *pattern) {
+    GRegex *re = compile_regex(pattern, 0, 0);
+    Sink += (long)re & 1;
+    g_regex_unref(re);
+}
+
+/* -------- Graph_lookup_or_add -------- */
+
+static char *Graph_Names[] = {
+    "Faerun", "Tristram", "Tambi", "Norrath",
+    "Snowdin", "Straylight", "AlphaCentauri", "Arbre",
+    NULL
+};
+
+static void *graph_lookup_setup(long *items) {
+    Graph *graph = Graph_new(8);
+
+    /* Timed after the adds, so these are all lookups */
+    for( int i = 0; Graph_Names[i] != NULL; i++ ) {
+        Graph_lookup_or_add(graph, Graph_Names[i]);
+    }
+
+    *items = graph->num_nodes;
+    return graph;
+}
+
+static void graph_lookup_run(void *graph) {
+    for( int i = 0; Graph_Names[i] != NULL; i++ ) {
+        Sink += Graph_lookup_or_add(graph, Graph_Names[i]);
+    }
+}
+
+static void graph_teardown(void *graph) {
+    Graph_destroy(graph);
+}
+
+/* -------- Graph_min_cost -------- */
+
+/* Graph_min_cost() is private, this is one search over all its
+   recursion from a single start, the same as day 9 per start. */
+static void *graph_min_cost_setup(long *items) {
+    GRand *rand = g_rand_new_with_seed(9);
+    Graph *graph = Graph_new(8);
+
+    for( int i = 0; Graph_Names[i] != NULL; i++ ) {
+        Graph_lookup_or_add(graph, Graph_Names[i]);
+    }
+    for( GraphNodeNum from = 0; from < graph->num_nodes; from++ ) {
+        for( GraphNodeNum to = from + 1; to < graph->num_nodes; to++ ) {
+            GraphCost cost = g_rand_int_range(rand, 1, 200);
+            Graph_add(graph, from, to, cost);
+            Graph_add(graph, to, from, cost);
+        }
+    }
+    g_rand_free(rand);
+
+    *items = 1;
+    return graph;
+}
+
+static void graph_min_cost_run(void *graph) {
+    Sink += Graph_shortest_route_cost_from(graph, 0, false);
+}
+
+static Bench Benches[] = {
+    { "foreach_line",        "line",   foreach_line_setup,   foreach_line_run,   foreach_line_teardown },
+    { "is_blank",            "line",   is_blank_setup,       is_blank_run,       NULL },
+    { "num_to_str",          "call",   num_to_str_setup,     num_to_str_run,     NULL },
+    { "compile_regex",       "call",   compile_regex_setup,  compile_regex_run,  NULL },
+    { "Graph_lookup_or_add", "call",   graph_lookup_setup,   graph_lookup_run,   graph_teardown },
+    { "Graph_min_cost",      "search", graph_min_cost_setup, graph_min_cost_run, graph_teardown },
+    { NULL }
+};
+
+static char *Evict_Buf = NULL;
+
+/* Walk a buffer bigger than the caches, one write per cache line */
+static void evict_caches() {
+    if( !Evict_Buf )
+        Evict_Buf = calloc(EVICT_SIZE, 1);
+
+    for( size_t i = 0; i < EVICT_SIZE; i += 64 ) {
+        Evict_Buf[i]++;
+    }
+    Sink += Evict_Buf[EVICT_SIZE / 2];
+}
+
+static double time_iterations(Bench *bench, void *data, long iterations) {
+    double start = now_seconds();
+    for( long i = 0; i < iterations; i++ ) {
+        bench->run(data);
+    }
+
+    return now_seconds() - start;
+}
+
+static long calibrate(Bench *bench, void *data) {
+    long iterations = 1;
+
+    while( time_iterations(bench, data, iterations) < Min_Time && iterations < (1L << 40) )
+        iterations *= 2;
+
+    return iterations;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static BenchStats summarize(double *samples, int num) {
+    BenchStats stats = { .mean = 0, .stddev = 0 };
+
+    qsort(samples, num, sizeof(double), cmp_double);
+    stats.min    = samples[0];
+    stats.median = num % 2 ? samples[num/2] : (samples[num/2 - 1] + samples[num/2]) / 2;
+
+    for( int i = 0; i < num; i++ ) {
+        stats.mean += samples[i];
+    }
+    stats.mean /= num;
+
+    for( int i = 0; i < num; i++ ) {
+        stats.stddev += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+    }
+    stats.stddev = num > 1 ? sqrt(stats.stddev / (num - 1)) : 0;
+
+    return stats;
+}
+
+static void print_stats(Bench *bench, const char *variant, long iterations, BenchStats stats) {
+    printf("%-20s %-5s %12ld %10.1f %10.1f %10.1f %9.1f  ns/%s\n",
+           bench->name, variant, iterations,
+           stats.min, stats.median, stats.mean, stats.stddev, bench->item);
+}
+
+static void run_bench(Bench *bench) {
+    long items = 1;
+    void *data = bench->setup(&items);
+    double *samples = calloc(Samples, sizeof(double));
+
+    /* One untimed run, so lazy setup inside the primitive is done */
+    bench->run(data);
+
+    long iterations = calibrate(bench, data);
+    for( int i = 0; i < Samples; i++ ) {
+        samples[i] = time_iterations(bench, data, iterations) * 1e9 / (iterations * items);
+    }
+    print_stats(bench, "warm", iterations, summarize(samples, Samples));
+
+    for( int i = 0; i < Samples; i++ ) {
+        evict_caches();
+        samples[i] = time_iterations(bench, data, 1) * 1e9 / items;
+    }
+    print_stats(bench, "cold", 1, summarize(samples, Samples));
+
+    free(samples);
+    if( bench->teardown )
+        bench->teardown(data);
+}
+
+static bool wanted(Bench *bench, int argc, char **argv) {
+    if( argc == 0 )
+        return true;
+
+    for( int i = 0; i < argc; i++ ) {
+        if( strstr(bench->name, argv[i]) )
+            return true;
+    }
+
+    return false;
+}
+
+int main(int argc, char **argv) {
+    char *name = argv[0];
+
+    argc--;
+    argv++;
+    while( argc > 0 && argv[0][0] == '-' ) {
+        if( streq(argv[0], "--samples") && argc > 1 )
+            Samples = atoi(argv[1]);
+        else if( streq(argv[0], "--min-time") && argc > 1 )
+            Min_Time = atof(argv[1]) / 1000;
+        else {
+            char *desc[] = {name, "[--samples <n>]", "[--min-time <ms>]", "[<name>...]"};
+            usage(4, desc);
+            return 1;
+        }
+
+        argc -= 2;
+        argv += 2;
+    }
+
+    if( Samples < 1 )
+        die("--samples must be at least 1");
+
+    printf("%-20s %-5s %12s %10s %10s %10s %9s\n",
+           "benchmark", "", "iterations", "min", "median", "mean", "stddev");
+
+    for( Bench *bench = Benches; bench->name != NULL; bench++ ) {
+        if( wanted(bench, argc, argv) )
+            run_bench(bench);
+    }
+
+    free(Evict_Buf);
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include "common.h"
+#include "pipeline.h"
+#include "pool.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NUM_LINES 20000
+
+typedef struct {
+    long expect;
+    long sum;
+} Folded;
+
+static bool parse_num(char *line, void *record, void *data) {
+    if( is_blank(line) )
+        return false;
+
+    *(long *)record = atol(line);
+    return true;
+}
+
+/* Also checks they come out in the order they went in */
+static void fold_num(void *record, void *data) {
+    Folded *folded = data;
+    long num = *(long *)record;
+
+    assert( num == folded->expect );
+    folded->expect++;
+    folded->sum += num;
+}
+
+static FILE *numbers_file(long num_lines) {
+    FILE *fp = tmpfile();
+    assert( fp != NULL );
+
+    for( long i = 0; i < num_lines; i++ ) {
+        fprintf(fp, "%ld\n", i);
+        /* Skipped lines */
+        if( i % 7 == 0 )
+            fputs("\n", fp);
+    }
+
+    rewind(fp);
+    return fp;
+}
+
+static void test_run(long num_lines, size_t batch_lines, size_t queue_depth) {
+    FILE *fp = numbers_file(num_lines);
+    Folded folded = { .expect = 0, .sum = 0 };
+    Pipeline pipeline = {
+        .record_size = sizeof(long),
+        .parse       = parse_num,
+        .fold        = fold_num,
+        .data        = &folded,
+        .batch_lines = batch_lines,
+        .queue_depth = queue_depth
+    };
+
+    long num_records = pipeline_run(&pipeline, fp);
+
+    assert( num_records == num_lines );
+    assert( folded.expect == num_lines );
+    assert( folded.sum == num_lines * (num_lines - 1) / 2 );
+
+    fclose(fp);
+}
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+#define STALL_USEC 300000
+
+/* Half the lines, a pause, then the rest */
+static void *write_stalled(void *arg) {
+    FILE *out = arg;
+
+    for( long i = 0; i < NUM_LINES; i++ ) {
+        if( i == NUM_LINES / 2 ) {
+            fflush(out);
+            usleep(STALL_USEC);
+        }
+        fprintf(out, "%ld\n", i);
+    }
+    fclose(out);
+
+    return NULL;
+}
+
+/* While the input stalls the stages sleep, they don't spin */
+static void test_stalled_input() {
+    int fds[2];
+    assert( pipe(fds) == 0 );
+    FILE *in  = fdopen(fds[0], "r");
+    FILE *out = fdopen(fds[1], "w");
+
+    Folded folded = { .expect = 0, .sum = 0 };
+    Pipeline pipeline = {
+        .record_size = sizeof(long),
+        .parse       = parse_num,
+        .fold        = fold_num,
+        .data        = &folded,
+        .batch_lines = 16
+    };
+
+    pthread_t writer;
+    pthread_create(&writer, NULL, write_stalled, out);
+
+    double wall = clock_seconds(CLOCK_MONOTONIC);
+    double cpu  = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    assert( pipeline_run(&pipeline, in) == NUM_LINES );
+    wall = clock_seconds(CLOCK_MONOTONIC) - wall;
+    cpu  = clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+
+    pthread_join(writer, NULL);
+    fclose(in);
+
+    assert( wall >= STALL_USEC / 1e6 );
+    /* A stage spinning through the stall takes a whole CPU, or at
+       least half of one when there's only one */
+    assert( cpu < wall / 4 );
+}
+
+int main(int argc, char **argv) {
+    pool_set_threads(4);
+
+    test_run(NUM_LINES, 0, 0);
+    test_run(0, 0, 0);
+    /* Every handoff waits */
+    test_run(NUM_LINES, 1, 1);
+    /* Odd sizes, and a batch bigger than the input */
+    test_run(NUM_LINES, 3, 3);
+    test_run(100, 4096, 2);
+    test_stalled_input();
+
+    pool_set_threads(1);
+    test_run(NUM_LINES, 0, 0);
+
+    printf("%s: PASS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include "common.h"
+#include "pool.h"
+#include "solve.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_ITEMS 100000
+
+static void count_visits(long from, long to, void *data) {
+    atomic_int *visits = data;
+
+    for( long i = from; i < to; i++ ) {
+        atomic_fetch_add(&visits[i], 1);
+    }
+}
+
+static void sum_range(long from, long to, void *data, void *partial) {
+    long *sum = partial;
+
+    for( long i = from; i < to; i++ ) {
+        *sum += i;
+    }
+}
+
+static void add_sums(void *result, const void *partial, void *data) {
+    *(long *)result += *(const long *)partial;
+}
+
+static void nested_sums(long from, long to, void *data, void *partial) {
+    for( long i = from; i < to; i++ ) {
+        long sum = 0;
+        pool_reduce(0, 100, 1, sum_range, add_sums, &sum, sizeof(sum), NULL);
+        *(long *)partial += sum;
+    }
+}
+
+void test_for_visits_everything_once() {
+    atomic_int *visits = calloc(NUM_ITEMS, sizeof(atomic_int));
+
+    pool_for(0, NUM_ITEMS, 7, count_visits, visits);
+
+    for( long i = 0; i < NUM_ITEMS; i++ ) {
+        assert( visits[i] == 1 );
+    }
+
+    free(visits);
+}
+
+void test_reduce() {
+    long sum = 0;
+    pool_reduce(0, NUM_ITEMS, 100, sum_range, add_sums, &sum, sizeof(sum), NULL);
+    assert( sum == (long)NUM_ITEMS * (NUM_ITEMS - 1) / 2 );
+
+    /* Again, the pool is reused */
+    sum = 0;
+    pool_reduce(10, 20, 1, sum_range, add_sums, &sum, sizeof(sum), NULL);
+    assert( sum == 145 );
+}
+
+void test_empty() {
+    long sum = 0;
+    pool_reduce(5, 5, 1, sum_range, add_sums, &sum, sizeof(sum), NULL);
+    assert( sum == 0 );
+}
+
+void test_nested() {
+    long sum = 0;
+    pool_reduce(0, 50, 1, nested_sums, add_sums, &sum, sizeof(sum), NULL);
+    assert( sum == 50 * 4950 );
+}
+
+static void sum_to_bad(long from, long to, void *data, void *partial) {
+    for( long i = from; i < to; i++ ) {
+        if( i == 777 )
+            die("Item %ld is bad", i);
+        *(long *)partial += i;
+    }
+}
+
+static int solve_sum_to_bad(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    long sum = 0;
+    pool_reduce(0, NUM_ITEMS, 10, sum_to_bad, add_sums, &sum, sizeof(sum), NULL);
+
+    return 0;
+}
+
+/* A body which dies fails the solve, not the process */
+void test_die() {
+    SolveContext *ctx = SolveContext_new();
+
+    for( int i = 0; i < 10; i++ ) {
+        assert( SolveContext_solve(ctx, solve_sum_to_bad, "", 0, 0, NULL) == 1 );
+        assert( streq(ctx->error, "Item 777 is bad") );
+    }
+    SolveContext_destroy(ctx);
+
+    /* The pool carries on */
+    test_reduce();
+}
+
+static void *reduce_in_thread(void *data) {
+    for( int i = 0; i < 100; i++ ) {
+        long sum = 0;
+        pool_reduce(0, NUM_ITEMS, 100, sum_range, add_sums, &sum, sizeof(sum), NULL);
+        assert( sum == (long)NUM_ITEMS * (NUM_ITEMS - 1) / 2 );
+    }
+
+    return NULL;
+}
+
+/* Loops from several threads at once take turns */
+void test_other_threads() {
+    pthread_t threads[4];
+
+    for( int i = 0; i < 4; i++ ) {
+        pthread_create(&threads[i], NULL, reduce_in_thread, NULL);
+    }
+    reduce_in_thread(NULL);
+    for( int i = 0; i < 4; i++ ) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+int main(int argc, char **argv) {
+    /* More threads than CPUs shakes out more races */
+    pool_set_threads(8);
+
+    test_for_visits_everything_once();
+    test_reduce();
+    test_empty();
+    test_nested();
+    test_other_threads();
+    test_die();
+
+    printf("%s: PASS\n", argv[0]);
+}
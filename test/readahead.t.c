@@ -0,0 +1,202 @@
+#include "common.h"
+#include "readahead.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Line i is i repeated (i % 50) + 1 times, every thousandth is longer
+   than a whole buffer, so lines land across buffers every which way */
+static char *make_text(long num_lines, bool last_newline, size_t *len) {
+    char *text = NULL;
+    FILE *fp = open_memstream(&text, len);
+
+    for( long i = 0; i < num_lines; i++ ) {
+        long repeat = i % 1000 == 999 ? READAHEAD_BUF_SIZE / 3 : i % 50 + 1;
+        for( long j = 0; j < repeat; j++ ) {
+            fputc('0' + i % 10, fp);
+        }
+        if( i < num_lines - 1 || last_newline )
+            fputc('\n', fp);
+    }
+
+    fclose(fp);
+    return text;
+}
+
+static void check_lines(Readahead *reader, const char *text, size_t text_len) {
+    const char *want = text;
+    const char *end = text + text_len;
+    char *line;
+    size_t len;
+
+    while( (line = Readahead_line(reader, &len)) != NULL ) {
+        const char *newline = memchr(want, '\n', end - want);
+        size_t want_len = newline ? newline + 1 - want : (size_t)(end - want);
+
+        assert( len == want_len );
+        assert( strlen(line) == len );
+        assert( memcmp(line, want, len) == 0 );
+
+        /* Callers may change the line, that must not leak into the next */
+        line[0] = 'X';
+        want += want_len;
+    }
+
+    assert( want == end );
+}
+
+typedef struct {
+    int fd;
+    const char *text;
+    size_t len;
+} Writer;
+
+static void *write_text(void *arg) {
+    Writer *writer = arg;
+
+    for( size_t done = 0; done < writer->len; ) {
+        size_t chunk = writer->len - done < 1000 ? writer->len - done : 1000;
+        ssize_t wrote = write(writer->fd, writer->text + done, chunk);
+        assert( wrote > 0 );
+        done += wrote;
+    }
+    close(writer->fd);
+
+    return NULL;
+}
+
+/* Another thread writes the text down a pipe in small pieces, like a
+   decompressor would */
+static void test_pipe(long num_lines, bool last_newline) {
+    size_t text_len;
+    char *text = make_text(num_lines, last_newline, &text_len);
+    int fds[2];
+    assert( pipe(fds) == 0 );
+
+    Writer writer = { .fd = fds[1], .text = text, .len = text_len };
+    pthread_t thread;
+    assert( pthread_create(&thread, NULL, write_text, &writer) == 0 );
+
+    Readahead *reader = Readahead_new(fds[0]);
+    check_lines(reader, text, text_len);
+    Readahead_destroy(reader);
+    close(fds[0]);
+    pthread_join(thread, NULL);
+
+    free(text);
+}
+
+/* The same pipe read as bytes, in pieces of every size */
+static void test_read() {
+    size_t text_len;
+    char *text = make_text(5000, true, &text_len);
+    int fds[2];
+    assert( pipe(fds) == 0 );
+
+    Writer writer = { .fd = fds[1], .text = text, .len = text_len };
+    pthread_t thread;
+    assert( pthread_create(&thread, NULL, write_text, &writer) == 0 );
+
+    Readahead *reader = Readahead_new(fds[0]);
+    char *got = malloc(text_len);
+    size_t got_len = 0;
+    ssize_t len;
+
+    for( size_t size = 1; (len = Readahead_read(reader, got + got_len, size)) > 0; size = size * 3 % 10007 + 1 ) {
+        assert( (size_t)len <= size );
+        got_len += len;
+        assert( got_len <= text_len );
+    }
+    assert( len == 0 );
+    assert( got_len == text_len );
+    assert( memcmp(got, text, text_len) == 0 );
+
+    Readahead_destroy(reader);
+    close(fds[0]);
+    pthread_join(thread, NULL);
+
+    free(got);
+    free(text);
+}
+
+static void test_file(long num_lines, bool last_newline) {
+    size_t text_len;
+    char *text = make_text(num_lines, last_newline, &text_len);
+    FILE *fp = tmpfile();
+    assert( fwrite(text, 1, text_len, fp) == text_len );
+    fflush(fp);
+    rewind(fp);
+
+    Readahead *reader = Readahead_new(fileno(fp));
+    check_lines(reader, text, text_len);
+    Readahead_destroy(reader);
+
+    fclose(fp);
+    free(text);
+}
+
+/* Stopping early, with the writer still going */
+static void test_destroy_early() {
+    int fds[2];
+    assert( pipe(fds) == 0 );
+    assert( write(fds[1], "one\ntwo\n", 8) == 8 );
+
+    Readahead *reader = Readahead_new(fds[0]);
+    size_t len;
+    assert( streq(Readahead_line(reader, &len), "one\n") );
+    Readahead_destroy(reader);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void count_line(char *line, void *count) {
+    (*(long *)count)++;
+}
+
+static void test_foreach_line() {
+    size_t text_len;
+    char *text = make_text(3000, true, &text_len);
+    FILE *fp = tmpfile();
+    long count = 0;
+
+    fwrite(text, 1, text_len, fp);
+    rewind(fp);
+    foreach_line(fp, count_line, &count);
+    assert( count == 3000 );
+
+    /* Once stdio has read some it carries on from there, not from
+       wherever stdio left the descriptor */
+    rewind(fp);
+    count = 0;
+    assert( fgetc(fp) == '0' );
+    assert( fgetc(fp) == '\n' );
+    foreach_line(fp, count_line, &count);
+    assert( count == 2999 );
+    assert( fgetc(fp) == EOF );
+
+    fclose(fp);
+    free(text);
+}
+
+int main(int argc, char **argv) {
+    test_pipe(0, true);
+    test_pipe(1, false);
+    test_pipe(5000, true);
+    test_pipe(5000, false);
+
+    /* Small enough to read without a thread, and not */
+    test_file(20, true);
+    test_file(20, false);
+    test_file(5000, true);
+
+    test_read();
+    test_destroy_early();
+    test_foreach_line();
+
+    printf("%s: PASS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,252 @@
+#include "common.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Guards against a solver quietly becoming quadratic or exponential.
+
+   Each kernel runs at growing input sizes made by bench/gen, and the
+   growth in its time is fitted against the complexity class it should
+   have.  A fitted exponent of 1 means it grows exactly as its class, 2
+   means it grows as the class squared.  It fails if the exponent is
+   over budget, or if the largest size takes longer than its envelope.
+
+   Times are the best of several runs, so noise only makes a kernel
+   look faster. */
+
+int day7_main(int argc, char **argv);
+int day9_main(int argc, char **argv);
+int day10_main(int argc, char **argv);
+int day12_main(int argc, char **argv);
+int day18_main(int argc, char **argv);
+
+#define MAX_SIZES 8
+
+/* The log of each complexity class, so n! doesn't overflow */
+typedef double (*LogComplexity)(double n);
+
+static double log_n(double n)         { return log(n); }
+static double log_n_squared(double n) { return 2 * log(n); }
+static double log_factorial(double n) { return lgamma(n + 1); }
+static double log_held_karp(double n) { return n * log(2) + 2 * log(n); }
+
+typedef struct {
+    const char *name;
+    int day;
+    int (*main)(int argc, char **argv);
+
+    /* The generated input is passed as the argument instead of a file */
+    bool input_is_arg;
+    /* Arguments after the input */
+    char *args[3];
+    /* ADVENT_ENGINE while it runs, see tune.h */
+    const char *engine;
+
+    LogComplexity log_class;
+    const char *class_desc;
+    double max_exponent;
+    double max_seconds;
+
+    long sizes[MAX_SIZES];
+} Kernel;
+
+static Kernel Kernels[] = {
+    {
+        .name = "graph route search",     .day = 9,  .main = day9_main,
+        .engine = "graph=search",
+        .log_class = log_factorial,       .class_desc = "n!",
+        .max_exponent = 1.3,              .max_seconds = 5,
+        .sizes = { 6, 7, 8, 9 }
+    },
+    {
+        .name = "graph route DP",         .day = 9,  .main = day9_main,
+        .engine = "graph=dp",
+        .log_class = log_held_karp,       .class_desc = "2^n n^2",
+        .max_exponent = 1.3,              .max_seconds = 5,
+        .sizes = { 10, 12, 14, 16 }
+    },
+    {
+        .name = "day7 circuit evaluation", .day = 7, .main = day7_main,
+        .args = { "a" },
+        .log_class = log_n,               .class_desc = "n",
+        .max_exponent = 1.4,              .max_seconds = 5,
+        .sizes = { 4000, 8000, 16000, 32000, 64000 }
+    },
+    {
+        .name = "day10 look-and-say",     .day = 10, .main = day10_main,
+        .input_is_arg = true,             .args = { "20" },
+        .log_class = log_n,               .class_desc = "n",
+        .max_exponent = 1.4,              .max_seconds = 5,
+        .sizes = { 500, 1000, 2000, 4000, 8000 }
+    },
+    {
+        .name = "day12 JSON sum",         .day = 12, .main = day12_main,
+        .log_class = log_n,               .class_desc = "n",
+        .max_exponent = 1.4,              .max_seconds = 5,
+        .sizes = { 5000, 10000, 20000, 40000, 80000 }
+    },
+    {
+        .name = "day18 stepping",         .day = 18, .main = day18_main,
+        .args = { "10" },
+        .log_class = log_n_squared,       .class_desc = "n^2",
+        .max_exponent = 1.3,              .max_seconds = 5,
+        .sizes = { 25, 50, 100, 200 }
+    },
+    { .name = NULL }
+};
+
+static double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static char *slurp_line(const char *filename) {
+    FILE *fp = open_file(filename, "r");
+    char *line = NULL;
+    size_t len = 0;
+
+    if( getline(&line, &len, fp) < 0 )
+        die("%s is empty", filename);
+    fclose(fp);
+
+    line[strcspn(line, "\n")] = '\0';
+
+    return line;
+}
+
+static void generate(const char *gen, int day, long size, const char *file) {
+    char *cmd = g_strdup_printf("%s %d %ld > %s", gen, day, size, file);
+
+    if( system(cmd) != 0 )
+        die("'%s' failed", cmd);
+
+    g_free(cmd);
+}
+
+/* Run the solver with its answers thrown away, returns the seconds taken */
+static double run_quietly(Kernel *kernel, int argc, char **argv) {
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    double start = now_seconds();
+    kernel->main(argc, argv);
+    fflush(stdout);
+    double took = now_seconds() - start;
+
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    return took;
+}
+
+/* Best of at least 3 runs and 50ms, so tiny sizes aren't all noise */
+static double time_kernel(Kernel *kernel, const char *input) {
+    char *argv[6] = { "scaling" };
+    int argc = 1;
+
+    char *line = kernel->input_is_arg ? slurp_line(input) : NULL;
+    argv[argc++] = line ? line : (char *)input;
+    for( int i = 0; kernel->args[i] != NULL; i++ ) {
+        argv[argc++] = kernel->args[i];
+    }
+
+    if( kernel->engine )
+        setenv("ADVENT_ENGINE", kernel->engine, 1);
+
+    double best = INFINITY;
+    double total = 0;
+    for( int runs = 0; runs < 3 || (total < 0.05 && runs < 1000); runs++ ) {
+        double took = run_quietly(kernel, argc, argv);
+        best = MIN(best, took);
+        total += took;
+    }
+
+    unsetenv("ADVENT_ENGINE");
+    free(line);
+
+    return best;
+}
+
+/* Least squares slope of log(time) against log(class) */
+static double fit_exponent(Kernel *kernel, double *seconds, int num_sizes) {
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+
+    for( int i = 0; i < num_sizes; i++ ) {
+        double x = kernel->log_class(kernel->sizes[i]);
+        double y = log(seconds[i]);
+
+        sum_x  += x;
+        sum_y  += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+    }
+
+    return (num_sizes * sum_xy - sum_x * sum_y) /
+           (num_sizes * sum_xx - sum_x * sum_x);
+}
+
+static bool test_kernel(Kernel *kernel, const char *gen, const char *dir) {
+    double seconds[MAX_SIZES];
+    int num_sizes = 0;
+
+    for( ; num_sizes < MAX_SIZES && kernel->sizes[num_sizes]; num_sizes++ ) {
+        long size = kernel->sizes[num_sizes];
+        char *input = g_strdup_printf("%s/day%d-%ld", dir, kernel->day, size);
+
+        generate(gen, kernel->day, size, input);
+        seconds[num_sizes] = time_kernel(kernel, input);
+
+        unlink(input);
+        g_free(input);
+    }
+
+    double exponent = fit_exponent(kernel, seconds, num_sizes);
+    double largest  = seconds[num_sizes-1];
+    bool ok = exponent <= kernel->max_exponent && largest <= kernel->max_seconds;
+
+    printf("%s - %s: (%s)^%.2f, budget %.2f; %.3fs at %ld, budget %.0fs\n",
+           ok ? "ok" : "not ok", kernel->name,
+           kernel->class_desc, exponent, kernel->max_exponent,
+           largest, kernel->sizes[num_sizes-1], kernel->max_seconds);
+
+    if( !ok ) {
+        for( int i = 0; i < num_sizes; i++ ) {
+            printf("#\t%8ld\t%.6fs\n", kernel->sizes[i], seconds[i]);
+        }
+    }
+
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    char *gen = getenv("GEN");
+    if( !gen || is_empty(gen) )
+        gen = "./bench/gen";
+
+    char dir[] = "/tmp/scaling.t.XXXXXX";
+    if( !mkdtemp(dir) )
+        die("Could not make a temp directory: %s", strerror(errno));
+
+    bool ok = true;
+    for( Kernel *kernel = Kernels; kernel->name != NULL; kernel++ ) {
+        if( !test_kernel(kernel, gen, dir) )
+            ok = false;
+    }
+
+    rmdir(dir);
+
+    if( !ok )
+        return 1;
+
+    printf("%s: PASS\n", argv[0]);
+    return 0;
+}
@@ -0,0 +1,234 @@
+#include "common.h"
+#include "phase.h"
+#include "pool.h"
+#include "solve.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define NUM_THREADS 4
+#define NUM_SOLVES  50
+
+static const char Day2_Input[]  = "2x3x4\n1x1x10\n";
+static const char Day2_Answer[] = "The elves need 101 sqft of paper and 48 ft of ribbon.\n";
+static const char Day9_Input[]  = "London to Dublin = 464\nLondon to Belfast = 518\nDublin to Belfast = 141\n";
+static const char Day9_Answer[] = "605\n";
+
+static int Destroyed = 0;
+
+static void count_destroy(void *thing) {
+    Destroyed++;
+    free(thing);
+}
+
+static int solve_echo(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    size_t len;
+    const char *buf = SolveContext_map(ctx, input, &len);
+
+    SolveContext_printf(ctx, "%.*s", (int)len, buf);
+    for( int i = 0; i < argc; i++ ) {
+        SolveContext_printf(ctx, " %s", argv[i]);
+    }
+    phase_items(len);
+
+    return 0;
+}
+
+static int solve_die(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    SolveContext_own(ctx, malloc(1), count_destroy);
+    SolveContext_own(ctx, malloc(1), count_destroy);
+
+    phase_begin("outer");
+    phase_begin("inner");
+    die("No %s here", "answer");
+
+    return 0;
+}
+
+static int solve_count_lines(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    char *line = NULL;
+    size_t line_size = 0;
+    int lines = 0;
+
+    while( getline(&line, &line_size, input) > 0 )
+        lines++;
+    free(line);
+
+    SolveContext_printf(ctx, "%d", lines);
+
+    return 0;
+}
+
+static GRegex *Seen_Regex = NULL;
+
+static int solve_regex(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    size_t len;
+    const char *buf = SolveContext_map(ctx, input, &len);
+
+    Seen_Regex = SolveContext_regex(ctx, "^a+$", G_REGEX_OPTIMIZE);
+    SolveContext_printf(ctx, "%d", g_regex_match(Seen_Regex, SolveContext_strndup(ctx, buf, len), 0, NULL));
+
+    return 0;
+}
+
+static void die_at_b(char *line, void *lines) {
+    if( line[0] == 'b' )
+        die("Got to b after %d lines", *(int *)lines);
+    (*(int *)lines)++;
+}
+
+static int solve_foreach_die(SolveContext *ctx, FILE *input, int argc, char **argv) {
+    int lines = 0;
+    foreach_line(input, die_at_b, &lines);
+
+    return 0;
+}
+
+void test_output() {
+    SolveContext *ctx = SolveContext_new();
+    char *argv[] = { "b", "c" };
+
+    assert( SolveContext_solve(ctx, solve_echo, "a", 1, 2, argv) == 0 );
+    assert( streq(ctx->output->str, "a b c") );
+    assert( ctx->error == NULL );
+    assert( ctx->stats.input_len == 1 );
+    assert( ctx->stats.items == 1 );
+
+    /* The output is each solve's own */
+    assert( SolveContext_solve(ctx, solve_echo, "xyz", 3, 0, NULL) == 0 );
+    assert( streq(ctx->output->str, "xyz") );
+
+    SolveContext_destroy(ctx);
+}
+
+void test_die() {
+    SolveContext *ctx = SolveContext_new();
+
+    Destroyed = 0;
+    assert( SolveContext_solve(ctx, solve_die, "", 0, 0, NULL) == 1 );
+    assert( streq(ctx->error, "No answer here") );
+    assert( Destroyed == 2 );
+    assert( phase_depth() == 0 );
+
+    /* The context can be used again */
+    assert( SolveContext_solve(ctx, solve_echo, "a", 1, 0, NULL) == 0 );
+    assert( ctx->error == NULL );
+    assert( streq(ctx->output->str, "a") );
+
+    /* A file which isn't there fails the solve, not the process */
+    assert( SolveContext_solve_file(ctx, solve_echo, "/no/such/file", 0, NULL) == 1 );
+    assert( strstr(ctx->error, "/no/such/file") != NULL );
+
+    SolveContext_destroy(ctx);
+}
+
+void test_stream() {
+    SolveContext *ctx = SolveContext_new();
+
+    assert( SolveContext_solve(ctx, solve_count_lines, "a\nb\nc", 5, 0, NULL) == 0 );
+    assert( streq(ctx->output->str, "3") );
+
+    assert( SolveContext_solve(ctx, solve_count_lines, NULL, 0, 0, NULL) == 0 );
+    assert( streq(ctx->output->str, "0") );
+
+    SolveContext_destroy(ctx);
+}
+
+/* A file is a stream, mapped only if the solve asks */
+void test_file() {
+    SolveContext *ctx = SolveContext_new();
+    char filename[] = "/tmp/solve.t.XXXXXX";
+    int fd = mkstemp(filename);
+    assert( fd >= 0 );
+    assert( write(fd, "a\nb\nc\n", 6) == 6 );
+    close(fd);
+
+    assert( SolveContext_solve_file(ctx, solve_count_lines, filename, 0, NULL) == 0 );
+    assert( streq(ctx->output->str, "3") );
+    assert( ctx->stats.input_len == 0 );
+
+    assert( SolveContext_solve_file(ctx, solve_echo, filename, 0, NULL) == 0 );
+    assert( streq(ctx->output->str, "a\nb\nc\n") );
+    assert( ctx->stats.input_len == 6 );
+
+    /* Dying in foreach_line()'s callback stops its read ahead */
+    assert( SolveContext_solve_file(ctx, solve_foreach_die, filename, 0, NULL) == 1 );
+    assert( streq(ctx->error, "Got to b after 1 lines") );
+
+    unlink(filename);
+    SolveContext_destroy(ctx);
+}
+
+void test_regex_kept() {
+    SolveContext *ctx = SolveContext_new();
+
+    assert( SolveContext_solve(ctx, solve_regex, "aaa\n", 4, 0, NULL) == 0 );
+    assert( streq(ctx->output->str, "1") );
+    GRegex *first = Seen_Regex;
+
+    assert( SolveContext_solve(ctx, solve_regex, "ab", 2, 0, NULL) == 0 );
+    assert( streq(ctx->output->str, "0") );
+    assert( Seen_Regex == first );
+
+    SolveContext_destroy(ctx);
+}
+
+/* A bad line dies in the middle of reading */
+void test_day_dies() {
+    SolveContext *ctx = SolveContext_new();
+    const char *input = "London to Dublin = 464\nsomething else\n";
+
+    assert( SolveContext_solve(ctx, day9_solve, input, strlen(input), 0, NULL) == 1 );
+    assert( streq(ctx->error, "Unknown line 'something else\n'") );
+    assert( phase_depth() == 0 );
+
+    assert( SolveContext_solve(ctx, day9_solve, Day9_Input, strlen(Day9_Input), 0, NULL) == 0 );
+    assert( streq(ctx->output->str, Day9_Answer) );
+
+    SolveContext_destroy(ctx);
+}
+
+static void *solve_in_thread(void *data) {
+    SolveContext *ctx = SolveContext_new();
+
+    for( int i = 0; i < NUM_SOLVES; i++ ) {
+        assert( SolveContext_solve(ctx, day9_solve, Day9_Input, strlen(Day9_Input), 0, NULL) == 0 );
+        assert( streq(ctx->output->str, Day9_Answer) );
+
+        assert( SolveContext_solve(ctx, day2_solve, Day2_Input, strlen(Day2_Input), 0, NULL) == 0 );
+        assert( streq(ctx->output->str, Day2_Answer) );
+    }
+
+    SolveContext_destroy(ctx);
+
+    return NULL;
+}
+
+/* Each thread has its own context, nothing else is shared */
+void test_threads() {
+    pthread_t threads[NUM_THREADS];
+
+    for( int i = 0; i < NUM_THREADS; i++ ) {
+        pthread_create(&threads[i], NULL, solve_in_thread, NULL);
+    }
+    solve_in_thread(NULL);
+    for( int i = 0; i < NUM_THREADS; i++ ) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+int main(int argc, char **argv) {
+    pool_set_threads(4);
+
+    test_output();
+    test_die();
+    test_stream();
+    test_file();
+    test_regex_kept();
+    test_day_dies();
+    test_threads();
+
+    printf("%s: PASS\n", argv[0]);
+}
@@ -0,0 +1,86 @@
+#include "common.h"
+#include "trace.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static char *slurp(const char *filename) {
+    FILE *fp = open_file(filename, "r");
+    char *contents = NULL;
+    size_t len = 0;
+
+    getdelim(&contents, &len, '\0', fp);
+    fclose(fp);
+
+    return contents;
+}
+
+static int count_matches(const char *haystack, const char *needle) {
+    int count = 0;
+    for( const char *pos = haystack; (pos = strstr(pos, needle)) != NULL; pos++ ) {
+        count++;
+    }
+
+    return count;
+}
+
+static void *thread_events(void *unused) {
+    TRACE_BEGIN("thread");
+    TRACE_END("thread");
+
+    return NULL;
+}
+
+void test_disabled() {
+    unsetenv("ADVENT_TRACE");
+    Trace_Enabled = -1;
+
+    TRACE_BEGIN("nothing");
+    assert( Trace_Enabled == 0 );
+}
+
+void test_dump() {
+    char filename[] = "/tmp/trace.t.XXXXXX";
+    close(mkstemp(filename));
+
+    setenv("ADVENT_TRACE", filename, 1);
+    Trace_Enabled = -1;
+
+    TRACE_BEGIN("outer");
+    TRACE_BEGIN("inner");
+    TRACE_COUNTER("things", 42);
+    TRACE_END("inner");
+    TRACE_END("outer");
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, thread_events, NULL);
+    pthread_join(thread, NULL);
+
+    trace_dump();
+
+    char *json = slurp(filename);
+
+    assert( strncmp(json, "{\"traceEvents\":[", 16) == 0 );
+    assert( count_matches(json, "\"ph\":\"B\"") == 3 );
+    assert( count_matches(json, "\"ph\":\"E\"") == 3 );
+    assert( count_matches(json, "\"name\":\"inner\",\"ph\":\"B\"") == 1 );
+    assert( count_matches(json, "\"args\":{\"value\":42}") == 1 );
+
+    /* The thread's events are in their own buffer */
+    assert( count_matches(json, "\"tid\":1") == 5 );
+    assert( count_matches(json, "\"tid\":2") == 2 );
+
+    free(json);
+    unlink(filename);
+
+    /* Don't dump again at exit */
+    Trace_Enabled = 0;
+}
+
+int main(int argc, char **argv) {
+    test_disabled();
+    test_dump();
+    printf("%s: PASS\n", argv[0]);
+}
@@ -0,0 +1,105 @@
+#include "common.h"
+#include "tune.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static const char *Engines[] = { "slow", "fast", "faster", NULL };
+
+static void test_bucket() {
+    assert( tune_bucket(0) == 0 );
+    assert( tune_bucket(1) == 0 );
+    assert( tune_bucket(2) == 2 );
+    assert( tune_bucket(3) == 3 );
+    assert( tune_bucket(4) == 4 );
+    assert( tune_bucket(5) == 4 );
+    assert( tune_bucket(6) == 5 );
+    assert( tune_bucket(1024) == 20 );
+    assert( tune_bucket(1L << 40) == 80 );
+}
+
+static void test_untuned() {
+    assert( tune_engine("thing", Engines, 100, 1) == 1 );
+    assert( tune_engine("thing", Engines, 100, 0) == 0 );
+}
+
+static void test_save() {
+    tune_save("thing", tune_bucket(16), "fast");
+    tune_save("thing", tune_bucket(1024), "faster");
+    tune_save("other", tune_bucket(16), "slow");
+
+    assert( tune_engine("thing", Engines, 16, 0) == 1 );
+    assert( tune_engine("thing", Engines, 1024, 0) == 2 );
+
+    /* The nearest bucket, ties to the smaller */
+    assert( tune_engine("thing", Engines, 2, 0) == 1 );
+    assert( tune_engine("thing", Engines, 100, 0) == 1 );
+    assert( tune_engine("thing", Engines, 200, 0) == 2 );
+    assert( tune_engine("thing", Engines, 1L << 30, 0) == 2 );
+
+    /* Saving again replaces it */
+    tune_save("thing", tune_bucket(16), "slow");
+    assert( tune_engine("thing", Engines, 16, 1) == 0 );
+    assert( tune_engine("other", Engines, 16, 1) == 0 );
+}
+
+static void test_other_lines(const char *file) {
+    FILE *fp = open_file(file, "a");
+    fprintf(fp, "# a comment\n");
+    fprintf(fp, "some-other-host thing 8 faster\n");
+    fprintf(fp, "junk\n");
+    fclose(fp);
+
+    assert( tune_engine("thing", Engines, 16, 1) == 0 );
+
+    /* An engine the solver no longer has is skipped */
+    tune_save("thing", tune_bucket(16), "removed");
+    assert( tune_engine("thing", Engines, 16, 1) == 2 );
+
+    /* The rest of the file is kept */
+    tune_save("thing", tune_bucket(16), "fast");
+    fp = open_file(file, "r");
+    char line[256];
+    bool found_comment = false, found_host = false;
+    while( fgets(line, sizeof(line), fp) ) {
+        if( streq(line, "# a comment\n") )
+            found_comment = true;
+        if( streq(line, "some-other-host thing 8 faster\n") )
+            found_host = true;
+    }
+    fclose(fp);
+    assert( found_comment && found_host );
+}
+
+static void test_forced() {
+    setenv("ADVENT_ENGINE", "other=fast,thing=faster", 1);
+    assert( tune_engine("thing", Engines, 16, 0) == 2 );
+    assert( tune_engine("other", Engines, 16, 0) == 1 );
+    assert( tune_engine("nothing", Engines, 16, 0) == 0 );
+    unsetenv("ADVENT_ENGINE");
+}
+
+int main(int argc, char **argv) {
+    char dir[] = "/tmp/tune.t.XXXXXX";
+    if( !mkdtemp(dir) )
+        die("Could not make a temp directory: %s", strerror(errno));
+
+    char *file = g_strdup_printf("%s/tune", dir);
+    setenv("ADVENT_TUNE", file, 1);
+    unsetenv("ADVENT_ENGINE");
+
+    test_bucket();
+    test_untuned();
+    test_save();
+    test_other_lines(file);
+    test_forced();
+
+    unlink(file);
+    rmdir(dir);
+    g_free(file);
+
+    printf("%s: PASS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "common.h"
+#include "vec.h"
+#include "sort.h"
+#include <assert.h>
+#include <stdio.h>
+
+void test_push() {
+    Vec *vec = Vec_new(sizeof(long), 0);
+
+    assert( vec->len == 0 );
+
+    for( long i = 0; i < 1000; i++ ) {
+        Vec_push_val(vec, i);
+    }
+    assert( vec->len == 1000 );
+    assert( vec->capacity >= 1000 );
+
+    for( long i = 0; i < 1000; i++ ) {
+        assert( Vec_index(vec, long, i) == i );
+    }
+
+    Vec_clear(vec);
+    assert( vec->len == 0 );
+
+    long num = 42;
+    Vec_push_val(vec, num);
+    assert( Vec_index(vec, long, 0) == 42 );
+
+    Vec_destroy(vec);
+}
+
+void test_reserve() {
+    Vec *vec = Vec_new(sizeof(int), 100);
+    assert( vec->capacity == 100 );
+
+    Vec_reserve(vec, 10);
+    assert( vec->capacity == 100 );
+
+    Vec_destroy(vec);
+}
+
+void test_sort() {
+    int nums[] = { 5, -3, 12, 0, 5, 7 };
+    int want[] = { -3, 0, 5, 5, 7, 12 };
+    Vec *vec = Vec_new(sizeof(int), 0);
+
+    for( int i = 0; i < 6; i++ ) {
+        Vec_push_val(vec, nums[i]);
+    }
+
+    Vec_sort(vec, cmp_int);
+    for( int i = 0; i < 6; i++ ) {
+        assert( Vec_index(vec, int, i) == want[i] );
+    }
+
+    Vec_destroy(vec);
+}
+
+int main(int argc, char **argv) {
+    test_push();
+    test_reserve();
+    test_sort();
+
+    printf("%s: PASS\n", argv[0]);
+
+    return 0;
+}